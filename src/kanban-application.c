@@ -26,6 +26,7 @@
 #include "gtk/gtk.h"
 #include "gtk/gtkshortcut.h"
 #include "kanban-window.h"
+#include "utils/kanban-trace.h"
 
 bool SaveNeeded, IsInitialized = false;
 
@@ -75,12 +76,26 @@ kanban_application_activate (GApplication *app)
 	gtk_window_present (window);
 }
 
+static gint
+kanban_application_handle_local_options (GApplication *app,
+                                         GVariantDict *options)
+{
+	const gchar *trace_path = NULL;
+
+	if (g_variant_dict_lookup (options, "trace", "^&ay", &trace_path))
+		kanban_trace_start (trace_path, 0);
+
+	/* Go on as usual */
+	return -1;
+}
+
 static void
 kanban_application_class_init (KanbanApplicationClass *klass)
 {
 	GApplicationClass *app_class = G_APPLICATION_CLASS (klass);
 
 	app_class->activate = kanban_application_activate;
+	app_class->handle_local_options = kanban_application_handle_local_options;
 }
 
 static void
@@ -117,11 +132,13 @@ static void response(AdwMessageDialog *self, gchar *response,
   if (strstr (response, "save"))
     {
       save_cards (user_data);
-      SaveNeeded = false;
+    }
+  else if (strstr (response, "discard"))
+    {
+      discard_changes (user_data);
     }
 
-  GApplication *app = G_APPLICATION(gtk_window_get_application(GTK_WINDOW (user_data)));
-  g_application_quit(app);
+  quit_after_save (user_data);
 }
 
 // Crude solution, should however finally fix the unnecessary prompting
@@ -164,9 +181,28 @@ kanban_application_quit_action (GSimpleAction *action,
 	g_assert (KANBAN_IS_APPLICATION (self));
 
     if (!SaveNeeded) {
-      g_application_quit(G_APPLICATION(self));
+      GtkWindow *window = gtk_application_get_active_window (GTK_APPLICATION (self));
+
+      /* A save may still be writing the board */
+      if (window)
+        quit_after_save (window);
+      else
+        g_application_quit (G_APPLICATION (self));
+      return;
   } 
-  
+
+  /* With autosave on, closing the window writes the board first */
+  GSettings *settings = g_settings_new ("io.github.zhrexl.thisweekinmylife");
+  gboolean autosave = g_settings_get_boolean (settings, "autosave");
+  GtkWindow *window = gtk_application_get_active_window (GTK_APPLICATION (self));
+
+  g_object_unref (settings);
+
+  if (autosave && window) {
+    gtk_window_close (window);
+    return;
+  }
+
   save_before_quit(self);
 }
 static void
@@ -181,7 +217,6 @@ kanban_application_save_action (GSimpleAction *action,
         KanbanWindow* Window = KANBAN_WINDOW (gtk_application_get_active_window (GTK_APPLICATION (self)));
 
         save_cards (Window);
-        SaveNeeded = false;
 }
 static void
 kanban_application_new_action (GSimpleAction *action,
@@ -207,6 +242,16 @@ static const GActionEntry app_actions[] = {
 static void
 kanban_application_init (KanbanApplication *self)
 {
+	g_application_add_main_option (G_APPLICATION (self), "trace", 0, G_OPTION_FLAG_NONE,
+	                               G_OPTION_ARG_FILENAME,
+	                               "Record a trace to FILE on exit, to open in Perfetto", "FILE");
+	/* Only listed here, main() hands the command line over before the
+	 * application runs */
+	g_application_add_main_option (G_APPLICATION (self), "headless", 0, G_OPTION_FLAG_NONE,
+	                               G_OPTION_ARG_NONE,
+	                               "Run a batch command on boards without a window, see --headless --help",
+	                               NULL);
+
 	g_action_map_add_action_entries (G_ACTION_MAP (self),
 	                                 app_actions,
 	                                 G_N_ELEMENTS (app_actions),
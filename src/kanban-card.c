@@ -27,25 +27,40 @@
 #include "glib-object.h"
 #include "glib.h"
 #include "gtk/gtk.h"
-#include "kanban-application.h"
 #include "kanban-column.h"
+#include "kanban-text-buffer.h"
 #include "kanban-window.h"
-#include "utils/kanban-serializer.h"
+#include "utils/kanban-card-item.h"
+#include "utils/kanban-trace.h"
 
-static GParamSpec *needs_saving = NULL;
 
 struct _KanbanCard
 {
-  GtkListBoxRow      parent_instance;
+  AdwBin             parent_instance;
 
   GtkBox            *handlerDrag;
   GtkEditableLabel  *LblCardName;
   GtkRevealer       *revealercard;
-  GtkRevealer       *drop_revealer;
+  GtkWidget         *CardHeader;
   GtkTextView       *description;
   AdwButtonContent  *BtnContent;
   guint              description_changed;
-  gboolean           needs_saving;
+  guint              title_changed;
+
+  /* The card shown, materialized tells whether its description was put
+   * in the text view, which only happens once it is expanded */
+  KanbanCardItem    *item;
+  gboolean           materialized;
+
+  /* Task anchors still waiting for their widget, made a batch at a
+   * time from one idle source */
+  GPtrArray         *pending_tasks;
+  guint              pending_next;
+  guint              tasks_source;
+
+  /* The header as a texture, reused as drag icon until the title or
+   * the item shown changes */
+  GdkPaintable      *drag_icon;
 };
 
 const gchar checktemplate[] = "<task status=";
@@ -55,7 +70,7 @@ const gchar titlexml[]      = " title=\"";
 const gchar endtitle[]      = "\"/>";
 const gchar nullbyte[]      = "\0";
 
-G_DEFINE_FINAL_TYPE (KanbanCard, kanban_card, GTK_TYPE_LIST_BOX_ROW)
+G_DEFINE_FINAL_TYPE (KanbanCard, kanban_card, ADW_TYPE_BIN)
 
 KanbanCard* kanban_card_new (void)
 {
@@ -63,8 +78,71 @@ KanbanCard* kanban_card_new (void)
                       NULL);
 }
 
-void kanban_card_set_title(KanbanCard *Card, const char *title) {
-  gtk_editable_set_text(GTK_EDITABLE(Card->LblCardName), title);
+/*
+ * Cards let go by their list are kept here, unbound, and handed out
+ * again instead of building a new template. Only used from the main
+ * thread.
+ * */
+static GPtrArray* CardPool     = NULL;
+static guint      CardPoolSize = 64;
+static guint      CardPoolHits = 0;
+static guint      CardPoolMisses = 0;
+
+/* Returns a new reference to an unbound card */
+KanbanCard*
+kanban_card_pool_acquire (void)
+{
+  if (CardPool && CardPool->len > 0)
+    {
+      CardPoolHits++;
+      return g_ptr_array_steal_index_fast (CardPool, CardPool->len - 1);
+    }
+
+  CardPoolMisses++;
+  return g_object_ref_sink (kanban_card_new ());
+}
+
+/* Unbinds card and keeps it for later if there is room, the caller
+ * still has to let go of its own reference */
+void
+kanban_card_pool_release (KanbanCard* Card)
+{
+  kanban_card_unbind (Card);
+  kanban_card_set_reveal (Card, FALSE);
+
+  /* Still in its row, it goes with it */
+  if (gtk_widget_get_parent (GTK_WIDGET (Card)) != NULL)
+    return;
+
+  if (CardPool == NULL)
+    CardPool = g_ptr_array_new_with_free_func (g_object_unref);
+
+  if (CardPool->len < CardPoolSize)
+    g_ptr_array_add (CardPool, g_object_ref (Card));
+}
+
+void
+kanban_card_pool_set_size (guint size)
+{
+  CardPoolSize = size;
+
+  if (CardPool && CardPool->len > size)
+    g_ptr_array_set_size (CardPool, size);
+}
+
+void
+kanban_card_pool_get_stats (guint* hits, guint* misses)
+{
+  if (hits)
+    *hits = CardPoolHits;
+  if (misses)
+    *misses = CardPoolMisses;
+}
+
+KanbanCardItem*
+kanban_card_get_item(KanbanCard* Card)
+{
+  return Card->item;
 }
 
 const gchar*
@@ -79,9 +157,15 @@ kanban_card_get_reveal(KanbanCard* Card)
   return gtk_revealer_get_reveal_child (Card->revealercard);
 }
 
-void
-kanban_card_set_reveal(KanbanCard* card, gboolean revealed)
+static void materialize_description(KanbanCard* Card);
+
+/* Only updates the widgets, the item is left alone */
+static void
+show_reveal(KanbanCard* card, gboolean revealed)
 {
+  if (revealed && !card->materialized)
+    materialize_description (card);
+
   if (!revealed)
   {
     adw_button_content_set_icon_name (card->BtnContent, 
@@ -103,23 +187,45 @@ kanban_card_set_reveal(KanbanCard* card, gboolean revealed)
   gtk_revealer_set_reveal_child (card->revealercard, revealed);
 }
 
-/* the user must unref the returned pointer with g_bytes_unref() */
-GBytes*
+void
+kanban_card_set_reveal(KanbanCard* card, gboolean revealed)
+{
+  show_reveal (card, revealed);
+
+  if (card->item)
+    kanban_card_item_set_revealed (card->item, revealed);
+}
+
+/* the user must release the returned pointer with
+ * kanban_unserialized_content_free() */
+KanbanUnserializedContent*
 kanban_card_get_description(KanbanCard* Card)
 {
+  if (!Card->materialized)
+    return Card->item ? kanban_unserialized_content_copy (kanban_card_item_get_description (Card->item))
+                      : kanban_unserialized_content_new ();
+
   GtkTextBuffer* Buffer = gtk_text_view_get_buffer(Card->description);
-  return get_serialized_buffer (Buffer);
+  return get_buffer_content (Buffer);
 }
 
-void kanban_card_content_dropped(KanbanCard* self) {
-  gtk_revealer_set_reveal_child(self->drop_revealer, false);
+/* Task edits don't touch the text buffer, so they are tracked here. The
+ * item tells its column, which tells the board */
+static void
+kanban_card_task_changed(GtkWidget* widget, gpointer user_data)
+{
+  KanbanCard* card = KANBAN_CARD (user_data);
+
+  if (card->item)
+    kanban_card_item_description_changed (card->item);
 }
 
+/* Tasks made for a card per main loop iteration while it loads */
+#define TASK_BATCH 64
+
 static void
-create_task(GtkTextView* text_view, GtkTextIter* iter, const gchar* title, gboolean active)
+add_task_widget(KanbanCard* Card, GtkTextChildAnchor* anchor, const gchar* title, gboolean active)
 {
-
-  GtkTextChildAnchor* anchor = gtk_text_buffer_create_child_anchor (gtk_text_view_get_buffer (text_view), iter);
   GtkWidget* box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 5);
   gtk_widget_set_margin_start (box, 5);
 
@@ -128,60 +234,158 @@ create_task(GtkTextView* text_view, GtkTextIter* iter, const gchar* title, gbool
 
   gtk_check_button_set_active (GTK_CHECK_BUTTON (child), active);
 
+  g_signal_connect (child, "toggled", G_CALLBACK (kanban_card_task_changed), Card);
+  g_signal_connect (label, "changed", G_CALLBACK (kanban_card_task_changed), Card);
+
   gtk_box_append (GTK_BOX(box), child);
   gtk_box_append (GTK_BOX(box), label);
 
   //gtk_widget_set_size_request (child, 10, -1);
-  gtk_text_view_add_child_at_anchor (text_view, box, anchor);
+  gtk_text_view_add_child_at_anchor (Card->description, box, anchor);
   //gtk_text_buffer_insert_at_cursor (buffer, "\n", 1);"
 }
 
-void
-kanban_card_set_description(KanbanCard* Card,const gchar* description)
+static void
+create_task(KanbanCard* Card, GtkTextIter* iter, const gchar* title, gboolean active)
+{
+  GtkTextChildAnchor* anchor = gtk_text_buffer_create_child_anchor (gtk_text_view_get_buffer (Card->description), iter);
+
+  add_task_widget (Card, anchor, title, active);
+}
+
+/* Makes the widgets of up to TASK_BATCH pending tasks, in buffer order.
+ * Returns whether some are left */
+static gboolean
+create_pending_tasks(KanbanCard* Card)
+{
+  guint end = MIN (Card->pending_next + TASK_BATCH, Card->pending_tasks->len);
+
+  KANBAN_TRACE_SCOPE ("create_pending_tasks");
+  KANBAN_TRACE_COUNT ("task widgets", end - Card->pending_next);
+
+  for (; Card->pending_next < end; Card->pending_next++)
+  {
+    GtkTextChildAnchor* anchor = g_ptr_array_index (Card->pending_tasks, Card->pending_next);
+    gboolean done = FALSE;
+    gchar* title  = take_pending_task (anchor, &done);
+
+    /* Deleted by an edit before its turn came */
+    if (title && !gtk_text_child_anchor_get_deleted (anchor))
+      add_task_widget (Card, anchor, title, done);
+
+    g_free (title);
+  }
+
+  if (Card->pending_next < Card->pending_tasks->len)
+    return TRUE;
+
+  g_clear_pointer (&Card->pending_tasks, g_ptr_array_unref);
+  return FALSE;
+}
+
+static gboolean
+create_pending_tasks_idle(gpointer user_data)
+{
+  KanbanCard* Card = KANBAN_CARD (user_data);
+
+  if (create_pending_tasks (Card))
+    return G_SOURCE_CONTINUE;
+
+  Card->tasks_source = 0;
+  return G_SOURCE_REMOVE;
+}
+
+/* Pending tasks keep their content on their anchor, dropping them
+ * loses nothing */
+static void
+cancel_pending_tasks(KanbanCard* Card)
+{
+  g_clear_handle_id (&Card->tasks_source, g_source_remove);
+  g_clear_pointer (&Card->pending_tasks, g_ptr_array_unref);
+  Card->pending_next = 0;
+}
+
+/* Lets the item pull the description out of the text view */
+static KanbanUnserializedContent*
+buffer_source(gpointer user_data)
 {
-  int dsc_len = strlen(description);
+  KanbanCard* Card = KANBAN_CARD (user_data);
+
+  return get_buffer_content (gtk_text_view_get_buffer (Card->description));
+}
 
-  if (!dsc_len)
+/* Fills the text view from the item, then edits go back to it */
+static void
+materialize_description(KanbanCard* Card)
+{
+  if (Card->item == NULL)
     return;
 
+  KANBAN_TRACE_SCOPE ("materialize_description");
+  KANBAN_TRACE_COUNT ("cards materialized", 1);
+
+  const KanbanUnserializedContent* description = kanban_card_item_get_description (Card->item);
   GtkTextBuffer*  buf = gtk_text_view_get_buffer(Card->description);
+
   /* Block changed signal to avoid unnecessary unsaved file flag */
   g_signal_handler_block(buf, Card->description_changed);
 
-  KanbanUnserializedContent* KUnContent = get_unserialized_buffer (description);
+  /* Text and anchors go in one pass, the first tasks get their widget
+   * right away and the rest from an idle, a batch at a time */
+  cancel_pending_tasks (Card);
+  Card->pending_tasks = set_buffer_content (buf, description);
 
-  if (!KUnContent)
-  {
-    g_print ("Error loading saved filed\n");
+  if (create_pending_tasks (Card))
+    Card->tasks_source = g_idle_add_full (G_PRIORITY_LOW, create_pending_tasks_idle,
+                                          Card, NULL);
+  g_signal_handler_unblock(buf, Card->description_changed);
+
+  kanban_card_item_set_source (Card->item, buffer_source, Card);
+  Card->materialized = TRUE;
+}
+
+/*
+ * Shows item in the card, a card is bound to one item after another as
+ * its row is recycled. A collapsed item keeps its description to itself,
+ * the text buffer and task widgets are built on first expand
+ * */
+void
+kanban_card_bind(KanbanCard* Card, KanbanCardItem* item)
+{
+  kanban_card_unbind (Card);
+
+  Card->item = g_object_ref (item);
+  g_clear_object (&Card->drag_icon);
+
+  g_signal_handler_block (Card->LblCardName, Card->title_changed);
+  gtk_editable_set_text (GTK_EDITABLE (Card->LblCardName), kanban_card_item_get_title (item));
+  g_signal_handler_unblock (Card->LblCardName, Card->title_changed);
+
+  show_reveal (Card, kanban_card_item_get_revealed (item));
+}
+
+/* Hands the description back to the item and empties the card */
+void
+kanban_card_unbind(KanbanCard* Card)
+{
+  if (Card->item == NULL)
     return;
-  }
 
-  /* Set text description to buffer */
-  GBytes* bytes = g_byte_array_free_to_bytes(KUnContent->text);
-  gsize    size;
-  char* text = (char*)g_bytes_get_data (bytes, &size);
-
-  GtkTextIter iter;
-  gtk_text_buffer_set_text (buf, text, size);
-  gtk_text_buffer_get_end_iter(buf, &iter);
-  g_bytes_unref (bytes);
-
-  /* Create and insert the anchors in GtkTextView */
-  GList* elem = NULL;
-  /* For each inserted anchor offset increments by one */
-  int i = 0;
-  for(elem = KUnContent->anchors; elem; elem = elem->next)
+  if (Card->materialized)
   {
-    KanbanAnchor* anchor = elem->data;
-    gtk_text_iter_set_offset (&iter, anchor->offset + i);
-    create_task (Card->description, &iter, anchor->title, anchor->active);
-    g_free(anchor->title);
-    i++;
+    GtkTextBuffer* buf = gtk_text_view_get_buffer (Card->description);
+
+    kanban_card_item_set_source (Card->item, NULL, NULL);
+    cancel_pending_tasks (Card);
+
+    g_signal_handler_block (buf, Card->description_changed);
+    gtk_text_buffer_set_text (buf, "", 0);
+    g_signal_handler_unblock (buf, Card->description_changed);
+    Card->materialized = FALSE;
   }
-  g_signal_handler_unblock(buf, Card->description_changed);
 
-  g_list_free (KUnContent->anchors);
-  free(KUnContent);
+  g_clear_object (&Card->drag_icon);
+  g_clear_object (&Card->item);
 }
 
 static void
@@ -190,25 +394,26 @@ insert_checkbox(GtkButton* btn, gpointer data)
   GtkTextView* text_view  = GTK_TEXT_VIEW (data);
   GtkTextBuffer* buffer   = gtk_text_view_get_buffer(text_view);
   GtkTextIter iter        = {};
+  KanbanCard* card        = KANBAN_CARD (gtk_widget_get_ancestor (GTK_WIDGET (text_view),
+                                                                  KANBAN_TYPE_CARD));
 
   gtk_text_buffer_insert_at_cursor (buffer, "\n", 1);
   gtk_text_buffer_get_iter_at_mark (buffer, &iter, gtk_text_buffer_get_mark (buffer, "insert"));
 
-  create_task(text_view, &iter, "Task #", false);
+  create_task(card, &iter, "Task #", false);
 }
 
 
 static void
 delete_clicked(GtkButton* btn, gpointer user_data)
 {
-  GtkWidget *old_box        = gtk_widget_get_parent (GTK_WIDGET(user_data));
-  GtkWidget *old_view       = gtk_widget_get_parent(old_box);
-  GtkWidget *old_scrollWnd  = gtk_widget_get_parent(old_view);
-  KanbanColumn *old_col     = KANBAN_COLUMN (gtk_widget_get_parent (old_scrollWnd));
+  KanbanCard* card      = KANBAN_CARD (user_data);
+  GtkWidget*  old_col   = gtk_widget_get_ancestor (GTK_WIDGET (card), KANBAN_COLUMN_TYPE);
 
-  g_object_set(user_data, "needs-saving", 1, NULL);
-  SaveNeeded = true;
-  kanban_column_remove_card(old_col, user_data);
+  if (old_col == NULL || card->item == NULL)
+    return;
+
+  kanban_column_remove_card(KANBAN_COLUMN (old_col), card->item);
 }
 
 static void
@@ -217,26 +422,13 @@ reveal_clicked(GtkButton* btn, gpointer user_data)
   KanbanCard* card = (KanbanCard*)user_data;
   kanban_card_set_reveal (card, !kanban_card_get_reveal (card));
 }
-static void 
-kanban_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec) 
-{
-  KanbanCard *self = KANBAN_CARD (object);
-
-  if (property_id == 1)
-    g_value_set_boolean (value, self->needs_saving);
-  else
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
-}
-
-static void 
-kanban_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec) 
+static void
+kanban_card_dispose (GObject *object)
 {
-  KanbanCard *self = KANBAN_CARD(object);
+  kanban_card_unbind (KANBAN_CARD (object));
+  g_clear_object (&KANBAN_CARD (object)->drag_icon);
 
-  if (property_id == 1)
-    self->needs_saving = g_value_get_boolean(value);
-  else
-    G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+  G_OBJECT_CLASS (kanban_card_parent_class)->dispose (object);
 }
 
 static void
@@ -255,7 +447,7 @@ kanban_card_class_init (KanbanCardClass *klass)
   gtk_widget_class_bind_template_child (widget_class,
                                         KanbanCard, revealercard);
   gtk_widget_class_bind_template_child (widget_class,
-                                        KanbanCard, drop_revealer);
+                                        KanbanCard, CardHeader);
   gtk_widget_class_bind_template_child (widget_class,
                                         KanbanCard, description);
   gtk_widget_class_bind_template_child (widget_class,
@@ -271,93 +463,64 @@ kanban_card_class_init (KanbanCardClass *klass)
                                            insert_checkbox);
 
   GObjectClass *GClass = G_OBJECT_CLASS(klass);
-  GClass->get_property = kanban_get_property;
-  GClass->set_property = kanban_set_property;
-  needs_saving = g_param_spec_boolean("needs-saving", "needsave",
-                                      "Boolean value", 0,
-                                      G_PARAM_READWRITE);
-  g_object_class_install_property (GClass, 1, needs_saving);
+  GClass->dispose      = kanban_card_dispose;
 }
 
 static void
 kanban_card_changed(GtkTextBuffer* buf, gpointer user_data)
 {
-    g_object_set (G_OBJECT(user_data), "needs-saving", 1, NULL);
-    if (IsInitialized) {
-      SaveNeeded = true;
-    }
+    KanbanCard* card = KANBAN_CARD (user_data);
+
+    if (card->item)
+      kanban_card_item_description_changed (card->item);
 }
 
 static void
 kanban_card_title_changed(GtkEditableLabel* label, gpointer user_data)
 {
-  g_object_set(user_data, "needs-saving", 1, NULL);
-  if (IsInitialized) {
-    SaveNeeded = true;
-  }
+  KanbanCard* card = KANBAN_CARD (user_data);
+
+  if (card->item)
+    kanban_card_item_set_title (card->item, kanban_card_get_title (card));
+  g_clear_object (&card->drag_icon);
 }
 
+/* The item travels with the drag, the card moves once it is dropped */
 static GdkContentProvider *
-css_drag_prepare (GtkDragSource *source,
-                  double         x,
-                  double         y,
-                  GtkWidget     *button)
+drag_prepare (GtkDragSource *source,
+              double         x,
+              double         y,
+              gpointer       user_data)
 {
-  GdkPaintable *paintable;
-
-  paintable = gtk_widget_paintable_new (button);
-  gtk_drag_source_set_icon (source, paintable, 0, 0);
-  g_object_unref (paintable);
-
+  KanbanCard *card = KANBAN_CARD (user_data);
 
-  return gdk_content_provider_new_typed (G_TYPE_POINTER, button);
-}
+  KANBAN_TRACE_SCOPE ("drag_prepare");
 
-static void
-  drop_motion_enter (
-    GtkDropControllerMotion* self,
-    gdouble x,
-    gdouble y,
-    gpointer user_data
-  )
-{
-  KanbanCard *card = KANBAN_CARD (user_data);
-  gtk_revealer_set_reveal_child(card->drop_revealer, true);
-}
+  if (card->item == NULL)
+    return NULL;
 
-static void
-  drop_motion_leave (
-    GtkDropControllerMotion* self,
-    gdouble x,
-    gdouble y,
-    gpointer user_data
-  )
-{
-  KanbanCard *card = KANBAN_CARD (user_data);
-  gtk_revealer_set_reveal_child(card->drop_revealer, false);
+  return gdk_content_provider_new_typed (KANBAN_TYPE_CARD_ITEM, card->item);
 }
 
+/* Only the header is rendered, once, however long the description is */
 static void
 on_drag_begin (GtkDragSource *source,
                GdkDrag       *drag,
-               GtkWidget      *self) {
-  g_object_ref(self);
-  GdkPaintable *paintable, *paintable2;
-
-  paintable = gtk_widget_paintable_new (self);
-  paintable2 = gdk_paintable_get_current_image(paintable);
+               gpointer       user_data)
+{
+  KanbanCard *card = KANBAN_CARD (user_data);
 
-  gtk_drag_source_set_icon (source, paintable2, 0, 0);
-  g_object_unref (paintable);
-  g_object_unref (paintable2);
+  KANBAN_TRACE_SCOPE ("on_drag_begin");
 
-  GtkWidget* old_box        = gtk_widget_get_parent (self);
-  GtkWidget* old_view       = gtk_widget_get_parent(old_box);
-  GtkWidget* old_scrollWnd  = gtk_widget_get_parent(old_view);
-  KanbanColumn* old_col     = KANBAN_COLUMN (gtk_widget_get_parent (old_scrollWnd));
+  if (card->drag_icon == NULL)
+    {
+      GdkPaintable *paintable = gtk_widget_paintable_new (card->CardHeader);
 
-  kanban_column_remove_card (old_col, self);
+      card->drag_icon = gdk_paintable_get_current_image (paintable);
+      g_object_unref (paintable);
+    }
 
+  gtk_drag_source_set_icon (source, card->drag_icon, 0, 0);
 }
 
 
@@ -365,7 +528,6 @@ static void
 kanban_card_init (KanbanCard *self)
 {
   GtkDragSource *source;
-  GtkDropControllerMotion *motion = NULL;
   GtkTextBuffer* buf;
 
   gtk_widget_init_template (GTK_WIDGET (self));
@@ -373,21 +535,15 @@ kanban_card_init (KanbanCard *self)
   gtk_widget_add_controller (GTK_WIDGET (self->handlerDrag),
                              GTK_EVENT_CONTROLLER (source));
 
-  gtk_drag_source_set_content(source, gdk_content_provider_new_typed (G_TYPE_POINTER, self));
-
+  g_signal_connect (source, "prepare", G_CALLBACK (drag_prepare), self);
   g_signal_connect (source, "drag-begin", G_CALLBACK (on_drag_begin), self);
 
-  motion = GTK_DROP_CONTROLLER_MOTION(gtk_drop_controller_motion_new());
-  gtk_widget_add_controller (GTK_WIDGET (self->handlerDrag),(GtkEventController*)motion);
-
-  g_signal_connect(motion, "enter", G_CALLBACK (drop_motion_enter), self);
-  g_signal_connect(motion, "leave", G_CALLBACK (drop_motion_leave), self);
-
   buf = gtk_text_view_get_buffer(self->description);
   
   self->description_changed = g_signal_connect (buf, "changed", 
                                                 G_CALLBACK(kanban_card_changed), self);
 
-  g_signal_connect(self->LblCardName, "changed", G_CALLBACK(kanban_card_title_changed), self);
+  self->title_changed = g_signal_connect(self->LblCardName, "changed",
+                                         G_CALLBACK(kanban_card_title_changed), self);
   // Both the description and the title are separate, so we had to implement them independently
 }
@@ -22,16 +22,36 @@
 
 #include <adwaita.h>
 
+#include "utils/kanban-card-item.h"
+
 G_BEGIN_DECLS
 
 #define KANBAN_TYPE_CARD (kanban_card_get_type())
 
-G_DECLARE_FINAL_TYPE (KanbanCard, kanban_card, KANBAN, CARD, GtkListBoxRow)
+G_DECLARE_FINAL_TYPE (KanbanCard, kanban_card, KANBAN, CARD, AdwBin)
 
 KanbanCard *kanban_card_new(void);
 
+KanbanCard*
+kanban_card_pool_acquire(void);
+
+void
+kanban_card_pool_release(KanbanCard* Card);
+
+void
+kanban_card_pool_set_size(guint size);
+
+void
+kanban_card_pool_get_stats(guint* hits, guint* misses);
+
+void
+kanban_card_bind(KanbanCard* Card, KanbanCardItem* item);
+
 void
-kanban_card_set_title(KanbanCard* Card, const char *title);
+kanban_card_unbind(KanbanCard* Card);
+
+KanbanCardItem*
+kanban_card_get_item(KanbanCard* Card);
 
 const gchar*
 kanban_card_get_title(KanbanCard* Card);
@@ -42,12 +62,7 @@ kanban_card_set_reveal(KanbanCard* card, gboolean revealed);
 gboolean
 kanban_card_get_reveal(KanbanCard* Card);
 
-GBytes*
+KanbanUnserializedContent*
 kanban_card_get_description(KanbanCard* Card);
 
-void kanban_card_content_dropped(KanbanCard* self);
-
-void
-kanban_card_set_description(KanbanCard* Card,const gchar* description);
-
 G_END_DECLS
@@ -21,11 +21,9 @@
 #include "kanban-column.h"
 #include "config.h"
 #include "gtk/gtk.h"
-#include "kanban-application.h"
 #include "kanban-card.h"
-#include <json-glib/json-glib.h>
+#include "utils/kanban-trace.h"
 
-static GParamSpec *needs_saving = NULL;
 static GParamSpec *edit_mode = NULL;
 static guint SIGNAL_DELETE_COLUMN = 0;
 static guint SIGNAL_CONTENT_DROPPED = 1;
@@ -36,10 +34,25 @@ struct _KanbanColumn {
   GtkEditableLabel *title;
   GtkRevealer *Revealer;
   GtkButton *RemoveBtn;
-  GtkListBox *CardsBox;
-  GList *Cards;
+  GtkOverlay *CardsOverlay;
+  GtkScrolledWindow *CardsScroll;
+  GtkListView *CardsView;
+  GtkWidget *DropIndicator;
+  KanbanColumnItem *item;
+  guint title_changed;
+
+  /* While a card is dragged over the column, the row the indicator is
+   * above, NULL for the end, and its span, valid until the pointer
+   * leaves it or the cards scroll */
+  gboolean dragging;
+  GtkWidget *drop_row;
+  gboolean drop_span_valid;
+  gdouble drop_top;
+  gdouble drop_bottom;
+
+  /* Scroll position to restore once the rows are measured, or -1 */
+  gdouble pending_scroll;
 
-  gboolean needs_saving;
   gboolean edit_mode;
 };
 
@@ -52,14 +65,75 @@ KanbanColumn *kanban_column_new(void) {
 static void remove_column(GtkButton *btn, gpointer user_data) {
   g_signal_emit(user_data, SIGNAL_DELETE_COLUMN, 0);
 }
-static void kanban_column_set_needs_saving(KanbanColumn *Column, bool needs) {
-  GValue val = G_VALUE_INIT;
-  g_value_init(&val, G_TYPE_BOOLEAN);
-  g_value_set_boolean(&val, needs);
-  g_object_set_property(G_OBJECT(Column),"needs_saving", &val);
+
+static void hide_drop_indicator(KanbanColumn *self) {
+  gtk_widget_set_visible(self->DropIndicator, FALSE);
+  g_clear_weak_pointer(&self->drop_row);
+  self->drop_span_valid = FALSE;
+  self->dragging = FALSE;
 }
-void kanban_column_set_title(KanbanColumn *Column, const char *title) {
-  gtk_editable_set_text(GTK_EDITABLE(Column->title), title);
+
+/* Where each column item was scrolled to when its widget last let go */
+static GQuark scroll_quark(void) {
+  return g_quark_from_static_string("kanban-column-scroll");
+}
+
+static void restore_scroll(KanbanColumn *Column) {
+  GtkAdjustment *adj = gtk_scrolled_window_get_vadjustment(Column->CardsScroll);
+
+  if (Column->pending_scroll < 0)
+    return;
+
+  /* Wait until enough rows are measured */
+  if (gtk_adjustment_get_upper(adj) - gtk_adjustment_get_page_size(adj) <
+      Column->pending_scroll)
+    return;
+
+  gtk_adjustment_set_value(adj, Column->pending_scroll);
+  Column->pending_scroll = -1;
+}
+
+static void scroll_changed(GtkAdjustment *adj, gpointer user_data) {
+  restore_scroll(KANBAN_COLUMN(user_data));
+}
+
+/*
+ * The cards are rendered through a list view, only the rows on screen
+ * have a KanbanCard, bound to their item. Columns are recycled as well,
+ * the scroll position is kept with the item in between
+ * */
+void kanban_column_set_item(KanbanColumn *Column, KanbanColumnItem *item) {
+  GtkAdjustment *adj = gtk_scrolled_window_get_vadjustment(Column->CardsScroll);
+  GtkNoSelection *selection;
+  gdouble *scroll;
+
+  if (Column->item) {
+    scroll = g_new(gdouble, 1);
+    *scroll = Column->pending_scroll >= 0 ? Column->pending_scroll
+                                          : gtk_adjustment_get_value(adj);
+    g_object_set_qdata_full(G_OBJECT(Column->item), scroll_quark(), scroll, g_free);
+  }
+
+  g_set_object(&Column->item, item);
+  hide_drop_indicator(Column);
+
+  g_signal_handler_block(Column->title, Column->title_changed);
+  gtk_editable_set_text(GTK_EDITABLE(Column->title),
+                        item ? kanban_column_item_get_title(item) : "");
+  g_signal_handler_unblock(Column->title, Column->title_changed);
+
+  selection = gtk_no_selection_new(item ? g_object_ref(G_LIST_MODEL(item)) : NULL);
+  gtk_list_view_set_model(Column->CardsView, GTK_SELECTION_MODEL(selection));
+  g_object_unref(selection);
+
+  scroll = item ? g_object_get_qdata(G_OBJECT(item), scroll_quark()) : NULL;
+  Column->pending_scroll = scroll ? *scroll : -1;
+  gtk_adjustment_set_value(adj, 0);
+  restore_scroll(Column);
+}
+
+KanbanColumnItem *kanban_column_get_item(KanbanColumn *Column) {
+  return Column->item;
 }
 
 void kanban_column_content_dropped(KanbanColumn *self) {
@@ -68,104 +142,163 @@ void kanban_column_content_dropped(KanbanColumn *self) {
 
 // This is related to issue #31
 static void kanban_column_content_dropped_callback(KanbanColumn *self) {
-  KanbanCard *item;
-  for (GList *elem = self->Cards; elem; elem = elem->next) {
-    item = elem->data;
-    kanban_card_content_dropped(item);
-  }
+  hide_drop_indicator(self);
+}
 
+/* Rows are list items wrapping the cards, returns the row at y in
+ * widget coordinates */
+static GtkWidget *row_at(KanbanColumn *Column, GtkWidget *widget, double y) {
+  GtkWidget *picked = gtk_widget_pick(widget, gtk_widget_get_width(widget) / 2.0,
+                                      y, GTK_PICK_DEFAULT);
+
+  while (picked && gtk_widget_get_parent(picked) != GTK_WIDGET(Column->CardsView))
+    picked = gtk_widget_get_parent(picked);
+
+  return picked;
 }
 
-GtkListBox *kanban_column_get_cards_box(KanbanColumn *Column) {
-  return Column->CardsBox;
+static void show_drop_indicator(KanbanColumn *Column, double top) {
+  gint height = gtk_widget_get_height(Column->DropIndicator);
+
+  gtk_widget_set_margin_top(Column->DropIndicator, MAX(0, top - height / 2.0));
+  gtk_widget_set_visible(Column->DropIndicator, TRUE);
 }
 
-void kanban_column_get_json(KanbanColumn *Column, gpointer CardObject) {
-  JsonObject *object, *nested;
-  object = json_object_new();
+/*
+ * Moves the drop indicator above the row under the pointer, or below the
+ * last row. Motion within the same row costs nothing, other motion picks
+ * a single row, so hovering does not depend on how many cards there are
+ * */
+static void drop_motion(GtkDropControllerMotion *motion, double x, double y,
+                        gpointer user_data) {
+  KanbanColumn *Column = KANBAN_COLUMN(user_data);
+  GtkWidget *overlay = GTK_WIDGET(Column->CardsOverlay);
+  GtkWidget *row;
+  graphene_rect_t bounds;
 
-  {
-    KanbanCard *item;
-    for (GList *elem = Column->Cards; elem; elem = elem->next) {
-      nested = json_object_new();
+  KANBAN_TRACE_SCOPE("drop_motion");
 
-      item = elem->data;
-      GBytes *byteDescription = kanban_card_get_description(item);
-      gsize size = 0;
-      const gchar *description = g_bytes_get_data(byteDescription, &size);
+  Column->dragging = TRUE;
 
-      json_object_set_string_member(nested, "description", description);
-      json_object_set_int_member(nested, "revealed",
-                                 kanban_card_get_reveal(item));
-      json_object_set_object_member(object, kanban_card_get_title(item),
-                                    nested);
+  if (Column->drop_span_valid && y >= Column->drop_top && y < Column->drop_bottom)
+    return;
 
-      g_bytes_unref(byteDescription);
-    }
+  row = row_at(Column, overlay, y);
+  if (row && gtk_widget_compute_bounds(row, overlay, &bounds)) {
+    g_set_weak_pointer(&Column->drop_row, row);
+    Column->drop_top = bounds.origin.y;
+    Column->drop_bottom = bounds.origin.y + bounds.size.height;
+    Column->drop_span_valid = TRUE;
+    show_drop_indicator(Column, bounds.origin.y);
+    return;
   }
 
-  const gchar *title = gtk_editable_get_text(GTK_EDITABLE(Column->title));
-  json_object_set_object_member((JsonObject *)CardObject, title, object);
+  /* Past the rows, the card goes at the end */
+  g_clear_weak_pointer(&Column->drop_row);
+  Column->drop_span_valid = FALSE;
+
+  row = gtk_widget_get_last_child(GTK_WIDGET(Column->CardsView));
+  if (row && gtk_widget_compute_bounds(row, overlay, &bounds))
+    show_drop_indicator(Column, bounds.origin.y + bounds.size.height);
+  else
+    show_drop_indicator(Column, 0);
+}
+
+static void drop_leave(GtkDropControllerMotion *motion, gpointer user_data) {
+  hide_drop_indicator(KANBAN_COLUMN(user_data));
 }
 
-static void add_card(KanbanColumn *Column, KanbanCard *card){
-  gtk_list_box_append(Column->CardsBox, GTK_WIDGET(card));
-  Column->Cards = g_list_append(Column->Cards, card);
+/* The rows move under the pointer, the next motion looks again */
+static void scroll_moved(GtkAdjustment *adj, gpointer user_data) {
+  KANBAN_COLUMN(user_data)->drop_span_valid = FALSE;
 }
 
 void kanban_column_add_card(KanbanColumn *Column, gpointer card) {
-  add_card(Column, KANBAN_CARD(card));
-  kanban_column_set_needs_saving(Column, true);
+  kanban_column_item_append(Column->item, KANBAN_CARD_ITEM(card));
 }
 
+/*
+ * Moves card out of its column and above the row the drop indicator is
+ * at, or else the row at y, or at the end
+ * */
 void kanban_column_insert_card(KanbanColumn *Column, double y, gpointer card){
-  GtkListBoxRow* row = gtk_list_box_get_row_at_y(Column->CardsBox,y);
-
-  if (row == NULL) {
-    add_card(Column, KANBAN_CARD(card));
+  GtkWidget *row = Column->dragging ? Column->drop_row
+                                    : row_at(Column, GTK_WIDGET(Column), y);
+  GtkWidget *child = row ? gtk_widget_get_first_child(row) : NULL;
+  KanbanCardItem *target = child && KANBAN_IS_CARD(child) ?
+                           kanban_card_get_item(KANBAN_CARD(child)) : NULL;
+  KanbanColumnItem *source = kanban_card_item_get_column(KANBAN_CARD_ITEM(card));
+  gint index;
+
+  /* Dropped on itself */
+  if (target == card)
     return;
+
+  /* The caller holds a reference while the card is between columns */
+  if (source) {
+    index = kanban_column_item_get_position(source, KANBAN_CARD_ITEM(card));
+    if (index >= 0)
+      kanban_column_item_remove(source, index);
   }
 
-  int index = gtk_list_box_row_get_index(row);
-  gtk_list_box_insert(Column->CardsBox, card, index );
-  Column->Cards = g_list_insert(Column->Cards, card, index);
+  index = target ? kanban_column_item_get_position(Column->item, target) : -1;
+  if (index < 0)
+    index = g_list_model_get_n_items(G_LIST_MODEL(Column->item));
 
-  kanban_column_set_needs_saving(Column, true);
+  kanban_column_item_insert(Column->item, index, KANBAN_CARD_ITEM(card));
 }
 
 void kanban_column_remove_card(KanbanColumn *Column, gpointer card) {
-  gtk_list_box_remove(Column->CardsBox, GTK_WIDGET(card));
-  Column->Cards = g_list_remove(Column->Cards, card);
-  kanban_column_set_needs_saving(Column, true);
-}
-
-void kanban_column_add_new_card(KanbanColumn *Column, const gchar *title,
-                                const gchar *description, gboolean revealed) {
-  KanbanCard *card = kanban_card_new();
-
-  kanban_card_set_title(card, title);
-  kanban_card_set_description(card, description);
-  kanban_card_set_reveal(card, revealed);
-
-  add_card(Column, card);
+  gint index = kanban_column_item_get_position(Column->item, KANBAN_CARD_ITEM(card));
 
-  g_object_bind_property(Column, "needs-saving", card, "needs-saving",
-                         G_BINDING_BIDIRECTIONAL);
+  if (index >= 0)
+    kanban_column_item_remove(Column->item, index);
 }
 
 static void add_card_clicked(GtkButton *btn, gpointer user_data) {
-  KanbanCard *card = kanban_card_new();
   KanbanColumn *Column = (KanbanColumn *)user_data;
+  KanbanCardItem *card;
 
   gchar *title;
-  title = g_strdup_printf("Activity #%d", g_list_length(Column->Cards));
-  kanban_card_set_title(card, title);
+  title = g_strdup_printf("Activity #%u",
+                          g_list_model_get_n_items(G_LIST_MODEL(Column->item)));
+  card = kanban_card_item_new(title, TRUE, NULL);
   g_free(title);
 
-  g_object_bind_property(Column, "needs-saving", card, "needs-saving",
-                         G_BINDING_BIDIRECTIONAL);
-  add_card(Column, card);
-  kanban_card_set_reveal(card, true);
+  kanban_column_add_card(Column, card);
+  g_object_unref(card);
+}
+
+/* Cards come from the pool shared by every column, and go back to it
+ * when the list lets go of their row */
+static void setup_card(GtkSignalListItemFactory *factory, GtkListItem *list_item,
+                       gpointer user_data) {
+  KanbanCard *card = kanban_card_pool_acquire();
+
+  gtk_list_item_set_activatable(list_item, FALSE);
+  gtk_list_item_set_selectable(list_item, FALSE);
+  gtk_list_item_set_child(list_item, GTK_WIDGET(card));
+  g_object_unref(card);
+}
+
+static void teardown_card(GtkSignalListItemFactory *factory, GtkListItem *list_item,
+                          gpointer user_data) {
+  KanbanCard *card = KANBAN_CARD(g_object_ref(gtk_list_item_get_child(list_item)));
+
+  gtk_list_item_set_child(list_item, NULL);
+  kanban_card_pool_release(card);
+  g_object_unref(card);
+}
+
+static void bind_card(GtkSignalListItemFactory *factory, GtkListItem *list_item,
+                      gpointer user_data) {
+  kanban_card_bind(KANBAN_CARD(gtk_list_item_get_child(list_item)),
+                   gtk_list_item_get_item(list_item));
+}
+
+static void unbind_card(GtkSignalListItemFactory *factory, GtkListItem *list_item,
+                        gpointer user_data) {
+  kanban_card_unbind(KANBAN_CARD(gtk_list_item_get_child(list_item)));
 }
 
 static void kanban_get_property(GObject *object, guint property_id,
@@ -173,8 +306,6 @@ static void kanban_get_property(GObject *object, guint property_id,
   KanbanColumn *self = KANBAN_COLUMN(object);
 
   if (property_id == 1)
-    g_value_set_boolean(value, self->needs_saving);
-  else if (property_id == 2)
     g_value_set_boolean(value, self->edit_mode);
   else
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -185,20 +316,30 @@ static void kanban_set_property(GObject *object, guint property_id,
   KanbanColumn *self = KANBAN_COLUMN(object);
 
   if (property_id == 1)
-    self->needs_saving = g_value_get_boolean(value);
-  else if (property_id == 2)
     self->edit_mode = g_value_get_boolean(value);
   else
     G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
 }
 
+static void kanban_column_dispose(GObject *object) {
+  KanbanColumn *self = KANBAN_COLUMN(object);
+
+  g_clear_weak_pointer(&self->drop_row);
+  g_clear_object(&self->item);
+
+  G_OBJECT_CLASS(kanban_column_parent_class)->dispose(object);
+}
+
 static void kanban_column_class_init(KanbanColumnClass *klass) {
   GtkWidgetClass *widget_class = GTK_WIDGET_CLASS(klass);
 
   gtk_widget_class_set_template_from_resource(
       widget_class, "/com/github/zhrexl/kanban/kanban-column.ui");
   gtk_widget_class_bind_template_child(widget_class, KanbanColumn, title);
-  gtk_widget_class_bind_template_child(widget_class, KanbanColumn, CardsBox);
+  gtk_widget_class_bind_template_child(widget_class, KanbanColumn, CardsOverlay);
+  gtk_widget_class_bind_template_child(widget_class, KanbanColumn, CardsScroll);
+  gtk_widget_class_bind_template_child(widget_class, KanbanColumn, CardsView);
+  gtk_widget_class_bind_template_child(widget_class, KanbanColumn, DropIndicator);
   gtk_widget_class_bind_template_child(widget_class, KanbanColumn, Revealer);
   gtk_widget_class_bind_template_child(widget_class, KanbanColumn, RemoveBtn);
 
@@ -210,14 +351,12 @@ static void kanban_column_class_init(KanbanColumnClass *klass) {
   GObjectClass *GClass = G_OBJECT_CLASS(klass);
   GClass->get_property = kanban_get_property;
   GClass->set_property = kanban_set_property;
+  GClass->dispose = kanban_column_dispose;
 
-  needs_saving = g_param_spec_boolean("needs-saving", "needsave",
-                                      "Boolean value", 0, G_PARAM_READWRITE);
   edit_mode = g_param_spec_boolean("edit-mode", "editmode", "Boolean value", 0,
                                    G_PARAM_READWRITE);
 
-  g_object_class_install_property(GClass, 1, needs_saving);
-  g_object_class_install_property(GClass, 2, edit_mode);
+  g_object_class_install_property(GClass, 1, edit_mode);
 
   SIGNAL_DELETE_COLUMN =
       g_signal_new("delete-column", G_TYPE_FROM_CLASS(klass),
@@ -230,20 +369,44 @@ static void kanban_column_class_init(KanbanColumnClass *klass) {
                  0, NULL, NULL, NULL, G_TYPE_NONE, 0);
 }
 static void title_changed(GtkEditableLabel *label, gpointer user_data) {
-  g_object_set(user_data, "needs-saving", 1, NULL);
-  if (IsInitialized) {
-    SaveNeeded = true;
-  }
+  KanbanColumn *self = KANBAN_COLUMN(user_data);
+
+  if (self->item)
+    kanban_column_item_set_title(self->item,
+                                 gtk_editable_get_text(GTK_EDITABLE(label)));
 }
 
 static void kanban_column_init(KanbanColumn *self) {
+  GtkListItemFactory *factory;
+  GtkEventController *motion;
+
   gtk_widget_init_template(GTK_WIDGET(self));
 
-  /* Initialize private variable */
-  self->Cards = NULL;
+  factory = gtk_signal_list_item_factory_new();
+  g_signal_connect(factory, "setup", G_CALLBACK(setup_card), self);
+  g_signal_connect(factory, "bind", G_CALLBACK(bind_card), self);
+  g_signal_connect(factory, "unbind", G_CALLBACK(unbind_card), self);
+  g_signal_connect(factory, "teardown", G_CALLBACK(teardown_card), self);
+  gtk_list_view_set_factory(self->CardsView, factory);
+  g_object_unref(factory);
+
+  self->pending_scroll = -1;
+  g_signal_connect(gtk_scrolled_window_get_vadjustment(self->CardsScroll), "changed",
+                   G_CALLBACK(scroll_changed), self);
+  g_signal_connect(gtk_scrolled_window_get_vadjustment(self->CardsScroll), "value-changed",
+                   G_CALLBACK(scroll_moved), self);
+
+  /* One indicator for the whole column, instead of one per card */
+  motion = gtk_drop_controller_motion_new();
+  g_signal_connect(motion, "enter", G_CALLBACK(drop_motion), self);
+  g_signal_connect(motion, "motion", G_CALLBACK(drop_motion), self);
+  g_signal_connect(motion, "leave", G_CALLBACK(drop_leave), self);
+  gtk_widget_add_controller(GTK_WIDGET(self->CardsOverlay), motion);
+
   g_object_bind_property(self, "edit-mode", self->Revealer, "reveal-child",
                          G_BINDING_BIDIRECTIONAL);
-  g_signal_connect(self->title, "changed", G_CALLBACK(title_changed), self);
+  self->title_changed = g_signal_connect(self->title, "changed",
+                                         G_CALLBACK(title_changed), self);
 
   g_signal_connect(self, "content-dropped",  G_CALLBACK(kanban_column_content_dropped_callback), self);
 }
@@ -22,6 +22,8 @@
 
 #include <adwaita.h>
 
+#include "utils/kanban-column-item.h"
+
 G_BEGIN_DECLS
 
 #define KANBAN_COLUMN_TYPE (kanban_column_get_type())
@@ -32,10 +34,10 @@ KanbanColumn
 *kanban_column_new(void);
 
 void
-kanban_column_set_title(KanbanColumn* Card, const char *title);
+kanban_column_set_item(KanbanColumn* Column, KanbanColumnItem* item);
 
-GtkListBox*
-kanban_column_get_cards_box(KanbanColumn* Column);
+KanbanColumnItem*
+kanban_column_get_item(KanbanColumn* Column);
 
 void
 kanban_column_add_card(KanbanColumn* Column, gpointer card);
@@ -43,11 +45,6 @@ kanban_column_add_card(KanbanColumn* Column, gpointer card);
 void
 kanban_column_remove_card(KanbanColumn* Column, gpointer card);
 
-void kanban_column_get_json(KanbanColumn* Column, gpointer CardObject);
-
-void
-kanban_column_add_new_card(KanbanColumn* Column, const gchar* title, const gchar* description, gboolean revealed);
-
 void kanban_column_insert_card(KanbanColumn *Column, double y, gpointer card);
 
 void kanban_column_content_dropped(KanbanColumn *self);
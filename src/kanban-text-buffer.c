@@ -0,0 +1,320 @@
+/* kanban-text-buffer.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "kanban-text-buffer.h"
+
+#define lenstr(X) (sizeof(X)/sizeof(X[0])-1)
+
+/* GtkTextBuffer keeps U+FFFC in slices wherever a child anchor sits */
+static gchar anchorchar[]    = "\xef\xbf\xbc";
+static gchar nullbyte[]      = "\0";
+
+/* Rough size of one serialized task, used to presize the output buffer */
+#define TASK_SIZE_HINT 48
+
+/* Reads a task back from the box create_task() put at its anchor */
+static const gchar*
+read_task(GtkWidget* box, gboolean* done)
+{
+  const gchar* tasklbl = NULL;
+
+  *done = FALSE;
+
+  for (GtkWidget* child = gtk_widget_get_first_child (box);
+                                                  child != NULL;
+                    child = gtk_widget_get_next_sibling (child))
+  {
+    if (GTK_IS_CHECK_BUTTON (child))
+      *done = gtk_check_button_get_active (GTK_CHECK_BUTTON (child));
+    else if (GTK_IS_EDITABLE_LABEL (child))
+      tasklbl = gtk_editable_get_text (GTK_EDITABLE(child));
+  }
+
+  return tasklbl ? tasklbl : "";
+}
+
+/*
+ * Tasks put in the buffer by set_buffer_content() keep their title and
+ * status on their anchor until a widget is made for them
+ * */
+static GQuark
+pending_task_quark(void)
+{
+  static GQuark quark = 0;
+
+  if (G_UNLIKELY(quark == 0))
+    quark = g_quark_from_static_string("kanban-pending-task");
+
+  return quark;
+}
+
+static void
+pending_task_free(gpointer data)
+{
+  KanbanAnchor* task = data;
+
+  g_free(task->title);
+  g_free(task);
+}
+
+static void
+append_task(GByteArray* ret, GtkTextChildAnchor* anch)
+{
+  guint widgets_len = 0;
+  GtkWidget** widgets = gtk_text_child_anchor_get_widgets(anch, &widgets_len);
+  KanbanAnchor* pending = g_object_get_qdata(G_OBJECT(anch), pending_task_quark());
+
+  for (guint i = 0; i < widgets_len; i++)
+  {
+    gboolean isChecked;
+    const gchar* tasklbl = read_task(widgets[i], &isChecked);
+
+    kanban_task_markup_append(ret, tasklbl, isChecked);
+  }
+
+  if (widgets_len == 0 && pending)
+    kanban_task_markup_append(ret, pending->title, pending->done);
+
+  g_free(widgets);
+}
+
+/*
+ * get_serialized_buffer returns a GByteArray with the serialized
+ * content of GtkTextBuffer according to predefined template
+ *
+ * The whole buffer is copied once as a slice; the text between two
+ * anchors is appended in bulk and the iterator only jumps from one
+ * anchor to the next.
+ *
+ * the user must unref the returned pointer with g_bytes_unref() */
+
+GBytes*
+get_serialized_buffer(GtkTextBuffer *buffer)
+{
+  GtkTextIter start, end, iter;
+
+  gtk_text_buffer_get_bounds(buffer, &start, &end);
+
+  gchar* slice    = gtk_text_buffer_get_slice(buffer, &start, &end, TRUE);
+  gsize slice_len = strlen(slice);
+
+  guint n_anchors = 0;
+  for (const gchar* p = strstr(slice, anchorchar); p != NULL;
+       p = strstr(p + lenstr(anchorchar), anchorchar))
+    n_anchors++;
+
+  GByteArray* ret = g_byte_array_sized_new(slice_len + 1 +
+                                           n_anchors * TASK_SIZE_HINT);
+
+  const gchar* chunk = slice;
+  iter = start;
+
+  while (TRUE)
+  {
+    const gchar* next = strstr(chunk, anchorchar);
+    gsize chunk_len   = next ? (gsize)(next - chunk)
+                             : slice_len - (gsize)(chunk - slice);
+
+    g_byte_array_append(ret, (guint8*)chunk, chunk_len);
+
+    if (next == NULL)
+      break;
+
+    gtk_text_iter_forward_chars(&iter, g_utf8_strlen(chunk, chunk_len));
+
+    GtkTextChildAnchor* anch = gtk_text_iter_get_child_anchor(&iter);
+
+    if (anch)
+      append_task(ret, anch);
+    else if (!gtk_text_iter_get_paintable(&iter))
+      /* A literal U+FFFC typed by the user is plain text */
+      g_byte_array_append(ret, (guint8*)anchorchar, lenstr(anchorchar));
+
+    gtk_text_iter_forward_char(&iter);
+    chunk = next + lenstr(anchorchar);
+  }
+
+  g_free(slice);
+
+  g_byte_array_append (ret, (guint8*)nullbyte, 1);
+
+  return g_byte_array_free_to_bytes(ret);
+}
+
+/*
+ * get_buffer_content returns the text of GtkTextBuffer without its
+ * anchors, plus one KanbanAnchor per task, walking the buffer the same
+ * way get_serialized_buffer does
+ *
+ * release it with kanban_unserialized_content_free() */
+
+KanbanUnserializedContent*
+get_buffer_content(GtkTextBuffer *buffer)
+{
+  GtkTextIter start, end, iter;
+
+  gtk_text_buffer_get_bounds(buffer, &start, &end);
+
+  gchar* slice    = gtk_text_buffer_get_slice(buffer, &start, &end, TRUE);
+  gsize slice_len = strlen(slice);
+
+  KanbanUnserializedContent* content = kanban_unserialized_content_new();
+  g_string_set_size(content->text, slice_len);
+  g_string_truncate(content->text, 0);
+
+  const gchar* chunk = slice;
+  guint offset = 0;
+  iter = start;
+
+  while (TRUE)
+  {
+    const gchar* next = strstr(chunk, anchorchar);
+    gsize chunk_len   = next ? (gsize)(next - chunk)
+                             : slice_len - (gsize)(chunk - slice);
+    glong chunk_chars = g_utf8_strlen(chunk, chunk_len);
+
+    g_string_append_len(content->text, chunk, chunk_len);
+    offset += chunk_chars;
+
+    if (next == NULL)
+      break;
+
+    gtk_text_iter_forward_chars(&iter, chunk_chars);
+
+    GtkTextChildAnchor* anch = gtk_text_iter_get_child_anchor(&iter);
+
+    if (anch)
+    {
+      guint widgets_len = 0;
+      GtkWidget** widgets = gtk_text_child_anchor_get_widgets(anch, &widgets_len);
+
+      KanbanAnchor* pending = g_object_get_qdata(G_OBJECT(anch), pending_task_quark());
+
+      for (guint i = 0; i < widgets_len; i++)
+      {
+        KanbanAnchor anchor;
+        anchor.offset = offset;
+        anchor.title  = g_strdup(read_task(widgets[i], &anchor.done));
+        g_array_append_val(content->anchors, anchor);
+      }
+
+      if (widgets_len == 0 && pending)
+      {
+        KanbanAnchor anchor;
+        anchor.offset = offset;
+        anchor.title  = g_strdup(pending->title);
+        anchor.done   = pending->done;
+        g_array_append_val(content->anchors, anchor);
+      }
+
+      g_free(widgets);
+    }
+    else if (!gtk_text_iter_get_paintable(&iter))
+    {
+      g_string_append_len(content->text, anchorchar, lenstr(anchorchar));
+      offset++;
+    }
+
+    gtk_text_iter_forward_char(&iter);
+    chunk = next + lenstr(anchorchar);
+  }
+
+  g_free(slice);
+
+  return content;
+}
+
+/*
+ * set_buffer_content replaces the text of GtkTextBuffer with content,
+ * text and task anchors are inserted in one forward pass at the end of
+ * the buffer, so no iterator has to be looked up by offset again.
+ *
+ * No widget is made for the tasks, each anchor keeps its task until
+ * take_pending_task() is called on it, and is read from there meanwhile.
+ *
+ * Returns the anchors in buffer order, release it with g_ptr_array_unref() */
+
+GPtrArray*
+set_buffer_content(GtkTextBuffer* buffer, const KanbanUnserializedContent* content)
+{
+  GPtrArray* anchors = g_ptr_array_new_full(content->anchors->len, g_object_unref);
+  const gchar* text  = content->text->str;
+  const gchar* end   = text + content->text->len;
+  const gchar* chunk = text;
+  guint offset = 0;
+  GtkTextIter iter;
+
+  gtk_text_buffer_set_text(buffer, "", 0);
+  gtk_text_buffer_get_end_iter(buffer, &iter);
+
+  for (guint i = 0; i < content->anchors->len; i++)
+  {
+    const KanbanAnchor* anchor = &g_array_index(content->anchors, KanbanAnchor, i);
+    const gchar* next = chunk;
+
+    /* Offsets only grow, the text is walked once */
+    for (; offset < anchor->offset && next < end; offset++)
+      next = g_utf8_next_char(next);
+
+    if (next > chunk)
+      gtk_text_buffer_insert(buffer, &iter, chunk, next - chunk);
+    chunk = next;
+
+    /* iter is revalidated past the new anchor */
+    GtkTextChildAnchor* anch = gtk_text_buffer_create_child_anchor(buffer, &iter);
+    KanbanAnchor* pending = g_new0(KanbanAnchor, 1);
+
+    pending->title = g_strdup(anchor->title ? anchor->title : "");
+    pending->done  = anchor->done;
+    g_object_set_qdata_full(G_OBJECT(anch), pending_task_quark(), pending,
+                            pending_task_free);
+
+    g_ptr_array_add(anchors, g_object_ref(anch));
+  }
+
+  if (chunk < end)
+    gtk_text_buffer_insert(buffer, &iter, chunk, end - chunk);
+
+  return anchors;
+}
+
+/*
+ * take_pending_task returns the title of the task anchor is waiting a
+ * widget for, and forgets it. Returns NULL when there is none
+ *
+ * the user must release the returned pointer with g_free() */
+
+gchar*
+take_pending_task(GtkTextChildAnchor* anchor, gboolean* done)
+{
+  KanbanAnchor* pending = g_object_steal_qdata(G_OBJECT(anchor), pending_task_quark());
+
+  if (pending == NULL)
+    return NULL;
+
+  gchar* title = pending->title;
+
+  *done = pending->done;
+  g_free(pending);
+
+  return title;
+}
@@ -0,0 +1,43 @@
+/* kanban-text-buffer.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "utils/kanban-serializer.h"
+
+/*
+ * Card descriptions as shown in a GtkTextBuffer, where each task sits at
+ * a child anchor. The descriptions themselves, and the rest of the board,
+ * are in the core library and know nothing of GTK.
+ * */
+
+GBytes*
+get_serialized_buffer(GtkTextBuffer *buffer);
+
+KanbanUnserializedContent*
+get_buffer_content(GtkTextBuffer *buffer);
+
+GPtrArray*
+set_buffer_content(GtkTextBuffer *buffer, const KanbanUnserializedContent* content);
+
+gchar*
+take_pending_task(GtkTextChildAnchor* anchor, gboolean* done);
@@ -23,10 +23,24 @@
 #include <glib/gi18n.h>
 
 #include "kanban-application.h"
+#include "kanban-card.h"
 #include "kanban-column.h"
-#include "json-glib/json-glib.h"
+#include "utils/kanban-board-file.h"
+#include "utils/kanban-board-model.h"
+#include "utils/kanban-journal.h"
+#include "utils/kanban-trace.h"
 
 const gchar FileName[] = ".thisweekinmylife\0";
+const gchar BoardDirName[] = ".thisweekinmylife.d\0";
+
+/* Card edits reach the journal at most every JOURNAL_FLUSH_MS */
+#define JOURNAL_FLUSH_MS         500
+
+/* Keystrokes closer than this hold an overdue autosave back */
+#define AUTOSAVE_TYPING_PAUSE_MS 300
+
+/* Time spent building cards on each frame while the board loads */
+#define LOAD_FRAME_BUDGET_US     6000
 
 struct _KanbanWindow
 {
@@ -36,71 +50,458 @@ struct _KanbanWindow
 
     /* Template widgets */
     GtkHeaderBar        *header_bar;
-    GtkBox              *mainBox;
+    GtkListView         *ColumnsView;
     GtkButton           *save;
     GtkToggleButton     *EditBtn;
-    GList               *ListOfColumns;
+    KanbanBoardModel    *Board;
+
+    KanbanJournal       *Journal;
+    GHashTable          *PendingCards;
+    guint                FlushSource;
+
+    /* Autosave, configured in GSettings. Each edit pushes the save back
+     * by AutosaveDelay, up to AutosaveDeadline */
+    GSettings           *Settings;
+    gboolean             Autosave;
+    guint                AutosaveDelay;
+    guint                AutosaveMaxLatency;
+    guint                AutosaveSource;
+    gint64               AutosaveDeadline;
+    gint64               LastTyping;
+
+    guint                SavingGeneration;
+    guint                JournalBase;
+    GPtrArray           *SavingColumns;
+    gboolean             SaveInFlight;
+    gboolean             SaveQueued;
+    gboolean             SaveNotify;
+    gboolean             QueuedNotify;
+    gboolean             QuitAfterSave;
+    gboolean             CloseAfterSave;
+    gboolean             SaveFailed;
+    gboolean             Disposed;
+
+    /* Progressive loading, LoadColumns and LoadNext, the next card to
+     * build in each column, run parallel to LoadBoard->columns.
+     * LoadIndex maps the column items to their index plus one. Columns
+     * come through LoadQueue as they are read, BoardRead is set once
+     * they all did */
+    GCancellable        *LoadCancellable;
+    GAsyncQueue         *LoadQueue;
+    gboolean             BoardRead;
+    KanbanBoardRecord   *LoadBoard;
+    GPtrArray           *LoadColumns;
+    GArray              *LoadNext;
+    GHashTable          *LoadIndex;
+    guint                LoadTick;
+    KanbanColumnItem    *FillingColumn;
+    gboolean             Loading;
 };
 
 G_DEFINE_FINAL_TYPE (KanbanWindow, kanban_window, ADW_TYPE_APPLICATION_WINDOW)
 
 
-gboolean
-save_cards(gpointer user_data)
+static void
+journal_failed(GError* error)
 {
-  JsonGenerator *generator;
-  JsonNode *root;
-  JsonObject *CardObject;
-  KanbanColumn *item;
-  KanbanWindow* wnd;
-  gchar *data = NULL;
-  gchar *file_path = NULL;
-  gsize len;
-  gboolean success = FALSE;
+  g_warning("Failed to write the journal: %s", error->message);
+  g_error_free(error);
+}
 
-  g_return_val_if_fail(KANBAN_IS_WINDOW(user_data), FALSE);
-  
-  wnd = KANBAN_WINDOW(user_data);
-  generator = json_generator_new();
-  root = json_node_new(JSON_NODE_OBJECT);
-  CardObject = json_object_new();
+static void journal_pending_cards(KanbanWindow* self);
+static void save_board_done(GObject* source, GAsyncResult* result, gpointer user_data);
+
+/*
+ * Takes a snapshot of the board and writes it from a worker thread, the
+ * cards hand over their cached encoding so the snapshot is cheap.
+ * Columns that did not change only need their place in the manifest.
+ *
+ * One save runs at a time, a save asked for meanwhile runs once it is
+ * done, with a fresh snapshot. Saves also wait for the board to load.
+ * */
+static void
+save_board(KanbanWindow* wnd, gboolean notify)
+{
+  if (wnd->SaveInFlight || wnd->Loading) {
+    wnd->SaveQueued    = TRUE;
+    wnd->QueuedNotify |= notify;
+    return;
+  }
+
+  KanbanBoardRecord *board = kanban_board_record_new();
+  KanbanColumnItem *item;
+  gchar *dir_path;
+
+  KANBAN_TRACE_SCOPE("save_board");
+
+  g_clear_handle_id(&wnd->AutosaveSource, g_source_remove);
+  wnd->AutosaveDeadline = 0;
+
+  /* The edits journaled so far are part of the snapshot, the next ones
+   * go to a new generation */
+  board->journal = wnd->JournalBase;
+  if (wnd->Journal) {
+    GError* error = NULL;
 
-  for(GList* elem = wnd->ListOfColumns; elem; elem = elem->next) {
-    item = elem->data;
-    kanban_column_get_json(item, CardObject);
+    g_clear_handle_id(&wnd->FlushSource, g_source_remove);
+    journal_pending_cards(wnd);
+
+    board->journal = kanban_journal_get_generation(wnd->Journal) + 1;
+    if (!kanban_journal_rotate(wnd->Journal, &error))
+      journal_failed(error);
   }
 
-  json_node_take_object(root, CardObject);
-  json_generator_set_root(generator, root);
-  g_object_set(generator, "pretty", FALSE, NULL);
-  
-  data = json_generator_to_data(generator, &len);
-  file_path = g_build_filename(g_get_home_dir(), FileName, NULL);
+  for (guint i = 0; i < g_list_model_get_n_items(G_LIST_MODEL(wnd->Board)); i++) {
+    KanbanColumnRecord *record;
+
+    item = kanban_board_model_get_column(wnd->Board, i);
+    if (kanban_column_item_get_dirty(item)) {
+      gchar* shard = kanban_board_shard_new_name();
+
+      /* Written next to the shard on disk, which stays as it is should
+       * the save be cut short */
+      kanban_column_item_set_shard(item, shard);
+      g_free(shard);
 
+      record = kanban_column_item_get_record(item);
+      g_ptr_array_add(wnd->SavingColumns, g_object_ref(item));
+    } else {
+      record = kanban_column_record_new(kanban_column_item_get_title(item));
+      record->shard = g_strdup(kanban_column_item_get_shard(item));
+      record->dirty = FALSE;
+    }
+
+    g_ptr_array_add(board->columns, record);
+  }
+
+  /* Edits from here on make the board dirty again */
+  kanban_board_model_clear_dirty(wnd->Board);
+
+  wnd->SaveInFlight     = TRUE;
+  wnd->SaveNotify       = notify;
+  wnd->SavingGeneration = board->journal;
+
+  KANBAN_TRACE_ASYNC_BEGIN("board save", wnd->SavingGeneration);
+
+  dir_path = g_build_filename(g_get_home_dir(), BoardDirName, NULL);
+  kanban_board_dir_save_async(board, dir_path, NULL, save_board_done, g_object_ref(wnd));
+  g_free(dir_path);
+}
+
+static void
+save_board_done(GObject* source, GAsyncResult* result, gpointer user_data)
+{
+  KanbanWindow* wnd = KANBAN_WINDOW(user_data);
   GError* error = NULL;
-  if (!g_file_set_contents(file_path, data, -1, &error)) {
+  gboolean success = kanban_board_dir_save_finish(result, &error);
+
+  KANBAN_TRACE_ASYNC_END("board save", wnd->SavingGeneration);
+
+  wnd->SaveInFlight = FALSE;
+  wnd->SaveFailed   = !success;
+
+  if (success) {
+    gchar* dir_path = g_build_filename(g_get_home_dir(), BoardDirName, NULL);
+    kanban_journal_remove_before(dir_path, wnd->SavingGeneration);
+    wnd->JournalBase = wnd->SavingGeneration;
+    g_free(dir_path);
+  } else {
+    /* Those columns are written again by the next save, and so is the
+     * manifest */
+    for (guint i = 0; i < wnd->SavingColumns->len; i++)
+      kanban_column_item_mark_dirty(g_ptr_array_index(wnd->SavingColumns, i));
+    if (!wnd->Disposed)
+      kanban_board_model_mark_dirty(wnd->Board);
+  }
+  g_ptr_array_set_size(wnd->SavingColumns, 0);
+
+  if (wnd->Disposed) {
+    g_clear_error(&error);
+    g_object_unref(wnd);
+    return;
+  }
+
+  if (!success) {
     gchar* msg = g_strdup_printf("Error saving file: %s\n", error->message);
     g_printerr("%s", msg);
     adw_toast_overlay_add_toast(wnd->toast_overlay, adw_toast_new(msg));
     g_free(msg);
     g_error_free(error);
-    goto cleanup;
+
+    /* The edits are still in the journal, but do not leave on a failed save */
+    wnd->QuitAfterSave  = FALSE;
+    wnd->CloseAfterSave = FALSE;
+  } else {
+    if (wnd->SaveNotify)
+      adw_toast_overlay_add_toast(wnd->toast_overlay, adw_toast_new("Saved"));
   }
 
-  adw_toast_overlay_add_toast(wnd->toast_overlay, adw_toast_new("Saved"));
-  gtk_widget_set_sensitive(GTK_WIDGET(wnd->save), FALSE);
-  SaveNeeded = FALSE;
-  success = TRUE;
+  if (wnd->SaveQueued) {
+    gboolean notify = wnd->QueuedNotify;
+
+    wnd->SaveQueued   = FALSE;
+    wnd->QueuedNotify = FALSE;
+    save_board(wnd, notify);
+  } else if (wnd->QuitAfterSave) {
+    g_application_quit(G_APPLICATION(gtk_window_get_application(GTK_WINDOW(wnd))));
+  } else if (wnd->CloseAfterSave) {
+    wnd->CloseAfterSave = FALSE;
+    gtk_window_close(GTK_WINDOW(wnd));
+  }
 
-cleanup:
-  g_free(file_path);
-  g_free(data);
-  json_node_free(root);
-  g_object_unref(generator);
+  g_object_unref(wnd);
+}
+
+gboolean
+save_cards(gpointer user_data)
+{
+  g_return_val_if_fail(KANBAN_IS_WINDOW(user_data), FALSE);
 
-  return success; 
+  KANBAN_TRACE_SCOPE("save_cards");
+
+  save_board(KANBAN_WINDOW(user_data), TRUE);
+
+  return TRUE;
 }
 
+/* Quits the application, once the save in progress, if any, is written */
+void
+quit_after_save(gpointer user_data)
+{
+  KanbanWindow* wnd;
+
+  g_return_if_fail(KANBAN_IS_WINDOW(user_data));
+
+  wnd = KANBAN_WINDOW(user_data);
+
+  if (wnd->SaveInFlight || wnd->SaveQueued) {
+    wnd->QuitAfterSave = TRUE;
+    return;
+  }
+
+  g_application_quit(G_APPLICATION(gtk_window_get_application(GTK_WINDOW(wnd))));
+}
+
+/* Drops the edits made since the last save, so they are not replayed */
+void
+discard_changes(gpointer user_data)
+{
+  KanbanWindow* wnd;
+  GError* error = NULL;
+
+  g_return_if_fail(KANBAN_IS_WINDOW(user_data));
+
+  wnd = KANBAN_WINDOW(user_data);
+
+  g_clear_handle_id(&wnd->FlushSource, g_source_remove);
+  g_clear_handle_id(&wnd->AutosaveSource, g_source_remove);
+  wnd->AutosaveDeadline = 0;
+  g_hash_table_remove_all(wnd->PendingCards);
+
+  if (wnd->Journal && !kanban_journal_discard(wnd->Journal, &error)) {
+    g_warning("Failed to empty the journal: %s", error->message);
+    g_error_free(error);
+  }
+}
+
+static gboolean
+autosave_timeout(gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(user_data);
+  gint64 now = g_get_monotonic_time();
+  gint64 since_typing = (now - self->LastTyping) / 1000;
+
+  self->AutosaveSource = 0;
+
+  /* Past the deadline, wait for a pause in typing for at most one delay */
+  if (since_typing < AUTOSAVE_TYPING_PAUSE_MS &&
+      now < self->AutosaveDeadline + self->AutosaveDelay * G_GINT64_CONSTANT(1000)) {
+    self->AutosaveSource = g_timeout_add(AUTOSAVE_TYPING_PAUSE_MS - since_typing,
+                                         autosave_timeout, self);
+    return G_SOURCE_REMOVE;
+  }
+
+  save_board(self, FALSE);
+
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Merges bursts of edits into a single save, which also folds the
+ * journal into the board. Without autosave the edits are unsaved ones,
+ * the journal keeps them until the board is saved or they are discarded
+ * on close, and grows with them meanwhile.
+ * */
+static void
+schedule_autosave(KanbanWindow* self)
+{
+  gint64 now, due;
+
+  if (!self->Autosave)
+    return;
+
+  now = g_get_monotonic_time();
+  if (self->AutosaveDeadline == 0)
+    self->AutosaveDeadline = now + self->AutosaveMaxLatency * G_GINT64_CONSTANT(1000);
+
+  due = MIN(now + self->AutosaveDelay * G_GINT64_CONSTANT(1000), self->AutosaveDeadline);
+
+  g_clear_handle_id(&self->AutosaveSource, g_source_remove);
+  self->AutosaveSource = g_timeout_add(MAX(due - now, 0) / 1000, autosave_timeout, self);
+}
+
+static void
+settings_changed(GSettings* settings, const gchar* key, gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(user_data);
+
+  self->Autosave           = g_settings_get_boolean(settings, "autosave");
+  self->AutosaveDelay      = g_settings_get_uint(settings, "autosave-delay");
+  self->AutosaveMaxLatency = g_settings_get_uint(settings, "autosave-max-latency");
+  kanban_card_pool_set_size(g_settings_get_uint(settings, "card-pool-size"));
+
+  if (!self->Autosave) {
+    g_clear_handle_id(&self->AutosaveSource, g_source_remove);
+    self->AutosaveDeadline = 0;
+  }
+}
+
+/*
+ * The board tracks unsaved edits, it only notifies when it goes from
+ * saved to edited or back, so typing does not reach the save button
+ * */
+static void
+board_dirty_changed(KanbanBoardModel* board, GParamSpec* pspec, gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(user_data);
+  gboolean dirty = kanban_board_model_get_dirty(board);
+
+  gtk_widget_set_sensitive(GTK_WIDGET(self->save), dirty);
+  SaveNeeded = dirty;
+}
+
+/*
+ * Schedules the autosave for an edit and tells whether it goes to the
+ * journal, edits made while the board is being restored are already on
+ * disk
+ * */
+static gboolean
+record_edit(KanbanWindow* self)
+{
+  if (!IsInitialized)
+    return FALSE;
+
+  schedule_autosave(self);
+
+  return self->Journal != NULL;
+}
+
+/*
+ * Writes the latest content of the edited cards at their current
+ * position, cards no longer on the board were removed since, and moved
+ * ones were written whole when inserted
+ * */
+static void
+journal_pending_cards(KanbanWindow* self)
+{
+  GHashTableIter iter;
+  gpointer card;
+
+  g_hash_table_iter_init(&iter, self->PendingCards);
+  while (g_hash_table_iter_next(&iter, &card, NULL)) {
+    KanbanColumnItem* column = kanban_card_item_get_column(card);
+    gint col   = column ? kanban_board_model_get_position(self->Board, column) : -1;
+    gint index = column ? kanban_column_item_get_position(column, card) : -1;
+
+    if (col < 0 || index < 0)
+      continue;
+
+    GError* error = NULL;
+    GBytes* encoded = kanban_card_item_get_encoded(card);
+    if (!kanban_journal_update_card(self->Journal, col, index, encoded, &error))
+      journal_failed(error);
+    g_bytes_unref(encoded);
+  }
+
+  g_hash_table_remove_all(self->PendingCards);
+}
+
+static gboolean
+flush_pending_cards(gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(user_data);
+
+  self->FlushSource = 0;
+  journal_pending_cards(self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+journal_card_changed(KanbanColumnItem* column, KanbanCardItem* card, gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(user_data);
+
+  if (column == self->FillingColumn)
+    return;
+
+  self->LastTyping = g_get_monotonic_time();
+  if (!record_edit(self))
+    return;
+
+  if (!g_hash_table_contains(self->PendingCards, card))
+    g_hash_table_add(self->PendingCards, g_object_ref(card));
+
+  if (self->FlushSource == 0)
+    self->FlushSource = g_timeout_add(JOURNAL_FLUSH_MS, flush_pending_cards, self);
+}
+
+static void
+journal_card_inserted(KanbanColumnItem* column, KanbanCardItem* card, guint index,
+                      gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(user_data);
+  gint col = kanban_board_model_get_position(self->Board, column);
+  GError* error = NULL;
+
+  if (column == self->FillingColumn || !record_edit(self) || col < 0)
+    return;
+
+  GBytes* encoded = kanban_card_item_get_encoded(card);
+  if (!kanban_journal_insert_card(self->Journal, col, index, encoded, &error))
+    journal_failed(error);
+  g_bytes_unref(encoded);
+}
+
+static void
+journal_card_removed(KanbanColumnItem* column, guint index, gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(user_data);
+  gint col = kanban_board_model_get_position(self->Board, column);
+  GError* error = NULL;
+
+  if (!record_edit(self) || col < 0)
+    return;
+
+  if (!kanban_journal_remove_card(self->Journal, col, index, &error))
+    journal_failed(error);
+}
+
+static void
+journal_title_changed(KanbanColumnItem* column, gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(user_data);
+  gint col = kanban_board_model_get_position(self->Board, column);
+  GError* error = NULL;
+
+  self->LastTyping = g_get_monotonic_time();
+  if (!record_edit(self) || col < 0)
+    return;
+
+  if (!kanban_journal_rename_column(self->Journal, col,
+                                    kanban_column_item_get_title(column), &error))
+    journal_failed(error);
+}
 
 static void
 response(AdwDialog* self, const char* response, gpointer user_data)
@@ -115,11 +516,13 @@ response(AdwDialog* self, const char* response, gpointer user_data)
   if (g_strcmp0(response, "save") == 0)
   {
     save_cards(user_data);
-    SaveNeeded = FALSE;
+  }
+  else if (g_strcmp0(response, "discard") == 0)
+  {
+    discard_changes(user_data);
   }
 
-  GApplication* app = G_APPLICATION(gtk_window_get_application(GTK_WINDOW(user_data)));
-  g_application_quit(app);
+  quit_after_save(user_data);
 }
 
 
@@ -128,12 +531,23 @@ static gboolean
 save_before_quit(KanbanWindow* self)
 {
   g_return_val_if_fail(KANBAN_IS_WINDOW(self), FALSE);
-  
-  gboolean sensitive = gtk_widget_get_sensitive(GTK_WIDGET(self->save));
 
-  if (!sensitive)
+  /* Come back once the board is written */
+  if (self->SaveInFlight || self->SaveQueued) {
+    self->CloseAfterSave = TRUE;
+    return TRUE;
+  }
+
+  if (!kanban_board_model_get_dirty(self->Board))
     return FALSE;
 
+  /* Autosave flushes the board instead of asking, unless saving failed */
+  if (self->Autosave && !self->SaveFailed) {
+    self->CloseAfterSave = TRUE;
+    save_board(self, FALSE);
+    return TRUE;
+  }
+
   AdwDialog *dialog;
 
   dialog = ADW_DIALOG(adw_alert_dialog_new(_("Save Changes?"),
@@ -162,76 +576,191 @@ static void
 remove_column(KanbanColumn* Column, gpointer user_data)
 {
   KanbanWindow* Window = KANBAN_WINDOW (user_data);
-  Window->ListOfColumns = g_list_remove (Window->ListOfColumns, Column);
-  gtk_box_remove (Window->mainBox, GTK_WIDGET(Column));
-  gtk_widget_set_sensitive (GTK_WIDGET (Window->save), true);
+  KanbanColumnItem* item = kanban_column_get_item (Column);
+  gint col = kanban_board_model_get_position (Window->Board, item);
+  GError* error = NULL;
+
+  if (col < 0)
+    return;
+
+  if (record_edit (Window)) {
+    if (!kanban_journal_remove_column (Window->Journal, col, &error))
+      journal_failed (error);
+  }
+
+  g_signal_handlers_disconnect_by_data (item, Window);
+  kanban_board_model_remove (Window->Board, col);
 }
 
+/* Moves the dropped card out of its column and into this one, where the
+ * column shows it would go */
 static gboolean
 item_drag_drop (GtkDropTarget *dest,
                 const GValue  *value,
                 double         x,
                 double         y){
 
-  if (G_VALUE_TYPE (value) != G_TYPE_POINTER)
+  if (!G_VALUE_HOLDS (value, KANBAN_TYPE_CARD_ITEM))
     return FALSE;
 
-  GtkWidget* card = (GtkWidget*)g_value_get_pointer(value);
+  KANBAN_TRACE_SCOPE ("item_drag_drop");
+
+  KanbanCardItem* card = g_value_get_object (value);
 
   KanbanColumn* col = KANBAN_COLUMN (gtk_event_controller_get_widget (
                                      GTK_EVENT_CONTROLLER (dest)));
 
-  kanban_column_content_dropped(col);
+  /* The value holds a reference while the card is between columns */
   kanban_column_insert_card(col,y,card);
-  g_object_unref (card);
+  kanban_column_content_dropped(col);
 
   return TRUE;
 }
 
-GtkWidget*
+/*
+ * Puts column on the board, the journal follows its edits from there on.
+ * The column strip only has widgets for the columns on screen
+ * */
+static void
+add_column(KanbanWindow* Window, KanbanColumnItem* item)
+{
+  g_signal_connect_object(item, "card-inserted", G_CALLBACK(journal_card_inserted), Window, 0);
+  g_signal_connect_object(item, "card-removed", G_CALLBACK(journal_card_removed), Window, 0);
+  g_signal_connect_object(item, "card-changed", G_CALLBACK(journal_card_changed), Window, 0);
+  g_signal_connect_object(item, "title-changed", G_CALLBACK(journal_title_changed), Window, 0);
+
+  kanban_board_model_append(Window->Board, item);
+
+  if (record_edit(Window)) {
+    GError* error = NULL;
+    if (!kanban_journal_add_column(Window->Journal, kanban_column_item_get_title(item), &error))
+      journal_failed(error);
+  }
+}
+
+void
 create_column(KanbanWindow* Window, const gchar* title)
 {
-  g_return_val_if_fail(KANBAN_IS_WINDOW(Window), NULL);
-  g_return_val_if_fail(title != NULL, NULL);
+  g_return_if_fail(KANBAN_IS_WINDOW(Window));
+  g_return_if_fail(title != NULL);
+
+  KANBAN_TRACE_SCOPE("create_column");
+
+  KanbanColumnItem* item = kanban_column_item_new(title);
+  add_column(Window, item);
+  g_object_unref(item);
+}
 
+/* Tells whether the cards of column are still being built */
+static gboolean
+column_loading(KanbanWindow* self, KanbanColumnItem* column)
+{
+  guint index;
+  KanbanColumnRecord* record;
+
+  if (!self->LoadIndex)
+    return FALSE;
+
+  index = GPOINTER_TO_UINT(g_hash_table_lookup(self->LoadIndex, column));
+  if (index == 0)
+    return FALSE;
+
+  record = g_ptr_array_index(self->LoadBoard->columns, index - 1);
+  return g_array_index(self->LoadNext, guint, index - 1) < record->cards->len;
+}
+
+/* Columns take edits once their cards are in and the journal is open */
+static gboolean
+column_ready(KanbanWindow* self, KanbanColumnItem* column)
+{
+  return (!self->Loading || self->BoardRead) && !column_loading(self, column);
+}
+
+static void
+setup_column(GtkSignalListItemFactory* factory, GtkListItem* list_item, gpointer user_data)
+{
+  KanbanWindow* Window = KANBAN_WINDOW(user_data);
   KanbanColumn* column = kanban_column_new();
-  if (!column) {
-    g_warning("Failed to create new KanbanColumn");
-    return NULL;
-  }
+  GtkDropTarget* target = gtk_drop_target_new(KANBAN_TYPE_CARD_ITEM, GDK_ACTION_COPY);
 
-  GtkDropTarget* target = gtk_drop_target_new(G_TYPE_POINTER, GDK_ACTION_COPY);
-  if (!target) {
-    g_warning("Failed to create drop target");
-    g_object_unref(column);
-    return NULL;
-  }
+  g_signal_connect(target, "drop", G_CALLBACK(item_drag_drop), NULL);
+  gtk_widget_add_controller(GTK_WIDGET(column), GTK_EVENT_CONTROLLER(target));
+  g_signal_connect(column, "delete-column", G_CALLBACK(remove_column), Window);
 
-  kanban_column_set_title(column, title);
-  
-  if (!g_signal_connect(target, "drop", G_CALLBACK(item_drag_drop), NULL)) {
-    g_warning("Failed to connect drop signal");
-    g_object_unref(target);
-    g_object_unref(column);
-    return NULL;
+  g_object_bind_property(Window->EditBtn, "active", column, "edit-mode",
+                         G_BINDING_BIDIRECTIONAL | G_BINDING_SYNC_CREATE);
+
+  gtk_list_item_set_activatable(list_item, FALSE);
+  gtk_list_item_set_selectable(list_item, FALSE);
+  gtk_list_item_set_child(list_item, GTK_WIDGET(column));
+}
+
+static void
+bind_column(GtkSignalListItemFactory* factory, GtkListItem* list_item, gpointer user_data)
+{
+  KanbanWindow* Window = KANBAN_WINDOW(user_data);
+  GtkWidget* column = gtk_list_item_get_child(list_item);
+  KanbanColumnItem* item = gtk_list_item_get_item(list_item);
+
+  kanban_column_set_item(KANBAN_COLUMN(column), item);
+  gtk_widget_set_sensitive(column, column_ready(Window, item));
+}
+
+static void
+unbind_column(GtkSignalListItemFactory* factory, GtkListItem* list_item, gpointer user_data)
+{
+  kanban_column_set_item(KANBAN_COLUMN(gtk_list_item_get_child(list_item)), NULL);
+}
+
+static void
+kanban_window_dispose(GObject* object)
+{
+  KanbanWindow* self = KANBAN_WINDOW(object);
+
+  g_clear_handle_id(&self->FlushSource, g_source_remove);
+  g_clear_handle_id(&self->AutosaveSource, g_source_remove);
+
+  if (self->LoadCancellable)
+    g_cancellable_cancel(self->LoadCancellable);
+  g_clear_object(&self->LoadCancellable);
+  g_clear_pointer(&self->LoadQueue, g_async_queue_unref);
+  if (self->LoadTick) {
+    gtk_widget_remove_tick_callback(GTK_WIDGET(self), self->LoadTick);
+    self->LoadTick = 0;
   }
+  g_clear_pointer(&self->LoadBoard, kanban_board_record_free);
+  g_clear_pointer(&self->LoadColumns, g_ptr_array_unref);
+  g_clear_pointer(&self->LoadNext, g_array_unref);
+  g_clear_pointer(&self->LoadIndex, g_hash_table_unref);
 
-  if (!g_signal_connect(column, "delete-column", G_CALLBACK(remove_column), Window)) {
-    g_warning("Failed to connect delete-column signal");
-    g_object_unref(target);
-    g_object_unref(column);
-    return NULL;
+  /* Keep the last edits, the board is replayed from them next time */
+  if (self->Journal && self->PendingCards)
+    journal_pending_cards(self);
+
+  g_clear_pointer(&self->PendingCards, g_hash_table_unref);
+  g_clear_pointer(&self->Journal, kanban_journal_close);
+  g_clear_object(&self->Board);
+  g_clear_object(&self->Settings);
+
+  if (!self->Disposed) {
+    guint hits, misses;
+
+    kanban_card_pool_get_stats(&hits, &misses);
+    g_debug("Card pool: %u reused, %u built", hits, misses);
   }
+  self->Disposed = TRUE;
 
-  g_object_bind_property(column, "needs-saving", Window->save, "sensitive", G_BINDING_BIDIRECTIONAL);
-  g_object_bind_property(column, "edit-mode", Window->EditBtn, "active", G_BINDING_BIDIRECTIONAL);
-  g_object_set(column, "needs-saving", FALSE, NULL);
+  G_OBJECT_CLASS(kanban_window_parent_class)->dispose(object);
+}
 
-  gtk_widget_add_controller(GTK_WIDGET(column), GTK_EVENT_CONTROLLER(target));
-  gtk_box_append(Window->mainBox, GTK_WIDGET(column));
-  Window->ListOfColumns = g_list_append(Window->ListOfColumns, column);
+static void
+kanban_window_finalize(GObject* object)
+{
+  KanbanWindow* self = KANBAN_WINDOW(object);
 
-  return GTK_WIDGET(column);
+  g_ptr_array_unref(self->SavingColumns);
+
+  G_OBJECT_CLASS(kanban_window_parent_class)->finalize(object);
 }
 
 static void
@@ -241,107 +770,448 @@ GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
   gtk_widget_class_set_template_from_resource (widget_class, "/com/github/zhrexl/kanban/kanban-window.ui");
   gtk_widget_class_bind_template_child (widget_class, KanbanWindow, header_bar);
-  gtk_widget_class_bind_template_child (widget_class, KanbanWindow, mainBox);
+  gtk_widget_class_bind_template_child (widget_class, KanbanWindow, ColumnsView);
   gtk_widget_class_bind_template_child (widget_class, KanbanWindow, save);
   gtk_widget_class_bind_template_child (widget_class, KanbanWindow, EditBtn);
   gtk_widget_class_bind_template_child (widget_class, KanbanWindow, toast_overlay);
 
   gtk_widget_class_bind_template_callback (GTK_WIDGET_CLASS (klass), save_cards);
+
+  G_OBJECT_CLASS (klass)->dispose = kanban_window_dispose;
+  G_OBJECT_CLASS (klass)->finalize = kanban_window_finalize;
 }
 
 
-static
-void create_cards_from_json(KanbanColumn* Column, JsonNode* node)
+/*
+ * Creates the columns and cards of board, columns read back from their
+ * shard keep its name and are not written again until they change
+ * */
+static void
+load_board(KanbanWindow* self, const KanbanBoardRecord* board)
 {
-  JsonObject* object = json_node_get_object (node);
-  GList* list = json_object_get_members (object);
+  for (guint i = 0; i < board->columns->len; i++) {
+    KanbanColumnRecord* record = g_ptr_array_index(board->columns, i);
+    KanbanColumnItem* item = kanban_column_item_new_from_record(record);
 
-  for (GList* child = list; child != NULL; child = child->next)
-  {
-    const gchar*  objectname  = child->data;
-    JsonNode*     member      = json_object_get_member (object, objectname);
-    JsonObject*   objmember   = json_node_get_object (member);
+    add_column(self, item);
+    g_object_unref(item);
+  }
+}
 
-    const gchar*  description = json_object_get_string_member (objmember,
-                                                              "description");
-    gboolean revealed = json_object_get_boolean_member (objmember, "revealed");
+/*
+ * Reads a single file board, every column is written to a new shard on
+ * the next save
+ * */
+static KanbanBoardRecord*
+read_board_file(const gchar* file_path)
+{
+  if (!g_file_test(file_path, G_FILE_TEST_EXISTS)) {
+    g_message("No JSON file was found! Creating a new one...");
+    return NULL;
+  }
+
+  GError* error = NULL;
+  KanbanBoardRecord* board = kanban_board_file_load(file_path, &error);
+  if (!board) {
+    g_warning("Error loading board: %s", error->message);
+    g_error_free(error);
+    return NULL;
+  }
 
-    kanban_column_add_new_card (Column, objectname, description, revealed);
+  if (!board->columns->len) {
+    g_message("No columns found in JSON");
+    kanban_board_record_free(board);
+    return NULL;
   }
 
-  g_list_free(list);
+  return board;
 }
 
+static const char* Weekdays[] = {
+  "Monday",
+  "Tuesday",
+  "Wednesday",
+  "Thursday",
+  "Friday",
+  NULL
+};
 
-static
-int loadjson(KanbanWindow* self, const gchar* file_path)
+/*
+ * What the loading thread shares with the window: columns are pushed to
+ * the window's queue as soon as they are read, unless there are edits
+ * to replay, which need the whole board first
+ * */
+typedef struct
 {
-  g_return_val_if_fail(KANBAN_IS_WINDOW(self), 1);
-  g_return_val_if_fail(file_path != NULL, 1);
+  gchar*             home_dir;
+  GAsyncQueue*       columns;  /* KanbanColumnRecord */
+  KanbanBoardRecord* board;
+  guint              n_columns;
+} BoardReading;
 
-  JsonParser* parser = json_parser_new();
-  if (!parser) {
-    g_warning("Failed to create JSON parser");
-    return 1;
+static void
+board_reading_free(BoardReading* reading)
+{
+  g_free(reading->home_dir);
+  g_async_queue_unref(reading->columns);
+  if (reading->board)
+    kanban_board_record_free(reading->board);
+  g_free(reading);
+}
+
+static void
+column_read(KanbanColumnRecord* column, gpointer user_data)
+{
+  BoardReading* reading = user_data;
+
+  reading->n_columns++;
+
+  if (reading->board)
+    g_ptr_array_add(reading->board->columns, column);
+  else
+    g_async_queue_push(reading->columns, column);
+}
+
+static gboolean
+stream_board_dir(BoardReading* reading, const gchar* dir_path, guint* journal,
+                 GCancellable* cancellable)
+{
+  gchar* manifest = g_build_filename(dir_path, KANBAN_BOARD_MANIFEST, NULL);
+  gboolean exists = g_file_test(manifest, G_FILE_TEST_EXISTS);
+  g_free(manifest);
+
+  if (!exists)
+    return FALSE;
+
+  GError* error = NULL;
+  if (!kanban_board_dir_read(dir_path, FALSE, journal, column_read, reading, cancellable,
+                             &error)) {
+    g_warning("Error loading board: %s", error->message);
+    g_error_free(error);
+    return FALSE;
   }
 
+  if (!reading->n_columns) {
+    g_message("No columns found in %s", dir_path);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Columns read before an error stay on the board */
+static gboolean
+stream_board_file(BoardReading* reading, const gchar* file_path, GCancellable* cancellable)
+{
   if (!g_file_test(file_path, G_FILE_TEST_EXISTS)) {
     g_message("No JSON file was found! Creating a new one...");
-    g_object_unref(parser);
-    return 1;
+    return FALSE;
   }
 
   GError* error = NULL;
-  if (!json_parser_load_from_file(parser, file_path, &error)) {
-    g_warning("Error parsing JSON: %s", error->message);
+  if (!kanban_board_file_read(file_path, NULL, column_read, reading, cancellable, &error)) {
+    g_warning("Error loading board: %s", error->message);
     g_error_free(error);
-    g_object_unref(parser);
-    return 1;
   }
 
-  JsonNode* root = json_parser_get_root(parser);
-  if (!root || json_node_get_node_type(root) != JSON_NODE_OBJECT) {
-    g_warning("JSON root is not an object");
-    g_object_unref(parser);
-    return 1;
+  if (!reading->n_columns) {
+    g_message("No columns found in JSON");
+    return FALSE;
   }
 
-  JsonObject* object = json_node_get_object(root);
-  if (!object) {
-    g_warning("Failed to get JSON object from root node");
-    g_object_unref(parser);
-    return 1;
-  }
+  return TRUE;
+}
 
-  GList* objects = json_object_get_members(object);
-  if (!objects) {
-    g_message("No columns found in JSON");
-    g_object_unref(parser);
+int
+loadjson(KanbanWindow* self, const gchar* file_path)
+{
+  g_return_val_if_fail(KANBAN_IS_WINDOW(self), 1);
+  g_return_val_if_fail(file_path != NULL, 1);
+
+  KANBAN_TRACE_SCOPE("loadjson");
+
+  KanbanBoardRecord* board = read_board_file(file_path);
+  if (!board)
     return 1;
+
+  load_board(self, board);
+
+  kanban_board_record_free(board);
+  return 0;
+}
+
+typedef struct
+{
+  guint journal;
+  guint replayed;
+} LoadResult;
+
+/*
+ * Reads the board and replays the journal, away from the main thread.
+ * Without edits to replay, the window gets each column as it is read
+ * */
+static void
+read_board_thread(GTask* task, gpointer source_object, gpointer task_data,
+                  GCancellable* cancellable)
+{
+  BoardReading* reading   = task_data;
+  gchar*        dir_path  = g_build_filename(reading->home_dir, BoardDirName, NULL);
+  gchar*        file_path = g_build_filename(reading->home_dir, FileName, NULL);
+  LoadResult*   result    = g_new0(LoadResult, 1);
+  GError*       error     = NULL;
+
+  KANBAN_TRACE_BEGIN("read_board_thread");
+
+  /* Journals of former generations only linger after an interrupted
+   * save, holding the board back for them costs nothing else */
+  if (kanban_journal_has_entries(dir_path, 0))
+    reading->board = kanban_board_record_new();
+
+  /* The single file board is only read until the first sharded save */
+  if (!stream_board_dir(reading, dir_path, &result->journal, cancellable) &&
+      !stream_board_file(reading, file_path, cancellable)) {
+    for (const char** day = Weekdays; *day != NULL; day++)
+      column_read(kanban_column_record_new(*day), reading);
   }
 
-  for (GList* child = objects; child != NULL; child = child->next) {
-    const char* object_name = child->data;
-    if (!object_name) {
-      g_warning("Invalid column name in JSON");
-      continue;
-    }
+  if (reading->board) {
+    KanbanBoardRecord* board = g_steal_pointer(&reading->board);
 
-    KanbanColumn* column = KANBAN_COLUMN(create_column(self, object_name));
-    if (!column) {
-      g_warning("Failed to create column: %s", object_name);
-      continue;
+    /* Edits made after the last save, for instance before a crash */
+    board->journal = result->journal;
+    if (!kanban_journal_replay(dir_path, board, &result->replayed, &error)) {
+      g_warning("Failed to replay the journal: %s", error->message);
+      g_error_free(error);
     }
 
-    JsonNode* node = json_object_get_member(object, object_name);
-    if (node) {
-      create_cards_from_json(column, node);
+    for (guint i = 0; i < board->columns->len; i++)
+      g_async_queue_push(reading->columns, g_steal_pointer(&g_ptr_array_index(board->columns, i)));
+
+    g_ptr_array_set_size(board->columns, 0);
+    kanban_board_record_free(board);
+  }
+
+  g_free(dir_path);
+  g_free(file_path);
+
+  g_task_return_pointer(task, result, g_free);
+
+  KANBAN_TRACE_END("read_board_thread");
+  kanban_board_io_release();
+}
+
+/* Only the columns on screen, or about to be, have a widget. Walks the
+ * rows of the column strip from row, returns the next KanbanColumn */
+static KanbanColumn*
+next_shown_column(KanbanWindow* self, GtkWidget** row)
+{
+  *row = *row ? gtk_widget_get_next_sibling(*row)
+              : gtk_widget_get_first_child(GTK_WIDGET(self->ColumnsView));
+
+  for (; *row; *row = gtk_widget_get_next_sibling(*row)) {
+    GtkWidget* child = gtk_widget_get_first_child(*row);
+
+    if (child && KANBAN_IS_COLUMN(child))
+      return KANBAN_COLUMN(child);
+  }
+
+  return NULL;
+}
+
+static void
+column_loaded(KanbanWindow* self, guint index)
+{
+  KanbanColumnRecord* record = g_ptr_array_index(self->LoadBoard->columns, index);
+  KanbanColumnItem* item = g_ptr_array_index(self->LoadColumns, index);
+
+  if (!record->dirty)
+    kanban_column_item_clear_dirty(item);
+
+  GtkWidget* row = NULL;
+  KanbanColumn* column;
+
+  while ((column = next_shown_column(self, &row))) {
+    if (kanban_column_get_item(column) == item)
+      gtk_widget_set_sensitive(GTK_WIDGET(column), column_ready(self, item));
+  }
+}
+
+/*
+ * Puts the columns read so far on the board, empty and insensitive until
+ * their cards are in
+ * */
+static void
+take_read_columns(KanbanWindow* self)
+{
+  KanbanColumnRecord* record;
+
+  while ((record = g_async_queue_try_pop(self->LoadQueue))) {
+    guint index = self->LoadBoard->columns->len;
+    guint next = 0;
+    KanbanColumnItem* item = kanban_column_item_new(record->title);
+
+    if (record->shard)
+      kanban_column_item_set_shard(item, record->shard);
+
+    g_ptr_array_add(self->LoadBoard->columns, record);
+    g_array_append_val(self->LoadNext, next);
+    g_ptr_array_add(self->LoadColumns, item);
+    g_hash_table_insert(self->LoadIndex, item, GUINT_TO_POINTER(index + 1));
+    add_column(self, item);
+
+    if (record->cards->len == 0)
+      column_loaded(self, index);
+  }
+}
+
+/* Returns a column still loading that is on screen, or else the first
+ * one still loading, -1 once every column is complete */
+static gint
+next_loading_column(KanbanWindow* self)
+{
+  GtkWidget* row = NULL;
+  KanbanColumn* column;
+
+  while ((column = next_shown_column(self, &row))) {
+    KanbanColumnItem* item = kanban_column_get_item(column);
+
+    if (item && column_loading(self, item))
+      return GPOINTER_TO_UINT(g_hash_table_lookup(self->LoadIndex, item)) - 1;
+  }
+
+  for (guint i = 0; i < self->LoadColumns->len; i++) {
+    KanbanColumnRecord* record = g_ptr_array_index(self->LoadBoard->columns, i);
+
+    if (g_array_index(self->LoadNext, guint, i) < record->cards->len)
+      return i;
+  }
+
+  return -1;
+}
+
+static void
+finish_loading(KanbanWindow* self)
+{
+  g_clear_pointer(&self->LoadBoard, kanban_board_record_free);
+  g_clear_pointer(&self->LoadColumns, g_ptr_array_unref);
+  g_clear_pointer(&self->LoadNext, g_array_unref);
+  g_clear_pointer(&self->LoadIndex, g_hash_table_unref);
+  g_clear_pointer(&self->LoadQueue, g_async_queue_unref);
+  self->LoadTick = 0;
+  self->Loading  = FALSE;
+
+  KANBAN_TRACE_ASYNC_END("board load", GPOINTER_TO_SIZE(self));
+
+  /* Saves wait for the whole board to be there */
+  if (self->SaveQueued) {
+    gboolean notify = self->QueuedNotify;
+
+    self->SaveQueued   = FALSE;
+    self->QueuedNotify = FALSE;
+    save_board(self, notify);
+  }
+}
+
+/* Takes the columns read since the last frame, then builds cards until
+ * the frame budget is spent */
+static gboolean
+load_tick(GtkWidget* widget, GdkFrameClock* frame_clock, gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(widget);
+  gint64 deadline = g_get_monotonic_time() + LOAD_FRAME_BUDGET_US;
+
+  KANBAN_TRACE_SCOPE("load_tick");
+
+  take_read_columns(self);
+
+  gint index = next_loading_column(self);
+
+  while (index >= 0) {
+    KanbanColumnRecord* record = g_ptr_array_index(self->LoadBoard->columns, index);
+    KanbanColumnItem* column = g_ptr_array_index(self->LoadColumns, index);
+    guint* next = &g_array_index(self->LoadNext, guint, index);
+    /* Cards come decoded from the reading thread, or from a snapshot and
+     * are decoded once shown, see kanban-board-snapshot.h */
+    KanbanCardItem* card = kanban_card_item_new_take_record(g_ptr_array_index(record->cards, *next));
+
+    /* Cards restored from disk are not edits */
+    self->FillingColumn = column;
+    kanban_column_item_append(column, card);
+    self->FillingColumn = NULL;
+    g_object_unref(card);
+
+    KANBAN_TRACE_COUNT("cards loaded", 1);
+
+    if (++*next == record->cards->len) {
+      column_loaded(self, index);
+      index = next_loading_column(self);
     }
+
+    if (g_get_monotonic_time() >= deadline)
+      return G_SOURCE_CONTINUE;
   }
 
-  g_list_free(objects);
-  g_object_unref(parser);
-  return 0;
+  /* More columns are on their way */
+  if (!self->BoardRead)
+    return G_SOURCE_CONTINUE;
+
+  finish_loading(self);
+  return G_SOURCE_REMOVE;
+}
+
+/*
+ * Every column is on the board by now, the journal follows edits from
+ * here on and the columns whose cards are in become sensitive
+ * */
+static void
+board_read(GObject* source, GAsyncResult* res, gpointer user_data)
+{
+  KanbanWindow* self = KANBAN_WINDOW(source);
+  GError* error = NULL;
+  LoadResult* result = g_task_propagate_pointer(G_TASK(res), &error);
+
+  KANBAN_TRACE_SCOPE("board_read");
+
+  if (result == NULL) {
+    /* Cancelled, the window is gone */
+    g_error_free(error);
+    return;
+  }
+
+  /* Columns restored from disk are not edits */
+  take_read_columns(self);
+
+  gchar* dir_path = g_build_filename(g_get_home_dir(), BoardDirName, NULL);
+  self->JournalBase = result->journal;
+  self->Journal = kanban_journal_open(dir_path, result->journal, &error);
+  g_free(dir_path);
+
+  if (!self->Journal) {
+    g_warning("Failed to open the journal: %s", error->message);
+    g_error_free(error);
+  }
+
+  IsInitialized = TRUE;
+  self->BoardRead = TRUE;
+
+  /* The manifest may still list columns the journal removed */
+  if (result->replayed > 0)
+    kanban_board_model_mark_dirty(self->Board);
+
+  if (self->Journal && kanban_journal_get_size(self->Journal) > 0)
+    schedule_autosave(self);
+
+  GtkWidget* row = NULL;
+  KanbanColumn* column;
+
+  while ((column = next_shown_column(self, &row))) {
+    KanbanColumnItem* item = kanban_column_get_item(column);
+
+    if (item)
+      gtk_widget_set_sensitive(GTK_WIDGET(column), column_ready(self, item));
+  }
+
+  g_free(result);
 }
 
 static gboolean
@@ -349,14 +1219,7 @@ load_ui(KanbanWindow* self)
 {
   g_return_val_if_fail(KANBAN_IS_WINDOW(self), TRUE);
 
-  static const char* Weekdays[] = {
-    "Monday",
-    "Tuesday",
-    "Wednesday",
-    "Thursday",
-    "Friday",
-    NULL
-  };
+  KANBAN_TRACE_SCOPE("load_ui");
 
   /* Restore json */
   const gchar* home_dir = g_get_home_dir();
@@ -365,22 +1228,29 @@ load_ui(KanbanWindow* self)
     return TRUE;
   }
 
-  gchar* file_path = g_build_filename(home_dir, FileName, NULL);
-  if (!file_path) {
-    g_warning("Failed to build file path");
-    return TRUE;
-  }
+  KANBAN_TRACE_ASYNC_BEGIN("board load", GPOINTER_TO_SIZE(self));
 
-  if (loadjson(self, file_path)) {
-    for (const char** day = Weekdays; *day != NULL; day++) {
-      if (!create_column(self, *day)) {
-        g_warning("Failed to create column for %s", *day);
-      }
-    }
-  }
+  self->Loading = TRUE;
+  self->LoadCancellable = g_cancellable_new();
+  self->LoadQueue   = g_async_queue_new_full((GDestroyNotify)kanban_column_record_free);
+  self->LoadBoard   = kanban_board_record_new();
+  self->LoadColumns = g_ptr_array_new_with_free_func(g_object_unref);
+  self->LoadIndex   = g_hash_table_new(g_direct_hash, g_direct_equal);
+  self->LoadNext    = g_array_new(FALSE, TRUE, sizeof(guint));
+
+  BoardReading* reading = g_new0(BoardReading, 1);
+  reading->home_dir = g_strdup(home_dir);
+  reading->columns  = g_async_queue_ref(self->LoadQueue);
+
+  GTask* task = g_task_new(self, self->LoadCancellable, board_read, NULL);
+  g_task_set_task_data(task, reading, (GDestroyNotify)board_reading_free);
+  kanban_board_io_hold();
+  g_task_run_in_thread(task, read_board_thread);
+  g_object_unref(task);
+
+  /* Columns are put on the board as they are read */
+  self->LoadTick = gtk_widget_add_tick_callback(GTK_WIDGET(self), load_tick, NULL, NULL);
 
-  g_free(file_path);
-  IsInitialized = TRUE;
   return FALSE; /* Don't call again */
 }
 
@@ -391,6 +1261,24 @@ kanban_window_init(KanbanWindow *self)
 
   gtk_widget_init_template(GTK_WIDGET(self));
 
+  self->PendingCards = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                             g_object_unref, NULL);
+  self->SavingColumns = g_ptr_array_new_with_free_func(g_object_unref);
+  self->Board = kanban_board_model_new();
+  g_signal_connect_object(self->Board, "notify::dirty", G_CALLBACK(board_dirty_changed), self, 0);
+  board_dirty_changed(self->Board, NULL, self);
+
+  GtkListItemFactory* factory = gtk_signal_list_item_factory_new();
+  g_signal_connect(factory, "setup", G_CALLBACK(setup_column), self);
+  g_signal_connect(factory, "bind", G_CALLBACK(bind_column), self);
+  g_signal_connect(factory, "unbind", G_CALLBACK(unbind_column), self);
+  gtk_list_view_set_factory(self->ColumnsView, factory);
+  g_object_unref(factory);
+
+  GtkNoSelection* selection = gtk_no_selection_new(g_object_ref(G_LIST_MODEL(self->Board)));
+  gtk_list_view_set_model(self->ColumnsView, GTK_SELECTION_MODEL(selection));
+  g_object_unref(selection);
+
   if (!g_idle_add((GSourceFunc)load_ui, self)) {
     g_warning("Failed to add load_ui to idle queue");
   }
@@ -405,6 +1293,10 @@ kanban_window_init(KanbanWindow *self)
     return;
   }
 
+  self->Settings = g_object_ref(settings);
+  settings_changed(settings, NULL, self);
+  g_signal_connect_object(settings, "changed", G_CALLBACK(settings_changed), self, 0);
+
   g_settings_bind(settings, "width",
                   self, "default-width",
                   G_SETTINGS_BIND_DEFAULT);
@@ -29,9 +29,19 @@ G_BEGIN_DECLS
 gboolean
 save_cards(gpointer user_data);
 
+void
+discard_changes(gpointer user_data);
+
+void
+quit_after_save(gpointer user_data);
+
 G_DECLARE_FINAL_TYPE (KanbanWindow, kanban_window, KANBAN, WINDOW, AdwApplicationWindow)
 
-GtkWidget*
+void
 create_column(KanbanWindow* Window, const gchar* title);
 
+int
+loadjson(KanbanWindow* self, const gchar* file_path);
+
+
 G_END_DECLS
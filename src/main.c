@@ -22,20 +22,47 @@
 
 #include <glib/gi18n.h>
 #include "kanban-application.h"
+#include "utils/kanban-board-file.h"
+#include "utils/kanban-headless.h"
+#include "utils/kanban-trace.h"
 
 int
 main (int   argc,
       char *argv[])
 {
 	g_autoptr(KanbanApplication) app = NULL;
+	GError *error = NULL;
 	int ret;
 
 	bindtextdomain (GETTEXT_PACKAGE, LOCALEDIR);
 	bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 	textdomain (GETTEXT_PACKAGE);
 
-	app = kanban_application_new ("io.github.zhrexl.thisweekinmylife", 0);
-	ret = g_application_run (G_APPLICATION (app), argc, argv);
+	/* --trace takes over the file, see kanban-trace.h */
+	if (g_getenv (KANBAN_TRACE_ENV) != NULL)
+		kanban_trace_start (g_getenv (KANBAN_TRACE_ENV), 0);
+
+	/* Batch commands never bring up a display, see kanban-headless.h */
+	if (kanban_headless_requested (argc, argv))
+	{
+		ret = kanban_headless_run (argc, argv);
+	}
+	else
+	{
+		app = kanban_application_new ("io.github.zhrexl.thisweekinmylife", 0);
+		ret = g_application_run (G_APPLICATION (app), argc, argv);
+	}
+
+	/* Threads still reading or saving the board record into the trace,
+	 * which is only written once they are done */
+	g_clear_object (&app);
+	kanban_board_io_join ();
+
+	if (!kanban_trace_stop (&error))
+	{
+		g_printerr ("Failed to write the trace: %s\n", error->message);
+		g_error_free (error);
+	}
 
 	return ret;
 }
@@ -0,0 +1,1351 @@
+/* kanban-board-file.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "kanban-board-file.h"
+#include "kanban-board-reader.h"
+#include "kanban-board-snapshot.h"
+#include "kanban-card-decoder.h"
+#include "kanban-trace.h"
+
+KanbanCardRecord*
+kanban_card_record_new(const gchar* title, gboolean revealed,
+                       KanbanUnserializedContent* description)
+{
+  KanbanCardRecord* card = g_new0(KanbanCardRecord, 1);
+
+  card->id          = kanban_card_id_new();
+  card->title       = g_strdup(title ? title : "");
+  card->revealed    = revealed;
+  card->description = description ? description
+                                  : kanban_unserialized_content_new();
+
+  return card;
+}
+
+/* A card that only carries its encoded form, description is NULL */
+KanbanCardRecord*
+kanban_card_record_new_encoded(const gchar* title, gboolean revealed, GBytes* encoded)
+{
+  KanbanCardRecord* card = g_new0(KanbanCardRecord, 1);
+
+  card->id       = kanban_card_id_new();
+  card->title    = g_strdup(title ? title : "");
+  card->revealed = revealed;
+  card->encoded  = g_bytes_ref(encoded);
+
+  return card;
+}
+
+void
+kanban_card_record_free(KanbanCardRecord* card)
+{
+  if (card == NULL)
+    return;
+
+  g_free(card->title);
+  kanban_unserialized_content_free(card->description);
+  g_clear_pointer(&card->encoded, g_bytes_unref);
+  g_free(card);
+}
+
+/*
+ * Card ids are random, non-zero and fit in a JSON integer, so they can
+ * be made up without knowing the rest of the board
+ * */
+guint64
+kanban_card_id_new(void)
+{
+  guint64 id;
+
+  do
+    id = (((guint64)g_random_int() << 32) | g_random_int()) & G_MAXINT64;
+  while (id == 0);
+
+  return id;
+}
+
+KanbanColumnRecord*
+kanban_column_record_new(const gchar* title)
+{
+  KanbanColumnRecord* column = g_new0(KanbanColumnRecord, 1);
+
+  column->title = g_strdup(title ? title : "");
+  column->cards = g_ptr_array_new_with_free_func((GDestroyNotify)kanban_card_record_free);
+  column->dirty = TRUE;
+
+  return column;
+}
+
+void
+kanban_column_record_free(KanbanColumnRecord* column)
+{
+  if (column == NULL)
+    return;
+
+  g_free(column->title);
+  g_free(column->shard);
+  g_ptr_array_unref(column->cards);
+  g_free(column);
+}
+
+KanbanBoardRecord*
+kanban_board_record_new(void)
+{
+  KanbanBoardRecord* board = g_new0(KanbanBoardRecord, 1);
+
+  board->columns = g_ptr_array_new_with_free_func((GDestroyNotify)kanban_column_record_free);
+
+  return board;
+}
+
+void
+kanban_board_record_free(KanbanBoardRecord* board)
+{
+  if (board == NULL)
+    return;
+
+  g_ptr_array_unref(board->columns);
+  g_free(board);
+}
+
+/* Member accessors that tolerate missing members and wrong types */
+
+static JsonNode*
+get_value(JsonObject* object, const gchar* name)
+{
+  JsonNode* node = json_object_get_member(object, name);
+
+  return node && JSON_NODE_HOLDS_VALUE(node) ? node : NULL;
+}
+
+static const gchar*
+get_string(JsonObject* object, const gchar* name)
+{
+  JsonNode* node = get_value(object, name);
+
+  if (!node || json_node_get_value_type(node) != G_TYPE_STRING)
+    return NULL;
+
+  return json_node_get_string(node);
+}
+
+static gint64
+get_int(JsonObject* object, const gchar* name)
+{
+  JsonNode* node = get_value(object, name);
+
+  return node ? json_node_get_int(node) : 0;
+}
+
+/* Version 1 saved "revealed" as an integer */
+static gboolean
+get_boolean(JsonObject* object, const gchar* name)
+{
+  JsonNode* node = get_value(object, name);
+
+  return node ? json_node_get_boolean(node) : FALSE;
+}
+
+static JsonArray*
+get_array(JsonObject* object, const gchar* name)
+{
+  JsonNode* node = json_object_get_member(object, name);
+
+  return node && JSON_NODE_HOLDS_ARRAY(node) ? json_node_get_array(node) : NULL;
+}
+
+static JsonObject*
+get_object_element(JsonArray* array, guint index)
+{
+  JsonNode* node = json_array_get_element(array, index);
+
+  return JSON_NODE_HOLDS_OBJECT(node) ? json_node_get_object(node) : NULL;
+}
+
+/* Appends str as a JSON string, len may be -1 when str is nul-terminated */
+void
+kanban_json_append_string(GString* out, const gchar* str, gssize len)
+{
+  const gchar* end = str + (len < 0 ? (gssize)strlen(str) : len);
+  const gchar* run = str;
+
+  g_string_append_c(out, '"');
+
+  for (const gchar* p = str; p < end; p++)
+  {
+    guchar c = *p;
+
+    if (c != '"' && c != '\\' && c >= 0x20)
+      continue;
+
+    g_string_append_len(out, run, p - run);
+    run = p + 1;
+
+    switch (c)
+    {
+      case '"':  g_string_append(out, "\\\""); break;
+      case '\\': g_string_append(out, "\\\\"); break;
+      case '\n': g_string_append(out, "\\n");  break;
+      case '\r': g_string_append(out, "\\r");  break;
+      case '\t': g_string_append(out, "\\t");  break;
+      case '\b': g_string_append(out, "\\b");  break;
+      case '\f': g_string_append(out, "\\f");  break;
+      default:   g_string_append_printf(out, "\\u%04x", c); break;
+    }
+  }
+
+  g_string_append_len(out, run, end - run);
+  g_string_append_c(out, '"');
+}
+
+/*
+ * kanban_card_record_encode returns the card as a JSON object, the way
+ * it is written in the board file
+ *
+ * the user must unref the returned pointer with g_bytes_unref() */
+GBytes*
+kanban_card_record_encode(const KanbanCardRecord* card)
+{
+  GString* text    = card->description->text;
+  GArray*  anchors = card->description->anchors;
+  GString* out     = g_string_sized_new(text->len + 64 + anchors->len * 48);
+
+  g_string_append_printf(out, "{\"id\":%" G_GUINT64_FORMAT ",\"title\":", card->id);
+  kanban_json_append_string(out, card->title, -1);
+  g_string_append_printf(out, ",\"revealed\":%s,\"text\":",
+                         card->revealed ? "true" : "false");
+  kanban_json_append_string(out, text->str, text->len);
+  g_string_append(out, ",\"tasks\":[");
+
+  for (guint i = 0; i < anchors->len; i++)
+  {
+    KanbanAnchor* anchor = &g_array_index(anchors, KanbanAnchor, i);
+
+    g_string_append_printf(out, "%s{\"offset\":%u,\"title\":",
+                           i ? "," : "", anchor->offset);
+    kanban_json_append_string(out, anchor->title, -1);
+    g_string_append_printf(out, ",\"done\":%s}", anchor->done ? "true" : "false");
+  }
+
+  g_string_append(out, "]}");
+
+  return g_string_free_to_bytes(out);
+}
+
+/*
+ * kanban_card_encoded_set_revealed returns encoded with its "revealed"
+ * member set to revealed, the rest of the card is copied as it is.
+ * Returns NULL when encoded has no such member holding true or false.
+ *
+ * the user must unref the returned pointer with g_bytes_unref() */
+GBytes*
+kanban_card_encoded_set_revealed(GBytes* encoded, gboolean revealed)
+{
+  static const gchar key[] = "\"revealed\"";
+
+  gsize        size = 0;
+  const gchar* data = g_bytes_get_data(encoded, &size);
+  const gchar* end  = data + size;
+  const gchar* pos  = data;
+
+  /* Strings can't hold an unescaped quote, so the key is only matched
+   * as a member name, or as a string value which no colon follows */
+  while ((pos = g_strstr_len(pos, end - pos, key)) != NULL)
+  {
+    const gchar* value = pos + strlen(key);
+
+    while (value < end && g_ascii_isspace(*value))
+      value++;
+
+    if (value == end || *value != ':')
+    {
+      pos = value;
+      continue;
+    }
+
+    for (value++; value < end && g_ascii_isspace(*value); value++)
+      ;
+
+    gsize length;
+    if (end - value >= 4 && memcmp(value, "true", 4) == 0)
+      length = 4;
+    else if (end - value >= 5 && memcmp(value, "false", 5) == 0)
+      length = 5;
+    else
+      return NULL;
+
+    GByteArray* out = g_byte_array_sized_new(size + 1);
+    g_byte_array_append(out, (const guint8*)data, value - data);
+    g_byte_array_append(out, (const guint8*)(revealed ? "true" : "false"), revealed ? 4 : 5);
+    g_byte_array_append(out, (const guint8*)value + length, end - value - length);
+
+    return g_byte_array_free_to_bytes(out);
+  }
+
+  return NULL;
+}
+
+/* release it with kanban_card_record_free() */
+KanbanCardRecord*
+kanban_card_record_from_json(JsonObject* object)
+{
+  KanbanUnserializedContent* description = kanban_unserialized_content_new();
+  const gchar* text  = get_string(object, "text");
+  JsonArray*   tasks = get_array(object, "tasks");
+
+  if (text)
+    g_string_assign(description->text, text);
+
+  if (tasks)
+  {
+    /* Tasks are inserted in order, so offsets never go back nor past
+     * the end of the text */
+    guint text_chars = g_utf8_strlen(description->text->str,
+                                     description->text->len);
+    guint offset = 0;
+
+    for (guint i = 0; i < json_array_get_length(tasks); i++)
+    {
+      JsonObject* task = get_object_element(tasks, i);
+      if (!task)
+        continue;
+
+      const gchar* title = get_string(task, "title");
+      KanbanAnchor anchor;
+
+      offset = CLAMP(get_int(task, "offset"), offset, text_chars);
+
+      anchor.offset = offset;
+      anchor.title  = g_strdup(title ? title : "");
+      anchor.done   = get_boolean(task, "done");
+      g_array_append_val(description->anchors, anchor);
+    }
+  }
+
+  KanbanCardRecord* card = kanban_card_record_new(get_string(object, "title"),
+                                                  get_boolean(object, "revealed"),
+                                                  description);
+  gint64 id = get_int(object, "id");
+
+  /* Cards written before they had an id keep the one made up here */
+  if (id > 0)
+    card->id = id;
+
+  return card;
+}
+
+/*
+ * kanban_card_record_decode fills in the card from its encoded form,
+ * which it keeps. had_id tells whether the encoded card had an id of its
+ * own, parser can be reused from one card to the next
+ * */
+gboolean
+kanban_card_record_decode(KanbanCardRecord* card, JsonParser* parser, gboolean* had_id,
+                          GError** error)
+{
+  gsize        size = 0;
+  const gchar* data = g_bytes_get_data(card->encoded, &size);
+
+  if (!json_parser_load_from_data(parser, data, size, error))
+    return FALSE;
+
+  if (!JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser)))
+  {
+    g_set_error_literal(error, JSON_PARSER_ERROR, JSON_PARSER_ERROR_INVALID_DATA,
+                        "The card is not an object");
+    return FALSE;
+  }
+
+  JsonObject*       object  = json_node_get_object(json_parser_get_root(parser));
+  KanbanCardRecord* decoded = kanban_card_record_from_json(object);
+
+  if (had_id)
+    *had_id = get_int(object, "id") > 0;
+
+  g_free(card->title);
+  if (card->description)
+    kanban_unserialized_content_free(card->description);
+
+  card->id          = decoded->id;
+  card->title       = g_steal_pointer(&decoded->title);
+  card->revealed    = decoded->revealed;
+  card->description = g_steal_pointer(&decoded->description);
+  kanban_card_record_free(decoded);
+
+  return TRUE;
+}
+
+static KanbanColumnRecord*
+column_from_json(JsonObject* object)
+{
+  KanbanColumnRecord* column = kanban_column_record_new(get_string(object, "title"));
+  JsonArray*          cards  = get_array(object, "cards");
+
+  for (guint j = 0; cards && j < json_array_get_length(cards); j++)
+  {
+    JsonObject* card = get_object_element(cards, j);
+    if (!card)
+      continue;
+
+    g_ptr_array_add(column->cards, kanban_card_record_from_json(card));
+  }
+
+  return column;
+}
+
+static KanbanBoardRecord*
+board_from_json(JsonObject* root)
+{
+  KanbanBoardRecord* board   = kanban_board_record_new();
+  JsonArray*         columns = get_array(root, "columns");
+
+  for (guint i = 0; columns && i < json_array_get_length(columns); i++)
+  {
+    JsonObject* object = get_object_element(columns, i);
+    if (object)
+      g_ptr_array_add(board->columns, column_from_json(object));
+  }
+
+  return board;
+}
+
+/*
+ * Migrates a version 1 board, where columns and cards are object
+ * members keyed by title and tasks are embedded in the description
+ * */
+static KanbanBoardRecord*
+board_from_legacy_json(JsonObject* root)
+{
+  KanbanBoardRecord* board   = kanban_board_record_new();
+  GList*             columns = json_object_get_members(root);
+
+  for (GList* elem = columns; elem; elem = elem->next)
+  {
+    const gchar*        title  = elem->data;
+    JsonNode*           node   = json_object_get_member(root, title);
+    KanbanColumnRecord* column = kanban_column_record_new(title);
+
+    if (JSON_NODE_HOLDS_OBJECT(node))
+    {
+      JsonObject* object = json_node_get_object(node);
+      GList*      cards  = json_object_get_members(object);
+
+      for (GList* card = cards; card; card = card->next)
+      {
+        JsonNode* member = json_object_get_member(object, card->data);
+        if (!JSON_NODE_HOLDS_OBJECT(member))
+          continue;
+
+        JsonObject*  objmember   = json_node_get_object(member);
+        const gchar* description = get_string(objmember, "description");
+
+        g_ptr_array_add(column->cards,
+                        kanban_card_record_new(card->data,
+                                               get_boolean(objmember, "revealed"),
+                                               description ? get_unserialized_buffer(description)
+                                                           : NULL));
+      }
+
+      g_list_free(cards);
+    }
+
+    g_ptr_array_add(board->columns, column);
+  }
+
+  g_list_free(columns);
+
+  return board;
+}
+
+/*
+ * kanban_board_record_from_json reads a board of any known version,
+ * migrated is set when it had to be converted from an older layout */
+KanbanBoardRecord*
+kanban_board_record_from_json(JsonNode* root, gboolean* migrated, GError** error)
+{
+  if (migrated)
+    *migrated = FALSE;
+
+  if (!root || !JSON_NODE_HOLDS_OBJECT(root))
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "Board root is not an object");
+    return NULL;
+  }
+
+  JsonObject* object  = json_node_get_object(root);
+  JsonNode*   version = get_value(object, "version");
+
+  if (version == NULL)
+  {
+    if (migrated)
+      *migrated = TRUE;
+    return board_from_legacy_json(object);
+  }
+
+  if (json_node_get_int(version) > KANBAN_BOARD_FILE_VERSION)
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "Board format version %" G_GINT64_FORMAT " is newer than this release supports",
+                json_node_get_int(version));
+    return NULL;
+  }
+
+  return board_from_json(object);
+}
+
+/*
+ * Board files are encoded straight into a GOutputStream. Small pieces
+ * gather in buffer, encoded cards are written as they are, so besides
+ * the records only one card is held at a time. The first error stops
+ * all writes and is kept in error.
+ * */
+typedef struct
+{
+  GOutputStream* stream;
+  GCancellable*  cancellable;
+  GString*       buffer;
+  GError*        error;
+} JsonStream;
+
+#define JSON_STREAM_BUFFER_SIZE 16384
+
+static void
+json_stream_flush(JsonStream* js)
+{
+  if (js->error == NULL && js->buffer->len > 0)
+  {
+    g_output_stream_write_all(js->stream, js->buffer->str, js->buffer->len, NULL,
+                              js->cancellable, &js->error);
+    KANBAN_TRACE_COUNT("bytes serialized", js->buffer->len);
+  }
+
+  g_string_truncate(js->buffer, 0);
+}
+
+static void
+json_stream_write(JsonStream* js, const gchar* data, gsize size)
+{
+  if (js->buffer->len + size > JSON_STREAM_BUFFER_SIZE)
+  {
+    json_stream_flush(js);
+
+    if (size > JSON_STREAM_BUFFER_SIZE)
+    {
+      if (js->error == NULL)
+      {
+        g_output_stream_write_all(js->stream, data, size, NULL, js->cancellable,
+                                  &js->error);
+        KANBAN_TRACE_COUNT("bytes serialized", size);
+      }
+      return;
+    }
+  }
+
+  g_string_append_len(js->buffer, data, size);
+}
+
+/* Writes the title and cards of a column, without the braces */
+static void
+write_column_members(JsonStream* js, const KanbanColumnRecord* column)
+{
+  g_string_append(js->buffer, "\"title\":");
+  kanban_json_append_string(js->buffer, column->title, -1);
+  g_string_append(js->buffer, ",\"cards\":[");
+
+  for (guint j = 0; j < column->cards->len && js->error == NULL; j++)
+  {
+    KanbanCardRecord* card = g_ptr_array_index(column->cards, j);
+    GBytes* bytes = card->encoded ? g_bytes_ref(card->encoded)
+                                  : kanban_card_record_encode(card);
+    gsize   size  = 0;
+    const gchar* data = g_bytes_get_data(bytes, &size);
+
+    if (j)
+      json_stream_write(js, ",", 1);
+    json_stream_write(js, data, size);
+
+    g_bytes_unref(bytes);
+  }
+
+  json_stream_write(js, "]", 1);
+}
+
+static void
+write_board(JsonStream* js, gconstpointer data)
+{
+  const KanbanBoardRecord* board = data;
+
+  g_string_append_printf(js->buffer, "{\"version\":%d,\"columns\":[",
+                         KANBAN_BOARD_FILE_VERSION);
+
+  for (guint i = 0; i < board->columns->len && js->error == NULL; i++)
+  {
+    json_stream_write(js, i ? ",{" : "{", i ? 2 : 1);
+    write_column_members(js, g_ptr_array_index(board->columns, i));
+    json_stream_write(js, "}", 1);
+  }
+
+  json_stream_write(js, "]}", 2);
+}
+
+static void
+write_shard(JsonStream* js, gconstpointer data)
+{
+  g_string_append_printf(js->buffer, "{\"version\":%d,", KANBAN_BOARD_FILE_VERSION);
+  write_column_members(js, data);
+  json_stream_write(js, "}", 1);
+}
+
+typedef void (*JsonWriteFunc)(JsonStream* js, gconstpointer data);
+
+static gboolean
+write_stream(GOutputStream* stream, JsonWriteFunc func, gconstpointer data,
+             GCancellable* cancellable, GError** error)
+{
+  JsonStream js = {
+    .stream      = stream,
+    .cancellable = cancellable,
+    .buffer      = g_string_sized_new(JSON_STREAM_BUFFER_SIZE),
+  };
+
+  func(&js, data);
+  json_stream_flush(&js);
+  g_string_free(js.buffer, TRUE);
+
+  if (js.error)
+  {
+    g_propagate_error(error, js.error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*
+ * Replaces the file at path with what func writes, through a temporary
+ * file renamed on close. On failure the close is cancelled, which leaves
+ * the old file in place.
+ * */
+static gboolean
+write_file(const gchar* path, JsonWriteFunc func, gconstpointer data, GError** error)
+{
+  GFile* file = g_file_new_for_path(path);
+  GFileOutputStream* stream = g_file_replace(file, NULL, FALSE, G_FILE_CREATE_NONE,
+                                             NULL, error);
+  gboolean success = stream != NULL;
+
+  if (success)
+  {
+    GCancellable* cancellable = g_cancellable_new();
+
+    success = write_stream(G_OUTPUT_STREAM(stream), func, data, NULL, error);
+
+    if (!success)
+      g_cancellable_cancel(cancellable);
+
+    if (!g_output_stream_close(G_OUTPUT_STREAM(stream), cancellable, success ? error : NULL))
+      success = FALSE;
+
+    g_object_unref(cancellable);
+    g_object_unref(stream);
+  }
+
+  g_object_unref(file);
+  return success;
+}
+
+/*
+ * kanban_board_record_write writes the board file contents to stream as
+ * they are encoded, cards that carry their encoded form are copied as
+ * they are. The stream is left open.
+ * */
+gboolean
+kanban_board_record_write(const KanbanBoardRecord* board, GOutputStream* stream,
+                          GCancellable* cancellable, GError** error)
+{
+  return write_stream(stream, write_board, board, cancellable, error);
+}
+
+/*
+ * kanban_board_record_to_data returns the board file contents, see
+ * kanban_board_record_write()
+ *
+ * the user must release the returned pointer with g_free() */
+gchar*
+kanban_board_record_to_data(const KanbanBoardRecord* board, gsize* length)
+{
+  GOutputStream* stream = g_memory_output_stream_new_resizable();
+
+  /* Writing to memory can't fail */
+  kanban_board_record_write(board, stream, NULL, NULL);
+  g_output_stream_write_all(stream, "", 1, NULL, NULL, NULL);
+  g_output_stream_close(stream, NULL, NULL);
+
+  if (length)
+    *length = g_memory_output_stream_get_data_size(G_MEMORY_OUTPUT_STREAM(stream)) - 1;
+
+  gchar* data = g_memory_output_stream_steal_data(G_MEMORY_OUTPUT_STREAM(stream));
+  g_object_unref(stream);
+
+  return data;
+}
+
+gboolean
+kanban_board_file_save(const KanbanBoardRecord* board, const gchar* file_path,
+                       GError** error)
+{
+  return write_file(file_path, write_board, board, error);
+}
+
+/* Older releases can't read the new layout, keep their file next to it */
+static void
+migrate_file(const KanbanBoardRecord* board, const gchar* file_path)
+{
+  GError* error  = NULL;
+  gchar*  backup = g_strconcat(file_path, ".v1", NULL);
+
+  if (g_rename(file_path, backup) != 0)
+  {
+    g_warning("Failed to back up %s before migrating it: %s",
+              file_path, g_strerror(errno));
+    g_free(backup);
+    return;
+  }
+
+  if (!kanban_board_file_save(board, file_path, &error))
+  {
+    g_warning("Failed to migrate %s: %s", file_path, error->message);
+    g_error_free(error);
+    g_rename(backup, file_path);
+  }
+  else
+    g_message("Migrated %s to board format version %d, the old file was kept as %s",
+              file_path, KANBAN_BOARD_FILE_VERSION, backup);
+
+  g_free(backup);
+}
+
+/* Version 1 boards are migrated from a JSON tree, they predate files
+ * large enough for it to matter */
+static gboolean
+read_legacy_file(const gchar* file_path, gboolean* migrated, KanbanColumnReadFunc func,
+                 gpointer user_data, GError** error)
+{
+  JsonParser* parser = json_parser_new();
+
+  if (!json_parser_load_from_file(parser, file_path, error))
+  {
+    g_object_unref(parser);
+    return FALSE;
+  }
+
+  KanbanBoardRecord* board = kanban_board_record_from_json(json_parser_get_root(parser),
+                                                           migrated, error);
+  g_object_unref(parser);
+
+  if (board == NULL)
+    return FALSE;
+
+  for (guint i = 0; i < board->columns->len; i++)
+    func(g_steal_pointer(&g_ptr_array_index(board->columns, i)), user_data);
+
+  g_ptr_array_set_size(board->columns, 0);
+  kanban_board_record_free(board);
+
+  return TRUE;
+}
+
+/*
+ * kanban_board_file_read hands the columns of the board saved at
+ * file_path to func as they are read, func takes ownership of them.
+ * migrated is set when the file is in an older layout. Their cards are
+ * decoded on a thread pool, func is called from the calling thread.
+ *
+ * Columns read before an error are kept by func, the error is returned
+ * once the file can't be read further */
+gboolean
+kanban_board_file_read(const gchar* file_path, gboolean* migrated,
+                       KanbanColumnReadFunc func, gpointer user_data,
+                       GCancellable* cancellable, GError** error)
+{
+  KANBAN_TRACE_SCOPE("kanban_board_file_read");
+
+  GFile*            file   = g_file_new_for_path(file_path);
+  GFileInputStream* stream = g_file_read(file, cancellable, error);
+  GError*           local_error = NULL;
+
+  if (migrated)
+    *migrated = FALSE;
+
+  g_object_unref(file);
+
+  if (stream == NULL)
+    return FALSE;
+
+  KanbanBoardReader*  reader  = kanban_board_reader_new(G_INPUT_STREAM(stream));
+  KanbanCardDecoder*  decoder = kanban_card_decoder_new(func, user_data);
+  KanbanColumnRecord* column;
+
+  /* Cards are decoded while the next columns are read */
+  kanban_board_reader_set_keep_encoded(reader, TRUE);
+
+  while ((column = kanban_board_reader_next_column(reader, NULL, cancellable, &local_error)))
+    kanban_card_decoder_push(column, decoder);
+
+  gboolean legacy = kanban_board_reader_is_legacy(reader);
+
+  kanban_card_decoder_finish(decoder);
+  kanban_board_reader_free(reader);
+  g_object_unref(stream);
+
+  if (local_error)
+  {
+    g_propagate_error(error, local_error);
+    return FALSE;
+  }
+
+  if (legacy)
+    return read_legacy_file(file_path, migrated, func, user_data, error);
+
+  return TRUE;
+}
+
+static void
+collect_column(KanbanColumnRecord* column, gpointer user_data)
+{
+  KanbanBoardRecord* board = user_data;
+
+  g_ptr_array_add(board->columns, column);
+}
+
+/*
+ * kanban_board_file_load reads the board saved at file_path, a version 1
+ * file is rewritten in the current layout the first time it is loaded
+ *
+ * release it with kanban_board_record_free() */
+KanbanBoardRecord*
+kanban_board_file_load(const gchar* file_path, GError** error)
+{
+  KanbanBoardRecord* board    = kanban_board_record_new();
+  gboolean           migrated = FALSE;
+
+  if (!kanban_board_file_read(file_path, &migrated, collect_column, board, NULL, error))
+  {
+    kanban_board_record_free(board);
+    return NULL;
+  }
+
+  if (migrated)
+    migrate_file(board, file_path);
+
+  return board;
+}
+
+/*
+ * Sharded boards are a directory holding one file per column plus a
+ * manifest listing them in order:
+ *
+ * manifest.json        { "version": 2, "journal": 1,
+ *                        "shards": [ "column-<uuid>.json" ] }
+ * column-<uuid>.json   { "version": 2, "title": "...", "cards": [ ... ] }
+ *
+ * Every file is replaced atomically, the manifest is written last. Each
+ * shard is shadowed by a snapshot, see kanban-board-snapshot.h.
+ * */
+
+static gboolean
+is_shard_name(const gchar* name)
+{
+  return g_str_has_prefix(name, KANBAN_BOARD_SHARD_PREFIX) &&
+         g_str_has_suffix(name, ".json") &&
+         strchr(name, G_DIR_SEPARATOR) == NULL;
+}
+
+/* Whether name is the snapshot of a shard not in shards */
+static gboolean
+is_stale_snapshot(const gchar* name, GHashTable* shards)
+{
+  if (!g_str_has_prefix(name, KANBAN_BOARD_SHARD_PREFIX) ||
+      !g_str_has_suffix(name, KANBAN_BOARD_SNAPSHOT_SUFFIX) ||
+      strchr(name, G_DIR_SEPARATOR) != NULL)
+    return FALSE;
+
+  gchar*   base  = g_strndup(name, strlen(name) - strlen(KANBAN_BOARD_SNAPSHOT_SUFFIX));
+  gchar*   shard = g_strconcat(base, ".json", NULL);
+  gboolean stale = !g_hash_table_contains(shards, shard);
+
+  g_free(shard);
+  g_free(base);
+  return stale;
+}
+
+static void
+remove_stale_shards(const gchar* dir_path, GHashTable* shards)
+{
+  GDir* dir = g_dir_open(dir_path, 0, NULL);
+  const gchar* name;
+
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name(dir)) != NULL)
+  {
+    if (is_shard_name(name) ? g_hash_table_contains(shards, name)
+                            : !is_stale_snapshot(name, shards))
+      continue;
+
+    gchar* path = g_build_filename(dir_path, name, NULL);
+    if (g_unlink(path) != 0)
+      g_warning("Failed to remove %s: %s", path, g_strerror(errno));
+    g_free(path);
+  }
+
+  g_dir_close(dir);
+}
+
+/* Returns a new shard name, release it with g_free() */
+gchar*
+kanban_board_shard_new_name(void)
+{
+  gchar* uuid = g_uuid_string_random();
+  gchar* name = g_strconcat(KANBAN_BOARD_SHARD_PREFIX, uuid, ".json", NULL);
+
+  g_free(uuid);
+  return name;
+}
+
+/*
+ * kanban_board_dir_save streams the columns marked dirty to their shards
+ * and writes the manifest, shards no longer listed are removed afterwards.
+ *
+ * A shard is never written over: a dirty column whose shard exists gets a
+ * new name, set in its record. Until the manifest is replaced it lists
+ * the shards as they were, which its journal generation replays onto
+ * even when the save is cut short. */
+gboolean
+kanban_board_dir_save(KanbanBoardRecord* board, const gchar* dir_path,
+                      GError** error)
+{
+  KANBAN_TRACE_SCOPE("kanban_board_dir_save");
+
+  if (g_mkdir_with_parents(dir_path, 0700) != 0)
+  {
+    int saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "Failed to create %s: %s", dir_path, g_strerror(saved_errno));
+    return FALSE;
+  }
+
+  GHashTable* shards   = g_hash_table_new(g_str_hash, g_str_equal);
+  GString*    manifest = g_string_new(NULL);
+  gboolean    success  = TRUE;
+
+  g_string_append_printf(manifest, "{\"version\":%d,\"journal\":%u,\"shards\":[",
+                         KANBAN_BOARD_FILE_VERSION, board->journal);
+
+  for (guint i = 0; i < board->columns->len && success; i++)
+  {
+    KanbanColumnRecord* column = g_ptr_array_index(board->columns, i);
+
+    if (column->shard == NULL || !is_shard_name(column->shard))
+    {
+      g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                  "Column \"%s\" has no valid shard name", column->title);
+      success = FALSE;
+      break;
+    }
+
+    if (column->dirty)
+    {
+      gchar*  path = g_build_filename(dir_path, column->shard, NULL);
+      GError* snapshot_error = NULL;
+
+      if (g_file_test(path, G_FILE_TEST_EXISTS))
+      {
+        g_free(column->shard);
+        column->shard = kanban_board_shard_new_name();
+
+        g_free(path);
+        path = g_build_filename(dir_path, column->shard, NULL);
+      }
+
+      success = write_file(path, write_shard, column, error);
+
+      /* The shard is read instead of a missing snapshot */
+      if (success && !kanban_board_snapshot_write(column, path, &snapshot_error))
+      {
+        g_warning("Failed to write the snapshot of %s: %s", path, snapshot_error->message);
+        g_error_free(snapshot_error);
+      }
+
+      g_free(path);
+    }
+
+    if (i)
+      g_string_append_c(manifest, ',');
+    kanban_json_append_string(manifest, column->shard, -1);
+    g_hash_table_add(shards, column->shard);
+  }
+
+  g_string_append(manifest, "]}");
+
+  if (success)
+  {
+    gchar* path = g_build_filename(dir_path, KANBAN_BOARD_MANIFEST, NULL);
+    success = g_file_set_contents(path, manifest->str, manifest->len, error);
+    g_free(path);
+  }
+
+  if (success)
+    remove_stale_shards(dir_path, shards);
+
+  g_string_free(manifest, TRUE);
+  g_hash_table_unref(shards);
+
+  return success;
+}
+
+static JsonObject*
+load_object(JsonParser* parser, const gchar* path, GError** error)
+{
+  if (!json_parser_load_from_file(parser, path, error))
+    return NULL;
+
+  JsonNode* root = json_parser_get_root(parser);
+  if (!root || !JSON_NODE_HOLDS_OBJECT(root))
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s is not a JSON object", path);
+    return NULL;
+  }
+
+  JsonObject* object = json_node_get_object(root);
+  if (get_int(object, "version") > KANBAN_BOARD_FILE_VERSION)
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "%s was written by a newer release", path);
+    return NULL;
+  }
+
+  return object;
+}
+
+/* Reads the one column of a shard, its cards left encoded */
+static KanbanColumnRecord*
+read_shard(const gchar* path, GCancellable* cancellable, GError** error)
+{
+  GFile*              file   = g_file_new_for_path(path);
+  GFileInputStream*   stream = g_file_read(file, cancellable, error);
+  KanbanColumnRecord* column = NULL;
+
+  g_object_unref(file);
+
+  if (stream == NULL)
+    return NULL;
+
+  KanbanBoardReader* reader = kanban_board_reader_new(G_INPUT_STREAM(stream));
+  GError*            local_error = NULL;
+
+  kanban_board_reader_set_keep_encoded(reader, TRUE);
+  column = kanban_board_reader_next_column(reader, NULL, cancellable, &local_error);
+
+  if (column == NULL && local_error == NULL)
+    g_set_error(&local_error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                "%s holds no column", path);
+
+  kanban_board_reader_free(reader);
+  g_object_unref(stream);
+
+  if (local_error)
+  {
+    g_propagate_error(error, local_error);
+    return NULL;
+  }
+
+  /* Unless ids have to be made up for its cards, see kanban-card-decoder.h */
+  column->dirty = FALSE;
+  return column;
+}
+
+/* Shards read without an up to date snapshot get one once their cards
+ * are decoded */
+typedef struct
+{
+  const gchar*         dir_path;
+  gboolean             read_only;
+  GHashTable*          unsnapped;  /* KanbanColumnRecord, not owned */
+  KanbanColumnReadFunc func;
+  gpointer             user_data;
+} DirReading;
+
+static void
+shard_decoded(KanbanColumnRecord* column, gpointer user_data)
+{
+  DirReading* reading = user_data;
+
+  /* Cards given an id are written by the next save, and so is the snapshot */
+  if (g_hash_table_remove(reading->unsnapped, column) && !column->dirty &&
+      !reading->read_only)
+  {
+    gchar*  path  = g_build_filename(reading->dir_path, column->shard, NULL);
+    GError* error = NULL;
+
+    if (!kanban_board_snapshot_write(column, path, &error))
+    {
+      g_debug("Failed to write the snapshot of %s: %s", path, error->message);
+      g_error_free(error);
+    }
+
+    g_free(path);
+  }
+
+  reading->func(column, reading->user_data);
+}
+
+/*
+ * kanban_board_dir_read hands the columns of a sharded board to func as
+ * each shard is read, func takes ownership of them. They come with their
+ * shard name and marked clean, unless some of their cards had no id yet.
+ *
+ * Shards with an up to date snapshot are read from it, their cards only
+ * carry their encoded form then. The cards of the others are decoded on
+ * a thread pool while the next shards are read.
+ *
+ * journal is set from the manifest before the first column is read. A
+ * shard that can't be read is left out with a warning. With read_only,
+ * nothing is written to dir_path, snapshots included */
+gboolean
+kanban_board_dir_read(const gchar* dir_path, gboolean read_only, guint* journal,
+                      KanbanColumnReadFunc func, gpointer user_data,
+                      GCancellable* cancellable, GError** error)
+{
+  KANBAN_TRACE_SCOPE("kanban_board_dir_read");
+
+  JsonParser* parser   = json_parser_new();
+  gchar*      path     = g_build_filename(dir_path, KANBAN_BOARD_MANIFEST, NULL);
+  JsonObject* manifest = load_object(parser, path, error);
+  gboolean    success  = TRUE;
+
+  g_free(path);
+
+  if (manifest == NULL)
+  {
+    g_object_unref(parser);
+    return FALSE;
+  }
+
+  DirReading reading = {
+    .dir_path  = dir_path,
+    .read_only = read_only,
+    .unsnapped = g_hash_table_new(NULL, NULL),
+    .func      = func,
+    .user_data = user_data,
+  };
+
+  JsonArray*         shards  = get_array(manifest, "shards");
+  KanbanCardDecoder* decoder = kanban_card_decoder_new(shard_decoded, &reading);
+
+  if (journal)
+    *journal = CLAMP(get_int(manifest, "journal"), 0, G_MAXUINT);
+
+  for (guint i = 0; shards && i < json_array_get_length(shards); i++)
+  {
+    JsonNode*    node = json_array_get_element(shards, i);
+    const gchar* name = JSON_NODE_HOLDS_VALUE(node) ? json_node_get_string(node) : NULL;
+    GError*      shard_error = NULL;
+
+    if (g_cancellable_set_error_if_cancelled(cancellable, error))
+    {
+      success = FALSE;
+      break;
+    }
+
+    if (name == NULL || !is_shard_name(name))
+    {
+      g_warning("Invalid shard name in %s", dir_path);
+      continue;
+    }
+
+    path = g_build_filename(dir_path, name, NULL);
+    KanbanColumnRecord* column = kanban_board_snapshot_read(path, &shard_error);
+
+    if (column)
+    {
+      KANBAN_TRACE_COUNT("snapshots mapped", 1);
+
+      column->shard = g_strdup(name);
+      kanban_card_decoder_push_ready(column, decoder);
+      g_free(path);
+      continue;
+    }
+
+    if (!g_error_matches(shard_error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+      g_debug("Reading %s instead of its snapshot: %s", path, shard_error->message);
+    g_clear_error(&shard_error);
+
+    KANBAN_TRACE_COUNT("shards parsed", 1);
+    column = read_shard(path, cancellable, &shard_error);
+
+    if (column == NULL)
+    {
+      g_warning("Failed to load column from %s: %s", path, shard_error->message);
+      g_error_free(shard_error);
+      g_free(path);
+      continue;
+    }
+
+    column->shard = g_strdup(name);
+    g_hash_table_add(reading.unsnapped, column);
+    kanban_card_decoder_push(column, decoder);
+
+    g_free(path);
+  }
+
+  kanban_card_decoder_finish(decoder);
+  g_hash_table_unref(reading.unsnapped);
+  g_object_unref(parser);
+
+  return success;
+}
+
+/*
+ * kanban_board_dir_load reassembles a sharded board, see
+ * kanban_board_dir_read()
+ *
+ * release it with kanban_board_record_free() */
+KanbanBoardRecord*
+kanban_board_dir_load(const gchar* dir_path, GError** error)
+{
+  KanbanBoardRecord* board = kanban_board_record_new();
+
+  if (!kanban_board_dir_read(dir_path, FALSE, &board->journal, collect_column, board, NULL,
+                             error))
+  {
+    kanban_board_record_free(board);
+    return NULL;
+  }
+
+  return board;
+}
+
+/* Worker threads reading or writing a board, see kanban_board_io_hold() */
+static struct
+{
+  GMutex mutex;
+  GCond  cond;
+  gint   threads;
+} board_io;
+
+/*
+ * kanban_board_io_hold counts a worker thread about to read or write a
+ * board, which calls kanban_board_io_release() once it is done with it.
+ * kanban_board_io_join waits for all of them, for the process to exit
+ * with no thread still recording or writing.
+ * */
+void
+kanban_board_io_hold(void)
+{
+  g_mutex_lock(&board_io.mutex);
+  board_io.threads++;
+  g_mutex_unlock(&board_io.mutex);
+}
+
+void
+kanban_board_io_release(void)
+{
+  g_mutex_lock(&board_io.mutex);
+  if (--board_io.threads == 0)
+    g_cond_broadcast(&board_io.cond);
+  g_mutex_unlock(&board_io.mutex);
+}
+
+void
+kanban_board_io_join(void)
+{
+  g_mutex_lock(&board_io.mutex);
+  while (board_io.threads > 0)
+    g_cond_wait(&board_io.cond, &board_io.mutex);
+  g_mutex_unlock(&board_io.mutex);
+}
+
+typedef struct
+{
+  KanbanBoardRecord* board;
+  gchar*             dir_path;
+} SaveData;
+
+static void
+save_data_free(SaveData* data)
+{
+  kanban_board_record_free(data->board);
+  g_free(data->dir_path);
+  g_free(data);
+}
+
+static void
+save_thread(GTask* task, gpointer source_object, gpointer task_data,
+            GCancellable* cancellable)
+{
+  SaveData* data  = task_data;
+  GError*   error = NULL;
+
+  if (kanban_board_dir_save(data->board, data->dir_path, &error))
+    g_task_return_boolean(task, TRUE);
+  else
+    g_task_return_error(task, error);
+
+  kanban_board_io_release();
+}
+
+/*
+ * kanban_board_dir_save_async encodes and writes board in a worker
+ * thread, taking ownership of it. Cards should carry their encoded form
+ * already, the records must not be shared with the caller.
+ * */
+void
+kanban_board_dir_save_async(KanbanBoardRecord* board, const gchar* dir_path,
+                            GCancellable* cancellable, GAsyncReadyCallback callback,
+                            gpointer user_data)
+{
+  GTask*    task = g_task_new(NULL, cancellable, callback, user_data);
+  SaveData* data = g_new0(SaveData, 1);
+
+  data->board    = board;
+  data->dir_path = g_strdup(dir_path);
+
+  g_task_set_source_tag(task, kanban_board_dir_save_async);
+  g_task_set_task_data(task, data, (GDestroyNotify)save_data_free);
+  kanban_board_io_hold();
+  g_task_run_in_thread(task, save_thread);
+  g_object_unref(task);
+}
+
+gboolean
+kanban_board_dir_save_finish(GAsyncResult* result, GError** error)
+{
+  g_return_val_if_fail(g_task_is_valid(result, NULL), FALSE);
+
+  return g_task_propagate_boolean(G_TASK(result), error);
+}
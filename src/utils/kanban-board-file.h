@@ -0,0 +1,180 @@
+/* kanban-board-file.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <json-glib/json-glib.h>
+
+#include "kanban-serializer.h"
+
+/*
+ * Board file layout, version 2:
+ *
+ * { "version": 2,
+ *   "columns": [ { "title": "Monday",
+ *                  "cards": [ { "id": 1234, "title": "...", "revealed": false,
+ *                               "text": "...",
+ *                               "tasks": [ { "offset": 0, "title": "...",
+ *                                            "done": true } ] } ] } ] }
+ *
+ * Version 1 files, where each card had its tasks embedded in a
+ * "description" string, are migrated when loaded. Cards written before
+ * they had an id get one when loaded.
+ * */
+#define KANBAN_BOARD_FILE_VERSION 2
+
+#define KANBAN_BOARD_MANIFEST     "manifest.json"
+#define KANBAN_BOARD_SHARD_PREFIX "column-"
+
+/*
+ * id identifies the card for as long as it exists, whatever its title
+ * or position. encoded is the card as written in the board file, when it
+ * is set the writer copies it as is and description may be NULL
+ * */
+typedef struct
+{
+  guint64                    id;
+  gchar*                     title;
+  gboolean                   revealed;
+  KanbanUnserializedContent* description;
+  GBytes*                    encoded;
+} KanbanCardRecord;
+
+/*
+ * shard is the file the column is kept in within a sharded board, dirty
+ * tells whether that file has to be written again
+ * */
+typedef struct
+{
+  gchar*     title;
+  GPtrArray* cards;    /* KanbanCardRecord */
+  gchar*     shard;
+  gboolean   dirty;
+} KanbanColumnRecord;
+
+/*
+ * journal is the first journal generation whose edits are not part of
+ * the board, see kanban-journal.h
+ * */
+typedef struct
+{
+  GPtrArray* columns;  /* KanbanColumnRecord */
+  guint      journal;
+} KanbanBoardRecord;
+
+/* Takes ownership of description */
+KanbanCardRecord*
+kanban_card_record_new(const gchar* title, gboolean revealed,
+                       KanbanUnserializedContent* description);
+
+/* Adds a reference to encoded */
+KanbanCardRecord*
+kanban_card_record_new_encoded(const gchar* title, gboolean revealed, GBytes* encoded);
+
+void
+kanban_card_record_free(KanbanCardRecord* card);
+
+guint64
+kanban_card_id_new(void);
+
+KanbanColumnRecord*
+kanban_column_record_new(const gchar* title);
+
+void
+kanban_column_record_free(KanbanColumnRecord* column);
+
+KanbanBoardRecord*
+kanban_board_record_new(void);
+
+void
+kanban_board_record_free(KanbanBoardRecord* board);
+
+GBytes*
+kanban_card_record_encode(const KanbanCardRecord* card);
+
+GBytes*
+kanban_card_encoded_set_revealed(GBytes* encoded, gboolean revealed);
+
+KanbanCardRecord*
+kanban_card_record_from_json(JsonObject* object);
+
+gboolean
+kanban_card_record_decode(KanbanCardRecord* card, JsonParser* parser, gboolean* had_id,
+                          GError** error);
+
+void
+kanban_json_append_string(GString* out, const gchar* str, gssize len);
+
+KanbanBoardRecord*
+kanban_board_record_from_json(JsonNode* root, gboolean* migrated, GError** error);
+
+gboolean
+kanban_board_record_write(const KanbanBoardRecord* board, GOutputStream* stream,
+                          GCancellable* cancellable, GError** error);
+
+gchar*
+kanban_board_record_to_data(const KanbanBoardRecord* board, gsize* length);
+
+gboolean
+kanban_board_file_save(const KanbanBoardRecord* board, const gchar* file_path,
+                       GError** error);
+
+/* Takes ownership of column */
+typedef void (*KanbanColumnReadFunc)(KanbanColumnRecord* column, gpointer user_data);
+
+gboolean
+kanban_board_file_read(const gchar* file_path, gboolean* migrated,
+                       KanbanColumnReadFunc func, gpointer user_data,
+                       GCancellable* cancellable, GError** error);
+
+KanbanBoardRecord*
+kanban_board_file_load(const gchar* file_path, GError** error);
+
+gchar*
+kanban_board_shard_new_name(void);
+
+gboolean
+kanban_board_dir_save(KanbanBoardRecord* board, const gchar* dir_path,
+                      GError** error);
+
+gboolean
+kanban_board_dir_read(const gchar* dir_path, gboolean read_only, guint* journal,
+                      KanbanColumnReadFunc func, gpointer user_data,
+                      GCancellable* cancellable, GError** error);
+
+KanbanBoardRecord*
+kanban_board_dir_load(const gchar* dir_path, GError** error);
+
+void
+kanban_board_dir_save_async(KanbanBoardRecord* board, const gchar* dir_path,
+                            GCancellable* cancellable, GAsyncReadyCallback callback,
+                            gpointer user_data);
+
+gboolean
+kanban_board_dir_save_finish(GAsyncResult* result, GError** error);
+
+void
+kanban_board_io_hold(void);
+
+void
+kanban_board_io_release(void);
+
+void
+kanban_board_io_join(void);
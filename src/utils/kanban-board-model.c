@@ -0,0 +1,307 @@
+/* kanban-board-model.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "kanban-board-model.h"
+
+/*
+ * The board tracks which columns have unsaved edits, columns report
+ * to it through their "dirty" property, which only changes when they go
+ * from saved to edited or back. changed is set when the columns
+ * themselves changed, since the board was saved last.
+ * */
+struct _KanbanBoardModel
+{
+  GObject     parent_instance;
+
+  GPtrArray*  columns;  /* KanbanColumnItem */
+  GHashTable* dirty;    /* KanbanColumnItem */
+  gboolean    changed;
+};
+
+enum {
+  PROP_0,
+  PROP_DIRTY,
+  N_PROPS
+};
+
+static GParamSpec* properties[N_PROPS];
+
+static void kanban_board_model_list_model_init(GListModelInterface* iface);
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (KanbanBoardModel, kanban_board_model, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL,
+                                                      kanban_board_model_list_model_init))
+
+static GType
+get_item_type(GListModel* model)
+{
+  return KANBAN_TYPE_COLUMN_ITEM;
+}
+
+static guint
+get_n_items(GListModel* model)
+{
+  return KANBAN_BOARD_MODEL(model)->columns->len;
+}
+
+static gpointer
+get_item(GListModel* model, guint position)
+{
+  KanbanBoardModel* self = KANBAN_BOARD_MODEL(model);
+
+  if (position >= self->columns->len)
+    return NULL;
+
+  return g_object_ref(g_ptr_array_index(self->columns, position));
+}
+
+static void
+kanban_board_model_list_model_init(GListModelInterface* iface)
+{
+  iface->get_item_type = get_item_type;
+  iface->get_n_items   = get_n_items;
+  iface->get_item      = get_item;
+}
+
+KanbanBoardModel*
+kanban_board_model_new(void)
+{
+  return g_object_new(KANBAN_TYPE_BOARD_MODEL, NULL);
+}
+
+KanbanBoardModel*
+kanban_board_model_new_from_record(const KanbanBoardRecord* board)
+{
+  KanbanBoardModel* model = kanban_board_model_new();
+
+  for (guint i = 0; i < board->columns->len; i++) {
+    KanbanColumnItem* column =
+      kanban_column_item_new_from_record(g_ptr_array_index(board->columns, i));
+
+    kanban_board_model_append(model, column);
+    g_object_unref(column);
+  }
+
+  return model;
+}
+
+/* Notifies "dirty" when the board as a whole goes from saved to edited
+ * or back, whatever happened before */
+static void
+update_dirty(KanbanBoardModel* model, gboolean was_dirty)
+{
+  if (kanban_board_model_get_dirty(model) != was_dirty)
+    g_object_notify_by_pspec(G_OBJECT(model), properties[PROP_DIRTY]);
+}
+
+static void
+column_dirty_changed(KanbanColumnItem* column, GParamSpec* pspec, gpointer user_data)
+{
+  KanbanBoardModel* model = KANBAN_BOARD_MODEL(user_data);
+  gboolean was_dirty = kanban_board_model_get_dirty(model);
+
+  if (kanban_column_item_get_dirty(column))
+    g_hash_table_add(model->dirty, column);
+  else
+    g_hash_table_remove(model->dirty, column);
+
+  update_dirty(model, was_dirty);
+}
+
+/* Tells whether something changed since the board was saved last */
+gboolean
+kanban_board_model_get_dirty(KanbanBoardModel* model)
+{
+  return model->changed || g_hash_table_size(model->dirty) > 0;
+}
+
+/* For when the board file no longer matches the board, and no single
+ * column is to blame */
+void
+kanban_board_model_mark_dirty(KanbanBoardModel* model)
+{
+  gboolean was_dirty = kanban_board_model_get_dirty(model);
+
+  model->changed = TRUE;
+  update_dirty(model, was_dirty);
+}
+
+/* Marks every column saved, once their snapshot is taken */
+void
+kanban_board_model_clear_dirty(KanbanBoardModel* model)
+{
+  gboolean was_dirty = kanban_board_model_get_dirty(model);
+  GList* columns = g_hash_table_get_keys(model->dirty);
+
+  g_hash_table_remove_all(model->dirty);
+
+  for (GList* elem = columns; elem; elem = elem->next) {
+    g_signal_handlers_block_by_func(elem->data, column_dirty_changed, model);
+    kanban_column_item_clear_dirty(elem->data);
+    g_signal_handlers_unblock_by_func(elem->data, column_dirty_changed, model);
+  }
+
+  g_list_free(columns);
+  model->changed = FALSE;
+  update_dirty(model, was_dirty);
+}
+
+/* Returns a borrowed pointer, unlike g_list_model_get_item() */
+KanbanColumnItem*
+kanban_board_model_get_column(KanbanBoardModel* model, guint position)
+{
+  g_return_val_if_fail(position < model->columns->len, NULL);
+
+  return g_ptr_array_index(model->columns, position);
+}
+
+gint
+kanban_board_model_get_position(KanbanBoardModel* model, KanbanColumnItem* column)
+{
+  guint position;
+
+  if (!g_ptr_array_find(model->columns, column, &position))
+    return -1;
+
+  return position;
+}
+
+/* Returns a borrowed pointer to the card with id, or NULL. Columns are
+ * few, each one finds the card without scanning its cards */
+KanbanCardItem*
+kanban_board_model_lookup_card(KanbanBoardModel* model, guint64 id)
+{
+  for (guint i = 0; i < model->columns->len; i++) {
+    KanbanCardItem* card = kanban_column_item_lookup(g_ptr_array_index(model->columns, i), id);
+
+    if (card)
+      return card;
+  }
+
+  return NULL;
+}
+
+void
+kanban_board_model_append(KanbanBoardModel* model, KanbanColumnItem* column)
+{
+  gboolean was_dirty = kanban_board_model_get_dirty(model);
+
+  g_ptr_array_add(model->columns, g_object_ref(column));
+  g_signal_connect(column, "notify::dirty", G_CALLBACK(column_dirty_changed), model);
+  if (kanban_column_item_get_dirty(column))
+    g_hash_table_add(model->dirty, column);
+
+  g_list_model_items_changed(G_LIST_MODEL(model), model->columns->len - 1, 0, 1);
+  update_dirty(model, was_dirty);
+}
+
+void
+kanban_board_model_remove(KanbanBoardModel* model, guint position)
+{
+  g_return_if_fail(position < model->columns->len);
+
+  gboolean was_dirty = kanban_board_model_get_dirty(model);
+  KanbanColumnItem* column = g_ptr_array_steal_index(model->columns, position);
+
+  /* Its shard has to leave the manifest */
+  g_signal_handlers_disconnect_by_func(column, column_dirty_changed, model);
+  g_hash_table_remove(model->dirty, column);
+  model->changed = TRUE;
+
+  g_list_model_items_changed(G_LIST_MODEL(model), position, 1, 0);
+  update_dirty(model, was_dirty);
+  g_object_unref(column);
+}
+
+/* A full snapshot of the board, release it with kanban_board_record_free() */
+KanbanBoardRecord*
+kanban_board_model_get_record(KanbanBoardModel* model)
+{
+  KanbanBoardRecord* board = kanban_board_record_new();
+
+  for (guint i = 0; i < model->columns->len; i++)
+    g_ptr_array_add(board->columns,
+                    kanban_column_item_get_record(g_ptr_array_index(model->columns, i)));
+
+  return board;
+}
+
+static void
+kanban_board_model_get_property(GObject* object, guint property_id, GValue* value,
+                                GParamSpec* pspec)
+{
+  KanbanBoardModel* self = KANBAN_BOARD_MODEL(object);
+
+  switch (property_id) {
+    case PROP_DIRTY:
+      g_value_set_boolean(value, kanban_board_model_get_dirty(self));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+  }
+}
+
+static void
+kanban_board_model_dispose(GObject* object)
+{
+  KanbanBoardModel* self = KANBAN_BOARD_MODEL(object);
+
+  for (guint i = 0; i < self->columns->len; i++)
+    g_signal_handlers_disconnect_by_func(g_ptr_array_index(self->columns, i),
+                                         column_dirty_changed, self);
+  g_ptr_array_set_size(self->columns, 0);
+  g_hash_table_remove_all(self->dirty);
+
+  G_OBJECT_CLASS(kanban_board_model_parent_class)->dispose(object);
+}
+
+static void
+kanban_board_model_finalize(GObject* object)
+{
+  KanbanBoardModel* self = KANBAN_BOARD_MODEL(object);
+
+  g_ptr_array_unref(self->columns);
+  g_hash_table_unref(self->dirty);
+
+  G_OBJECT_CLASS(kanban_board_model_parent_class)->finalize(object);
+}
+
+static void
+kanban_board_model_class_init(KanbanBoardModelClass* klass)
+{
+  GObjectClass* object_class = G_OBJECT_CLASS(klass);
+
+  object_class->get_property = kanban_board_model_get_property;
+  object_class->dispose      = kanban_board_model_dispose;
+  object_class->finalize     = kanban_board_model_finalize;
+
+  properties[PROP_DIRTY] =
+    g_param_spec_boolean("dirty", NULL, NULL, FALSE,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_properties(object_class, N_PROPS, properties);
+}
+
+static void
+kanban_board_model_init(KanbanBoardModel* self)
+{
+  self->columns = g_ptr_array_new_with_free_func(g_object_unref);
+  self->dirty   = g_hash_table_new(g_direct_hash, g_direct_equal);
+}
@@ -0,0 +1,72 @@
+/* kanban-board-model.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "kanban-column-item.h"
+
+G_BEGIN_DECLS
+
+/*
+ * The columns of the board, as a GListModel of KanbanColumnItem. The
+ * "dirty" property tells whether the board has unsaved edits, it is only
+ * notified when that changes, not for every edit.
+ * */
+#define KANBAN_TYPE_BOARD_MODEL (kanban_board_model_get_type())
+
+G_DECLARE_FINAL_TYPE (KanbanBoardModel, kanban_board_model, KANBAN, BOARD_MODEL, GObject)
+
+KanbanBoardModel*
+kanban_board_model_new(void);
+
+KanbanBoardModel*
+kanban_board_model_new_from_record(const KanbanBoardRecord* board);
+
+KanbanColumnItem*
+kanban_board_model_get_column(KanbanBoardModel* model, guint position);
+
+gint
+kanban_board_model_get_position(KanbanBoardModel* model, KanbanColumnItem* column);
+
+KanbanCardItem*
+kanban_board_model_lookup_card(KanbanBoardModel* model, guint64 id);
+
+void
+kanban_board_model_append(KanbanBoardModel* model, KanbanColumnItem* column);
+
+void
+kanban_board_model_remove(KanbanBoardModel* model, guint position);
+
+KanbanBoardRecord*
+kanban_board_model_get_record(KanbanBoardModel* model);
+
+gboolean
+kanban_board_model_get_dirty(KanbanBoardModel* model);
+
+void
+kanban_board_model_mark_dirty(KanbanBoardModel* model);
+
+void
+kanban_board_model_clear_dirty(KanbanBoardModel* model);
+
+G_END_DECLS
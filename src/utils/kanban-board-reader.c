@@ -0,0 +1,680 @@
+/* kanban-board-reader.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "kanban-board-reader.h"
+
+#define READ_BUFFER_SIZE 65536
+
+typedef enum
+{
+  READER_START,
+  READER_COLUMNS,
+  READER_DONE,
+} ReaderState;
+
+/*
+ * The file is scanned byte by byte from buffer. While a card is read
+ * every byte consumed is kept in capture, then handed to parser. The
+ * first error stops the reader and is kept in error.
+ * */
+struct _KanbanBoardReader
+{
+  GInputStream* stream;
+  GCancellable* cancellable;
+  GError*       error;
+
+  gchar*        buffer;
+  gsize         pos;
+  gsize         len;
+  gboolean      eof;
+
+  GByteArray*   capture;
+  JsonParser*   parser;
+
+  ReaderState   state;
+  gboolean      first_column;
+  gboolean      legacy;
+  gboolean      keep_encoded;
+};
+
+KanbanBoardReader*
+kanban_board_reader_new(GInputStream* stream)
+{
+  KanbanBoardReader* reader = g_new0(KanbanBoardReader, 1);
+
+  reader->stream = g_object_ref(stream);
+  reader->buffer = g_malloc(READ_BUFFER_SIZE);
+  reader->parser = json_parser_new();
+
+  return reader;
+}
+
+void
+kanban_board_reader_free(KanbanBoardReader* reader)
+{
+  if (reader == NULL)
+    return;
+
+  g_object_unref(reader->stream);
+  g_object_unref(reader->parser);
+  g_clear_pointer(&reader->capture, g_byte_array_unref);
+  g_clear_error(&reader->error);
+  g_free(reader->buffer);
+  g_free(reader);
+}
+
+/*
+ * Leaves the cards read from then on encoded, with only their encoded
+ * form set, for them to be decoded elsewhere, see kanban-card-decoder.h.
+ * Cards without an id are not told apart then.
+ * */
+void
+kanban_board_reader_set_keep_encoded(KanbanBoardReader* reader, gboolean keep_encoded)
+{
+  reader->keep_encoded = keep_encoded;
+}
+
+/* Tells whether the file turned out to be a version 1 board */
+gboolean
+kanban_board_reader_is_legacy(KanbanBoardReader* reader)
+{
+  return reader->legacy;
+}
+
+static void
+fail(KanbanBoardReader* reader, const gchar* message)
+{
+  if (reader->error == NULL)
+    g_set_error_literal(&reader->error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, message);
+}
+
+static gboolean
+fill(KanbanBoardReader* reader)
+{
+  if (reader->pos < reader->len)
+    return TRUE;
+
+  if (reader->eof || reader->error)
+    return FALSE;
+
+  gssize read = g_input_stream_read(reader->stream, reader->buffer, READ_BUFFER_SIZE,
+                                    reader->cancellable, &reader->error);
+
+  reader->pos = 0;
+  reader->len = MAX(read, 0);
+  reader->eof = read <= 0;
+
+  return read > 0;
+}
+
+/* Returns the next byte without consuming it, -1 at the end */
+static gint
+peek(KanbanBoardReader* reader)
+{
+  return fill(reader) ? (guchar)reader->buffer[reader->pos] : -1;
+}
+
+static gint
+next(KanbanBoardReader* reader)
+{
+  if (!fill(reader))
+    return -1;
+
+  guint8 c = reader->buffer[reader->pos++];
+
+  if (reader->capture)
+    g_byte_array_append(reader->capture, &c, 1);
+
+  return c;
+}
+
+/* Skips whitespace, returns the next byte without consuming it */
+static gint
+skip_space(KanbanBoardReader* reader)
+{
+  gint c;
+
+  while ((c = peek(reader)) == ' ' || c == '\n' || c == '\r' || c == '\t')
+    next(reader);
+
+  return c;
+}
+
+static gboolean
+expect(KanbanBoardReader* reader, gchar expected)
+{
+  gint c = skip_space(reader);
+
+  if (c != expected)
+  {
+    fail(reader, c < 0 ? "Unexpected end of board file" : "Malformed board file");
+    return FALSE;
+  }
+
+  next(reader);
+  return TRUE;
+}
+
+static gboolean
+is_delimiter(gint c)
+{
+  return c < 0 || c == ',' || c == '}' || c == ']' ||
+         c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/* Consumes a string without decoding it, runs without escapes are
+ * skipped at once */
+static gboolean
+skip_string(KanbanBoardReader* reader)
+{
+  if (!expect(reader, '"'))
+    return FALSE;
+
+  while (fill(reader))
+  {
+    const gchar* start = reader->buffer + reader->pos;
+    const gchar* end   = reader->buffer + reader->len;
+    const gchar* p     = start;
+
+    while (p < end && *p != '"' && *p != '\\')
+      p++;
+
+    if (reader->capture)
+      g_byte_array_append(reader->capture, (const guint8*)start, p - start);
+    reader->pos += p - start;
+
+    if (p == end)
+      continue;
+
+    if (next(reader) == '"')
+      return TRUE;
+
+    /* The byte after a backslash never ends the string */
+    if (next(reader) < 0)
+      break;
+  }
+
+  fail(reader, "Unexpected end of board file");
+  return FALSE;
+}
+
+static gint
+read_hex(KanbanBoardReader* reader)
+{
+  gint value = 0;
+
+  for (guint i = 0; i < 4; i++)
+  {
+    gint digit = g_ascii_xdigit_value(next(reader));
+
+    if (digit < 0)
+      return -1;
+    value = value * 16 + digit;
+  }
+
+  return value;
+}
+
+/* Reads and decodes a string into out */
+static gboolean
+read_string(KanbanBoardReader* reader, GString* out)
+{
+  g_string_truncate(out, 0);
+
+  if (!expect(reader, '"'))
+    return FALSE;
+
+  for (gint c = next(reader); c >= 0; c = next(reader))
+  {
+    if (c == '"')
+      return TRUE;
+
+    if (c != '\\')
+    {
+      g_string_append_c(out, c);
+      continue;
+    }
+
+    switch (c = next(reader))
+    {
+      case 'n': g_string_append_c(out, '\n'); break;
+      case 'r': g_string_append_c(out, '\r'); break;
+      case 't': g_string_append_c(out, '\t'); break;
+      case 'b': g_string_append_c(out, '\b'); break;
+      case 'f': g_string_append_c(out, '\f'); break;
+      case '"':
+      case '\\':
+      case '/': g_string_append_c(out, c);    break;
+      case 'u':
+      {
+        gint unit = read_hex(reader);
+        gunichar ch = 0xfffd;
+
+        if (unit < 0)
+        {
+          fail(reader, "Malformed escape in board file");
+          return FALSE;
+        }
+
+        /* Characters past the BMP come as a surrogate pair */
+        if (unit >= 0xd800 && unit < 0xdc00 && peek(reader) == '\\')
+        {
+          next(reader);
+
+          gint low = next(reader) == 'u' ? read_hex(reader) : -1;
+
+          if (low < 0)
+          {
+            fail(reader, "Malformed escape in board file");
+            return FALSE;
+          }
+
+          if (low >= 0xdc00 && low < 0xe000)
+            ch = 0x10000 + ((unit - 0xd800) << 10) + (low - 0xdc00);
+        }
+        else if (unit < 0xd800 || unit >= 0xe000)
+          ch = unit;
+
+        g_string_append_unichar(out, ch);
+        break;
+      }
+      default:
+        fail(reader, c < 0 ? "Unexpected end of board file" : "Malformed escape in board file");
+        return FALSE;
+    }
+  }
+
+  fail(reader, "Unexpected end of board file");
+  return FALSE;
+}
+
+/* Consumes a value of any kind without looking into it */
+static gboolean
+skip_value(KanbanBoardReader* reader)
+{
+  gint c = skip_space(reader);
+
+  if (c == '"')
+    return skip_string(reader);
+
+  if (c != '{' && c != '[')
+  {
+    /* Numbers and literals run up to the next delimiter */
+    while (!is_delimiter(peek(reader)))
+      next(reader);
+
+    return reader->error == NULL;
+  }
+
+  guint depth = 0;
+
+  do
+  {
+    c = peek(reader);
+
+    if (c < 0)
+    {
+      fail(reader, "Unexpected end of board file");
+      return FALSE;
+    }
+
+    if (c == '"')
+    {
+      if (!skip_string(reader))
+        return FALSE;
+      continue;
+    }
+
+    next(reader);
+
+    if (c == '{' || c == '[')
+      depth++;
+    else if (c == '}' || c == ']')
+      depth--;
+  }
+  while (depth > 0);
+
+  return TRUE;
+}
+
+static gboolean
+read_version(KanbanBoardReader* reader)
+{
+  gchar   digits[32];
+  guint   len = 0;
+  gint    c   = skip_space(reader);
+
+  if (c == '"' || c == '{' || c == '[')
+    return skip_value(reader);
+
+  while (!is_delimiter(c = peek(reader)))
+  {
+    next(reader);
+    if (len < sizeof(digits) - 1)
+      digits[len++] = c;
+  }
+  digits[len] = '\0';
+
+  gint64 version = g_ascii_strtoll(digits, NULL, 10);
+
+  if (version > KANBAN_BOARD_FILE_VERSION && reader->error == NULL)
+    g_set_error(&reader->error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                "Board format version %" G_GINT64_FORMAT " is newer than this release supports",
+                version);
+
+  return reader->error == NULL;
+}
+
+/* Reads the name of the next member of the object being read, FALSE
+ * at its end or on error */
+static gboolean
+next_member(KanbanBoardReader* reader, GString* name, gboolean* first)
+{
+  if (skip_space(reader) == '}')
+  {
+    next(reader);
+    return FALSE;
+  }
+
+  if (!*first && !expect(reader, ','))
+    return FALSE;
+  *first = FALSE;
+
+  return read_string(reader, name) && expect(reader, ':');
+}
+
+/* Only the card is parsed into a tree, new_ids is set when it has no id */
+static KanbanCardRecord*
+read_card(KanbanBoardReader* reader, gboolean* new_ids)
+{
+  if (skip_space(reader) != '{')
+  {
+    skip_value(reader);
+    return NULL;
+  }
+
+  reader->capture = g_byte_array_new();
+
+  gboolean          read  = skip_value(reader);
+  GByteArray*       bytes = g_steal_pointer(&reader->capture);
+  KanbanCardRecord* card  = NULL;
+
+  if (read && reader->keep_encoded)
+  {
+    GBytes* encoded = g_byte_array_free_to_bytes(bytes);
+
+    card = kanban_card_record_new_encoded(NULL, FALSE, encoded);
+    g_bytes_unref(encoded);
+    return card;
+  }
+
+  if (read && json_parser_load_from_data(reader->parser, (const gchar*)bytes->data,
+                                         bytes->len, &reader->error))
+  {
+    JsonObject* object = json_node_get_object(json_parser_get_root(reader->parser));
+    JsonNode*   id     = json_object_get_member(object, "id");
+
+    if (!id || !JSON_NODE_HOLDS_VALUE(id) || json_node_get_int(id) <= 0)
+      *new_ids = TRUE;
+
+    card = kanban_card_record_from_json(object);
+  }
+
+  g_byte_array_unref(bytes);
+  return card;
+}
+
+static gboolean
+read_cards(KanbanBoardReader* reader, KanbanColumnRecord* column, gboolean* new_ids)
+{
+  gboolean first = TRUE;
+
+  if (skip_space(reader) != '[')
+    return skip_value(reader);
+  next(reader);
+
+  while (reader->error == NULL)
+  {
+    if (skip_space(reader) == ']')
+    {
+      next(reader);
+      return TRUE;
+    }
+
+    if (!first && !expect(reader, ','))
+      break;
+    first = FALSE;
+
+    KanbanCardRecord* card = read_card(reader, new_ids);
+    if (card)
+      g_ptr_array_add(column->cards, card);
+  }
+
+  return FALSE;
+}
+
+static gboolean
+read_column_member(KanbanBoardReader* reader, KanbanColumnRecord* column,
+                   const gchar* name, gboolean* new_ids)
+{
+  if (g_str_equal(name, "cards"))
+    return read_cards(reader, column, new_ids);
+
+  if (g_str_equal(name, "version"))
+    return read_version(reader);
+
+  if (!g_str_equal(name, "title") || skip_space(reader) != '"')
+    return skip_value(reader);
+
+  GString* title = g_string_new(NULL);
+  gboolean read  = read_string(reader, title);
+
+  g_free(column->title);
+  column->title = g_string_free(title, FALSE);
+
+  return read;
+}
+
+/* Reads the members of column up to the end of its object, first tells
+ * whether none was read yet */
+static KanbanColumnRecord*
+read_column(KanbanBoardReader* reader, KanbanColumnRecord* column, gboolean first,
+            gboolean* new_ids)
+{
+  GString* name = g_string_new(NULL);
+
+  while (next_member(reader, name, &first))
+  {
+    if (!read_column_member(reader, column, name->str, new_ids))
+      break;
+  }
+
+  g_string_free(name, TRUE);
+
+  if (reader->error)
+    g_clear_pointer(&column, kanban_column_record_free);
+
+  return column;
+}
+
+/* What follows "columns" in the root object is skipped */
+static void
+read_root_end(KanbanBoardReader* reader)
+{
+  GString* name  = g_string_new(NULL);
+  gboolean first = FALSE;
+
+  while (next_member(reader, name, &first))
+  {
+    if (!(g_str_equal(name->str, "version") ? read_version(reader) : skip_value(reader)))
+      break;
+  }
+
+  g_string_free(name, TRUE);
+}
+
+static KanbanColumnRecord*
+read_next_column(KanbanBoardReader* reader, gboolean* new_ids)
+{
+  while (reader->error == NULL)
+  {
+    if (skip_space(reader) == ']')
+    {
+      next(reader);
+      reader->state = READER_DONE;
+      read_root_end(reader);
+      return NULL;
+    }
+
+    if (!reader->first_column && !expect(reader, ','))
+      return NULL;
+    reader->first_column = FALSE;
+
+    /* Anything but an object is not a column */
+    if (skip_space(reader) != '{')
+    {
+      skip_value(reader);
+      continue;
+    }
+
+    next(reader);
+    return read_column(reader, kanban_column_record_new(NULL), TRUE, new_ids);
+  }
+
+  return NULL;
+}
+
+/*
+ * A board file lists its columns in "columns", a shard is a column on
+ * its own. Version 1 files have no "version", their columns are objects
+ * keyed by title, whatever the title. Until the version is read, a
+ * member is only taken in the current layout when its value has the
+ * type it has there, anything else is left to the JSON tree reader
+ * */
+static KanbanColumnRecord*
+read_root(KanbanBoardReader* reader, gboolean* new_ids)
+{
+  GString*            name      = g_string_new(NULL);
+  KanbanColumnRecord* column    = NULL;
+  gboolean            first     = TRUE;
+  gboolean            versioned = FALSE;
+
+  reader->state = READER_DONE;
+
+  if (!expect(reader, '{'))
+  {
+    g_string_free(name, TRUE);
+    return NULL;
+  }
+
+  while (next_member(reader, name, &first))
+  {
+    gint value = skip_space(reader);
+
+    if (!versioned && value == '{')
+    {
+      reader->legacy = TRUE;
+      break;
+    }
+
+    if (g_str_equal(name->str, "columns") && value == '[')
+    {
+      next(reader);
+      reader->state        = READER_COLUMNS;
+      reader->first_column = TRUE;
+      column = read_next_column(reader, new_ids);
+      break;
+    }
+
+    if ((g_str_equal(name->str, "title") && value == '"') ||
+        (g_str_equal(name->str, "cards") && value == '['))
+    {
+      column = kanban_column_record_new(NULL);
+
+      if (read_column_member(reader, column, name->str, new_ids))
+        column = read_column(reader, column, FALSE, new_ids);
+      else
+        g_clear_pointer(&column, kanban_column_record_free);
+      break;
+    }
+
+    if (g_str_equal(name->str, "version"))
+    {
+      if (!read_version(reader))
+        break;
+      versioned = TRUE;
+    }
+    else if (!skip_value(reader))
+    {
+      break;
+    }
+  }
+
+  /* A version 1 board without columns, as kanban_board_record_from_json()
+   * takes it */
+  if (!versioned && column == NULL && reader->error == NULL)
+    reader->legacy = TRUE;
+
+  g_string_free(name, TRUE);
+  return column;
+}
+
+/*
+ * kanban_board_reader_next_column returns the next column of the file,
+ * with its cards, or NULL once there is none left or on error. new_ids
+ * is set when some of its cards had no id yet.
+ *
+ * release it with kanban_column_record_free() */
+KanbanColumnRecord*
+kanban_board_reader_next_column(KanbanBoardReader* reader, gboolean* new_ids,
+                                GCancellable* cancellable, GError** error)
+{
+  KanbanColumnRecord* column = NULL;
+  gboolean            unused = FALSE;
+
+  if (new_ids == NULL)
+    new_ids = &unused;
+  *new_ids = FALSE;
+
+  reader->cancellable = cancellable;
+
+  switch (reader->state)
+  {
+    case READER_START:
+      column = read_root(reader, new_ids);
+      break;
+    case READER_COLUMNS:
+      column = read_next_column(reader, new_ids);
+      break;
+    case READER_DONE:
+      break;
+  }
+
+  reader->cancellable = NULL;
+
+  if (reader->error)
+  {
+    reader->state = READER_DONE;
+    g_clear_pointer(&column, kanban_column_record_free);
+    g_propagate_error(error, g_steal_pointer(&reader->error));
+  }
+
+  return column;
+}
@@ -0,0 +1,53 @@
+/* kanban-board-reader.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "kanban-board-file.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Reads a board file or a column shard as it comes from the stream, one
+ * column at a time. Only the card being read is held as a JSON tree, the
+ * rest of the file is scanned without building one.
+ *
+ * Version 1 files can't be read this way, the reader stops at once and
+ * tells so with kanban_board_reader_is_legacy(), see kanban-board-file.h
+ * */
+typedef struct _KanbanBoardReader KanbanBoardReader;
+
+KanbanBoardReader*
+kanban_board_reader_new(GInputStream* stream);
+
+void
+kanban_board_reader_free(KanbanBoardReader* reader);
+
+KanbanColumnRecord*
+kanban_board_reader_next_column(KanbanBoardReader* reader, gboolean* new_ids,
+                                GCancellable* cancellable, GError** error);
+
+void
+kanban_board_reader_set_keep_encoded(KanbanBoardReader* reader, gboolean keep_encoded);
+
+gboolean
+kanban_board_reader_is_legacy(KanbanBoardReader* reader);
+
+G_END_DECLS
@@ -0,0 +1,201 @@
+/* kanban-board-snapshot.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "kanban-board-snapshot.h"
+
+/* What tells a shard apart from the one a snapshot was written for,
+ * the shard is replaced by a rename each time it is written */
+typedef struct
+{
+  guint64 inode;
+  guint64 mtime;
+  guint64 size;
+} ShardStamp;
+
+static gboolean
+stamp_shard(const gchar* shard_path, ShardStamp* stamp, GError** error)
+{
+  GFile*     file = g_file_new_for_path(shard_path);
+  GFileInfo* info = g_file_query_info(file,
+                                      G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                      G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                      G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+                                      G_FILE_ATTRIBUTE_UNIX_INODE,
+                                      G_FILE_QUERY_INFO_NONE, NULL, error);
+
+  g_object_unref(file);
+
+  if (info == NULL)
+    return FALSE;
+
+  stamp->inode = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_UNIX_INODE);
+  stamp->mtime = g_file_info_get_attribute_uint64(info, G_FILE_ATTRIBUTE_TIME_MODIFIED) *
+                 G_USEC_PER_SEC +
+                 g_file_info_get_attribute_uint32(info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+  stamp->size  = g_file_info_get_size(info);
+
+  g_object_unref(info);
+  return TRUE;
+}
+
+/* The snapshot of the shard at shard_path, release it with g_free() */
+gchar*
+kanban_board_snapshot_path(const gchar* shard_path)
+{
+  gsize len = strlen(shard_path);
+
+  if (g_str_has_suffix(shard_path, ".json"))
+    len -= strlen(".json");
+
+  gchar* base = g_strndup(shard_path, len);
+  gchar* path = g_strconcat(base, KANBAN_BOARD_SNAPSHOT_SUFFIX, NULL);
+
+  g_free(base);
+  return path;
+}
+
+/*
+ * kanban_board_snapshot_write writes the snapshot of column, once it is
+ * written to the shard at shard_path. Cards that carry their encoded
+ * form have it copied as is.
+ * */
+gboolean
+kanban_board_snapshot_write(const KanbanColumnRecord* column, const gchar* shard_path,
+                            GError** error)
+{
+  ShardStamp stamp;
+
+  if (!stamp_shard(shard_path, &stamp, error))
+    return FALSE;
+
+  GVariantBuilder cards;
+  g_variant_builder_init(&cards, G_VARIANT_TYPE("a(tsbay)"));
+
+  for (guint i = 0; i < column->cards->len; i++)
+  {
+    KanbanCardRecord* card  = g_ptr_array_index(column->cards, i);
+    GBytes*           bytes = card->encoded ? g_bytes_ref(card->encoded)
+                                            : kanban_card_record_encode(card);
+
+    g_variant_builder_add(&cards, "(tsb@ay)", card->id, card->title ? card->title : "",
+                          card->revealed,
+                          g_variant_new_from_bytes(G_VARIANT_TYPE_BYTESTRING, bytes, TRUE));
+    g_bytes_unref(bytes);
+  }
+
+  GVariant* snapshot = g_variant_ref_sink(
+    g_variant_new("(uttts@a(tsbay))", KANBAN_BOARD_SNAPSHOT_VERSION, stamp.inode,
+                  stamp.mtime, stamp.size, column->title ? column->title : "",
+                  g_variant_builder_end(&cards)));
+  GBytes*      data     = g_variant_get_data_as_bytes(snapshot);
+  gchar*       path     = kanban_board_snapshot_path(shard_path);
+  gsize        size     = 0;
+  const gchar* contents = g_bytes_get_data(data, &size);
+  gboolean     success  = g_file_set_contents(path, contents, size, error);
+
+  g_free(path);
+  g_bytes_unref(data);
+  g_variant_unref(snapshot);
+
+  return success;
+}
+
+/*
+ * kanban_board_snapshot_read maps the snapshot of the shard at
+ * shard_path and returns its column. The column is clean and its cards
+ * only carry their encoded form, which holds on to the mapping.
+ *
+ * Fails with G_FILE_ERROR_NOENT when there is no snapshot, and with
+ * G_IO_ERROR_INVALID_DATA when it is out of date.
+ *
+ * release it with kanban_column_record_free() */
+KanbanColumnRecord*
+kanban_board_snapshot_read(const gchar* shard_path, GError** error)
+{
+  gchar*       path   = kanban_board_snapshot_path(shard_path);
+  GMappedFile* mapped = g_mapped_file_new(path, FALSE, error);
+
+  if (mapped == NULL)
+  {
+    g_free(path);
+    return NULL;
+  }
+
+  GBytes* bytes = g_mapped_file_get_bytes(mapped);
+  g_mapped_file_unref(mapped);
+
+  /* Not trusted: a damaged file reads as default values, never past it */
+  GVariant* snapshot = g_variant_ref_sink(
+    g_variant_new_from_bytes(G_VARIANT_TYPE(KANBAN_BOARD_SNAPSHOT_TYPE), bytes, FALSE));
+  g_bytes_unref(bytes);
+
+  guint32      version;
+  ShardStamp   written, stamp;
+  const gchar* title;
+  GVariant*    cards;
+
+  g_variant_get(snapshot, "(uttt&s@a(tsbay))", &version, &written.inode, &written.mtime,
+                &written.size, &title, &cards);
+
+  /* Snapshots written on a machine of the other byte order fail here too */
+  if (version != KANBAN_BOARD_SNAPSHOT_VERSION ||
+      !stamp_shard(shard_path, &stamp, NULL) ||
+      stamp.inode != written.inode || stamp.mtime != written.mtime ||
+      stamp.size != written.size)
+  {
+    g_set_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "%s is out of date", path);
+    g_variant_unref(cards);
+    g_variant_unref(snapshot);
+    g_free(path);
+    return NULL;
+  }
+
+  KanbanColumnRecord* column = kanban_column_record_new(title);
+  GVariantIter        iter;
+  guint64             id;
+  const gchar*        card_title;
+  gboolean            revealed;
+  GVariant*           encoded;
+
+  column->dirty = FALSE;
+
+  g_variant_iter_init(&iter, cards);
+  while (g_variant_iter_next(&iter, "(t&sb@ay)", &id, &card_title, &revealed, &encoded))
+  {
+    GBytes*           card_bytes = g_variant_get_data_as_bytes(encoded);
+    KanbanCardRecord* card       = kanban_card_record_new_encoded(card_title, revealed,
+                                                                  card_bytes);
+
+    if (id)
+      card->id = id;
+
+    g_ptr_array_add(column->cards, card);
+    g_bytes_unref(card_bytes);
+    g_variant_unref(encoded);
+  }
+
+  g_variant_unref(cards);
+  g_variant_unref(snapshot);
+  g_free(path);
+
+  return column;
+}
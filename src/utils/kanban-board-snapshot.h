@@ -0,0 +1,54 @@
+/* kanban-board-snapshot.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "kanban-board-file.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Each shard of a sharded board is shadowed by a binary snapshot, a
+ * GVariant of type KANBAN_BOARD_SNAPSHOT_TYPE written next to it:
+ *
+ * column-<uuid>.gvariant   ( version, shard inode, shard mtime in µs,
+ *                            shard size, title,
+ *                            [ ( id, title, revealed, encoded card ) ] )
+ *
+ * Snapshots are mapped and read in place: column and card titles come
+ * without parsing, and each card keeps its JSON form as a slice of the
+ * mapping, to be decoded when needed. A snapshot whose shard changed
+ * since it was written is out of date, the shard is read instead.
+ * */
+#define KANBAN_BOARD_SNAPSHOT_VERSION 1
+#define KANBAN_BOARD_SNAPSHOT_SUFFIX  ".gvariant"
+#define KANBAN_BOARD_SNAPSHOT_TYPE    "(utttsa(tsbay))"
+
+gchar*
+kanban_board_snapshot_path(const gchar* shard_path);
+
+gboolean
+kanban_board_snapshot_write(const KanbanColumnRecord* column, const gchar* shard_path,
+                            GError** error);
+
+KanbanColumnRecord*
+kanban_board_snapshot_read(const gchar* shard_path, GError** error);
+
+G_END_DECLS
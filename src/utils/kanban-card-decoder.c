@@ -0,0 +1,222 @@
+/* kanban-card-decoder.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "kanban-card-decoder.h"
+#include "kanban-trace.h"
+
+/* Cards decoded by a worker in one go */
+#define DECODE_BATCH 64
+
+/* Columns read ahead of the first one still decoding */
+#define MAX_COLUMNS_IN_FLIGHT 8
+
+/* pending counts the batches of column left, under the decoder mutex */
+typedef struct
+{
+  KanbanColumnRecord* column;
+  guint               pending;
+  gboolean            new_ids;
+} DecodeColumn;
+
+typedef struct
+{
+  DecodeColumn* column;
+  guint         start;
+  guint         end;
+} DecodeBatch;
+
+struct _KanbanCardDecoder
+{
+  GThreadPool*         pool;
+  GMutex               mutex;
+  GCond                cond;
+  GQueue               columns;  /* DecodeColumn, in reading order */
+
+  KanbanColumnReadFunc func;
+  gpointer             user_data;
+};
+
+/* Returns whether card had an id of its own. A decoded card keeps its
+ * encoded form to be written back as it is, unless its id was made up.
+ * A card that can't be decoded keeps it as text, for nothing to be lost */
+static gboolean
+decode_card(KanbanCardRecord* card, JsonParser* parser)
+{
+  GError*  error  = NULL;
+  gboolean had_id = TRUE;
+
+  if (kanban_card_record_decode(card, parser, &had_id, &error))
+  {
+    if (had_id)
+      return TRUE;
+  }
+  else
+  {
+    gsize        size = 0;
+    const gchar* data = g_bytes_get_data(card->encoded, &size);
+
+    g_warning("Failed to decode a card: %s", error->message);
+    g_error_free(error);
+
+    card->description = kanban_unserialized_content_new();
+    g_string_append_len(card->description->text, data, size);
+  }
+
+  /* data belongs to encoded, dropped last */
+  g_clear_pointer(&card->encoded, g_bytes_unref);
+  return had_id;
+}
+
+static void
+decode_batch(gpointer data, gpointer user_data)
+{
+  DecodeBatch*       batch   = data;
+  KanbanCardDecoder* decoder = user_data;
+  JsonParser*        parser  = json_parser_new();
+  gboolean           new_ids = FALSE;
+
+  KANBAN_TRACE_SCOPE("decode_batch");
+  KANBAN_TRACE_COUNT("cards decoded", batch->end - batch->start);
+
+  for (guint i = batch->start; i < batch->end; i++)
+  {
+    KanbanCardRecord* card = g_ptr_array_index(batch->column->column->cards, i);
+
+    if (card->encoded && card->description == NULL && !decode_card(card, parser))
+      new_ids = TRUE;
+  }
+
+  g_object_unref(parser);
+
+  g_mutex_lock(&decoder->mutex);
+  batch->column->new_ids |= new_ids;
+  if (--batch->column->pending == 0)
+    g_cond_broadcast(&decoder->cond);
+  g_mutex_unlock(&decoder->mutex);
+
+  g_free(batch);
+}
+
+KanbanCardDecoder*
+kanban_card_decoder_new(KanbanColumnReadFunc func, gpointer user_data)
+{
+  KanbanCardDecoder* decoder = g_new0(KanbanCardDecoder, 1);
+
+  decoder->func      = func;
+  decoder->user_data = user_data;
+  decoder->pool      = g_thread_pool_new(decode_batch, decoder, g_get_num_processors(),
+                                         FALSE, NULL);
+  g_mutex_init(&decoder->mutex);
+  g_cond_init(&decoder->cond);
+  g_queue_init(&decoder->columns);
+
+  return decoder;
+}
+
+/*
+ * Hands the decoded columns at the head of the queue to func, waiting
+ * for them while more than keep columns are queued
+ * */
+static void
+emit_decoded(KanbanCardDecoder* decoder, guint keep)
+{
+  g_mutex_lock(&decoder->mutex);
+
+  for (DecodeColumn* head; (head = g_queue_peek_head(&decoder->columns)) != NULL;)
+  {
+    if (head->pending > 0)
+    {
+      if (decoder->columns.length <= keep)
+        break;
+
+      g_cond_wait(&decoder->cond, &decoder->mutex);
+      continue;
+    }
+
+    g_queue_pop_head(&decoder->columns);
+    g_mutex_unlock(&decoder->mutex);
+
+    if (head->new_ids)
+      head->column->dirty = TRUE;
+    decoder->func(head->column, decoder->user_data);
+    g_free(head);
+
+    g_mutex_lock(&decoder->mutex);
+  }
+
+  g_mutex_unlock(&decoder->mutex);
+}
+
+static void
+queue_column(KanbanCardDecoder* self, KanbanColumnRecord* column, gboolean decode)
+{
+  DecodeColumn* item = g_new0(DecodeColumn, 1);
+  guint         len  = decode ? column->cards->len : 0;
+
+  item->column  = column;
+  item->pending = (len + DECODE_BATCH - 1) / DECODE_BATCH;
+
+  g_mutex_lock(&self->mutex);
+  g_queue_push_tail(&self->columns, item);
+  g_mutex_unlock(&self->mutex);
+
+  for (guint start = 0; start < len; start += DECODE_BATCH)
+  {
+    DecodeBatch* batch = g_new0(DecodeBatch, 1);
+
+    batch->column = item;
+    batch->start  = start;
+    batch->end    = MIN(start + DECODE_BATCH, len);
+    g_thread_pool_push(self->pool, batch, NULL);
+  }
+
+  emit_decoded(self, MAX_COLUMNS_IN_FLIGHT);
+}
+
+/*
+ * kanban_card_decoder_push queues column for its cards to be decoded,
+ * taking ownership of it. Its signature is the one of
+ * KanbanColumnReadFunc, so that it can be handed to a board reader.
+ * */
+void
+kanban_card_decoder_push(KanbanColumnRecord* column, gpointer decoder)
+{
+  queue_column(decoder, column, TRUE);
+}
+
+/* Queues column as it is, for it to keep its place among the others */
+void
+kanban_card_decoder_push_ready(KanbanColumnRecord* column, KanbanCardDecoder* decoder)
+{
+  queue_column(decoder, column, FALSE);
+}
+
+/* Waits for every column to be decoded and handed to func, then frees
+ * decoder */
+void
+kanban_card_decoder_finish(KanbanCardDecoder* decoder)
+{
+  emit_decoded(decoder, 0);
+
+  g_thread_pool_free(decoder->pool, FALSE, TRUE);
+  g_mutex_clear(&decoder->mutex);
+  g_cond_clear(&decoder->cond);
+  g_free(decoder);
+}
@@ -0,0 +1,51 @@
+/* kanban-card-decoder.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "kanban-board-file.h"
+
+G_BEGIN_DECLS
+
+/*
+ * Decodes the cards of columns on a pool of worker threads, one per
+ * processor. Columns go in as they are read, their cards only carrying
+ * their encoded form, and are handed to func in the same order once all
+ * their cards are decoded. func runs in the thread pushing the columns.
+ *
+ * A column whose cards had to be given an id comes out marked dirty.
+ * Columns that need no decoding, such as those read from a snapshot, are
+ * queued with kanban_card_decoder_push_ready() to keep their place.
+ * */
+typedef struct _KanbanCardDecoder KanbanCardDecoder;
+
+KanbanCardDecoder*
+kanban_card_decoder_new(KanbanColumnReadFunc func, gpointer user_data);
+
+void
+kanban_card_decoder_push(KanbanColumnRecord* column, gpointer decoder);
+
+void
+kanban_card_decoder_push_ready(KanbanColumnRecord* column, KanbanCardDecoder* decoder);
+
+void
+kanban_card_decoder_finish(KanbanCardDecoder* decoder);
+
+G_END_DECLS
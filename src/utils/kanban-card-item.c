@@ -0,0 +1,352 @@
+/* kanban-card-item.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "kanban-card-item.h"
+#include "kanban-trace.h"
+
+struct _KanbanCardItem
+{
+  GObject                    parent_instance;
+
+  guint64                    id;
+  gchar*                     title;
+  gboolean                   revealed;
+
+  /* NULL until decoded from encoded, for cards that were only read */
+  KanbanUnserializedContent* description;
+
+  /* Set while a widget edits the description, stale tells that the
+   * description has to be pulled from it */
+  KanbanCardItemSource       source;
+  gpointer                   source_data;
+  gboolean                   stale;
+
+  /* Card as written in the board file, NULL once the card changed. The
+   * revealed flag it carries is patched when it no longer matches */
+  GBytes*                    encoded;
+  gboolean                   encoded_revealed;
+  gboolean                   dirty;
+
+  /* The KanbanColumnItem holding the card, not referenced */
+  gpointer                   column;
+};
+
+static guint SIGNAL_CHANGED = 0;
+
+G_DEFINE_FINAL_TYPE (KanbanCardItem, kanban_card_item, G_TYPE_OBJECT)
+
+/* A card that can't be decoded keeps its encoded form as text */
+static KanbanUnserializedContent*
+decode_description(GBytes* encoded)
+{
+  KanbanUnserializedContent* description = NULL;
+  JsonParser* parser = json_parser_new();
+  gsize size = 0;
+  const gchar* data = g_bytes_get_data(encoded, &size);
+
+  KANBAN_TRACE_COUNT("descriptions decoded", 1);
+
+  if (json_parser_load_from_data(parser, data, size, NULL) &&
+      JSON_NODE_HOLDS_OBJECT(json_parser_get_root(parser))) {
+    KanbanCardRecord* decoded =
+      kanban_card_record_from_json(json_node_get_object(json_parser_get_root(parser)));
+
+    description = g_steal_pointer(&decoded->description);
+    kanban_card_record_free(decoded);
+  } else {
+    description = kanban_unserialized_content_new();
+    g_string_append_len(description->text, data, size);
+  }
+
+  g_object_unref(parser);
+  return description;
+}
+
+static void
+invalidate(KanbanCardItem* item)
+{
+  /* The description was only kept encoded until now */
+  if (item->description == NULL)
+    item->description = decode_description(item->encoded);
+
+  g_clear_pointer(&item->encoded, g_bytes_unref);
+  item->dirty = TRUE;
+  g_signal_emit(item, SIGNAL_CHANGED, 0);
+}
+
+KanbanCardItem*
+kanban_card_item_new(const gchar* title, gboolean revealed,
+                     KanbanUnserializedContent* description)
+{
+  KanbanCardItem* item = g_object_new(KANBAN_TYPE_CARD_ITEM, NULL);
+
+  item->id          = kanban_card_id_new();
+  item->title       = g_strdup(title ? title : "");
+  item->revealed    = revealed;
+  item->description = description ? description : kanban_unserialized_content_new();
+
+  /* Records hand over an encoded form saved with their revealed flag */
+  item->encoded_revealed = revealed;
+
+  return item;
+}
+
+/* Cards that only carry their encoded form keep it, and are decoded
+ * when their description is first asked for */
+KanbanCardItem*
+kanban_card_item_new_from_record(const KanbanCardRecord* record)
+{
+  KanbanCardItem* item = kanban_card_item_new(record->title, record->revealed, NULL);
+
+  if (record->id)
+    item->id = record->id;
+
+  if (record->encoded)
+    item->encoded = g_bytes_ref(record->encoded);
+
+  if (record->description) {
+    kanban_unserialized_content_free(item->description);
+    item->description = kanban_unserialized_content_copy(record->description);
+  } else if (record->encoded) {
+    g_clear_pointer(&item->description, kanban_unserialized_content_free);
+  }
+
+  return item;
+}
+
+/* Like kanban_card_item_new_from_record(), but takes the description and
+ * encoded form of record instead of copying them, record is left empty */
+KanbanCardItem*
+kanban_card_item_new_take_record(KanbanCardRecord* record)
+{
+  KanbanUnserializedContent* description = g_steal_pointer(&record->description);
+  KanbanCardItem* item = kanban_card_item_new(record->title, record->revealed, description);
+
+  if (record->id)
+    item->id = record->id;
+
+  item->encoded = g_steal_pointer(&record->encoded);
+
+  if (description == NULL && item->encoded)
+    g_clear_pointer(&item->description, kanban_unserialized_content_free);
+
+  return item;
+}
+
+/* The id the card keeps across saves, see kanban-board-file.h */
+guint64
+kanban_card_item_get_id(KanbanCardItem* item)
+{
+  return item->id;
+}
+
+/* Gives the card a new id, for a copy to be told apart from the original.
+ * Columns index their cards by id, so only while it is in none */
+void
+kanban_card_item_renew_id(KanbanCardItem* item)
+{
+  g_return_if_fail(item->column == NULL);
+
+  item->id = kanban_card_id_new();
+  invalidate(item);
+}
+
+const gchar*
+kanban_card_item_get_title(KanbanCardItem* item)
+{
+  return item->title;
+}
+
+void
+kanban_card_item_set_title(KanbanCardItem* item, const gchar* title)
+{
+  if (g_strcmp0(item->title, title) == 0)
+    return;
+
+  g_free(item->title);
+  item->title = g_strdup(title ? title : "");
+  invalidate(item);
+}
+
+gboolean
+kanban_card_item_get_revealed(KanbanCardItem* item)
+{
+  return item->revealed;
+}
+
+/* Expanding a card is not an edit, the flag is saved along with the
+ * next change to its column */
+void
+kanban_card_item_set_revealed(KanbanCardItem* item, gboolean revealed)
+{
+  item->revealed = !!revealed;
+}
+
+/* The description stays owned by the item */
+const KanbanUnserializedContent*
+kanban_card_item_get_description(KanbanCardItem* item)
+{
+  if (item->description == NULL)
+    item->description = decode_description(item->encoded);
+
+  if (item->stale && item->source) {
+    kanban_unserialized_content_free(item->description);
+    item->description = item->source(item->source_data);
+    item->stale       = FALSE;
+  }
+
+  return item->description;
+}
+
+/* Takes ownership of description */
+void
+kanban_card_item_set_description(KanbanCardItem* item,
+                                 KanbanUnserializedContent* description)
+{
+  kanban_unserialized_content_free(item->description);
+  item->description = description ? description : kanban_unserialized_content_new();
+  item->stale       = FALSE;
+  invalidate(item);
+}
+
+/*
+ * Registers the widget editing the description, the description it had
+ * is pulled from it before it goes. Pass a NULL source to unregister.
+ * */
+void
+kanban_card_item_set_source(KanbanCardItem* item, KanbanCardItemSource source,
+                            gpointer user_data)
+{
+  if (item->stale && item->source)
+    kanban_card_item_get_description(item);
+
+  item->source      = source;
+  item->source_data = user_data;
+  item->stale       = FALSE;
+}
+
+/* Tells the item its source has a new description */
+void
+kanban_card_item_description_changed(KanbanCardItem* item)
+{
+  item->stale = item->source != NULL;
+  invalidate(item);
+}
+
+/*
+ * kanban_card_item_get_encoded returns the card as written in the board
+ * file, it is only encoded again after the card changed
+ *
+ * the user must unref the returned pointer with g_bytes_unref() */
+GBytes*
+kanban_card_item_get_encoded(KanbanCardItem* item)
+{
+  if (item->encoded && item->encoded_revealed != item->revealed) {
+    GBytes* patched = kanban_card_encoded_set_revealed(item->encoded, item->revealed);
+
+    /* Encoded again below when the flag can't be found */
+    if (patched == NULL && item->description == NULL)
+      item->description = decode_description(item->encoded);
+
+    g_bytes_unref(item->encoded);
+    item->encoded = patched;
+  }
+
+  if (item->encoded == NULL) {
+    KanbanCardRecord record = {
+      .id          = item->id,
+      .title       = item->title,
+      .revealed    = item->revealed,
+      .description = (KanbanUnserializedContent*)kanban_card_item_get_description(item),
+    };
+
+    item->encoded = kanban_card_record_encode(&record);
+  }
+
+  item->encoded_revealed = item->revealed;
+  return g_bytes_ref(item->encoded);
+}
+
+/* A record carrying the encoded card, release it with kanban_card_record_free() */
+KanbanCardRecord*
+kanban_card_item_get_record(KanbanCardItem* item)
+{
+  GBytes* encoded = kanban_card_item_get_encoded(item);
+  KanbanCardRecord* record = kanban_card_record_new_encoded(item->title, item->revealed,
+                                                            encoded);
+
+  record->id = item->id;
+  g_bytes_unref(encoded);
+  return record;
+}
+
+gpointer
+kanban_card_item_get_column(KanbanCardItem* item)
+{
+  return item->column;
+}
+
+void
+kanban_card_item_set_column(KanbanCardItem* item, gpointer column)
+{
+  item->column = column;
+}
+
+/* Tells whether the card changed since kanban_card_item_clear_dirty() */
+gboolean
+kanban_card_item_get_dirty(KanbanCardItem* item)
+{
+  return item->dirty;
+}
+
+void
+kanban_card_item_clear_dirty(KanbanCardItem* item)
+{
+  item->dirty = FALSE;
+}
+
+static void
+kanban_card_item_finalize(GObject* object)
+{
+  KanbanCardItem* self = KANBAN_CARD_ITEM(object);
+
+  g_free(self->title);
+  kanban_unserialized_content_free(self->description);
+  g_clear_pointer(&self->encoded, g_bytes_unref);
+
+  G_OBJECT_CLASS(kanban_card_item_parent_class)->finalize(object);
+}
+
+static void
+kanban_card_item_class_init(KanbanCardItemClass* klass)
+{
+  G_OBJECT_CLASS(klass)->finalize = kanban_card_item_finalize;
+
+  SIGNAL_CHANGED = g_signal_new("changed", G_TYPE_FROM_CLASS(klass),
+                                G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE | G_SIGNAL_NO_HOOKS,
+                                0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+}
+
+static void
+kanban_card_item_init(KanbanCardItem* self)
+{
+  self->dirty = TRUE;
+}
@@ -0,0 +1,105 @@
+/* kanban-card-item.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "kanban-board-file.h"
+
+G_BEGIN_DECLS
+
+/*
+ * A card of the board, independent of any widget. KanbanCard widgets are
+ * bound to items as they scroll into view and let go of them after.
+ *
+ * While a widget edits the description it registers a source, the item
+ * pulls the description from it when it is asked for, so keystrokes
+ * only mark the item stale.
+ * */
+#define KANBAN_TYPE_CARD_ITEM (kanban_card_item_get_type())
+
+G_DECLARE_FINAL_TYPE (KanbanCardItem, kanban_card_item, KANBAN, CARD_ITEM, GObject)
+
+typedef KanbanUnserializedContent* (*KanbanCardItemSource)(gpointer user_data);
+
+/* Takes ownership of description */
+KanbanCardItem*
+kanban_card_item_new(const gchar* title, gboolean revealed,
+                     KanbanUnserializedContent* description);
+
+KanbanCardItem*
+kanban_card_item_new_from_record(const KanbanCardRecord* record);
+
+KanbanCardItem*
+kanban_card_item_new_take_record(KanbanCardRecord* record);
+
+guint64
+kanban_card_item_get_id(KanbanCardItem* item);
+
+void
+kanban_card_item_renew_id(KanbanCardItem* item);
+
+const gchar*
+kanban_card_item_get_title(KanbanCardItem* item);
+
+void
+kanban_card_item_set_title(KanbanCardItem* item, const gchar* title);
+
+gboolean
+kanban_card_item_get_revealed(KanbanCardItem* item);
+
+void
+kanban_card_item_set_revealed(KanbanCardItem* item, gboolean revealed);
+
+const KanbanUnserializedContent*
+kanban_card_item_get_description(KanbanCardItem* item);
+
+void
+kanban_card_item_set_description(KanbanCardItem* item,
+                                 KanbanUnserializedContent* description);
+
+void
+kanban_card_item_set_source(KanbanCardItem* item, KanbanCardItemSource source,
+                            gpointer user_data);
+
+void
+kanban_card_item_description_changed(KanbanCardItem* item);
+
+GBytes*
+kanban_card_item_get_encoded(KanbanCardItem* item);
+
+KanbanCardRecord*
+kanban_card_item_get_record(KanbanCardItem* item);
+
+gpointer
+kanban_card_item_get_column(KanbanCardItem* item);
+
+void
+kanban_card_item_set_column(KanbanCardItem* item, gpointer column);
+
+gboolean
+kanban_card_item_get_dirty(KanbanCardItem* item);
+
+void
+kanban_card_item_clear_dirty(KanbanCardItem* item);
+
+G_END_DECLS
@@ -0,0 +1,422 @@
+/* kanban-column-item.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "kanban-column-item.h"
+
+/*
+ * The cards are kept in slots indexed by card id. A slot remembers its
+ * position, positions from stale_from on are renumbered the next time
+ * one of them is asked for, so moving cards around never scans the
+ * column more than once per lookup after an edit
+ * */
+typedef struct
+{
+  guint64         id;
+  guint           position;
+  KanbanCardItem* card;
+} CardSlot;
+
+struct _KanbanColumnItem
+{
+  GObject     parent_instance;
+
+  gchar*      title;
+  gchar*      shard;
+  GPtrArray*  cards;  /* CardSlot */
+  GHashTable* index;  /* id -> CardSlot */
+  guint       stale_from;
+  gboolean    dirty;
+};
+
+static guint SIGNAL_CARD_INSERTED = 0;
+static guint SIGNAL_CARD_REMOVED  = 0;
+static guint SIGNAL_CARD_CHANGED  = 0;
+static guint SIGNAL_TITLE_CHANGED = 0;
+
+enum {
+  PROP_0,
+  PROP_DIRTY,
+  N_PROPS
+};
+
+static GParamSpec* properties[N_PROPS];
+
+static void kanban_column_item_list_model_init(GListModelInterface* iface);
+
+#define CARD_AT(column, position) \
+  (((CardSlot*)g_ptr_array_index((column)->cards, (position)))->card)
+
+/* Only notifies when the column goes from clean to dirty or back, so
+ * further edits cost nothing */
+static void
+set_dirty(KanbanColumnItem* column, gboolean dirty)
+{
+  if (column->dirty == dirty)
+    return;
+
+  column->dirty = dirty;
+  g_object_notify_by_pspec(G_OBJECT(column), properties[PROP_DIRTY]);
+}
+
+static void
+card_slot_free(CardSlot* slot)
+{
+  g_object_unref(slot->card);
+  g_free(slot);
+}
+
+G_DEFINE_FINAL_TYPE_WITH_CODE (KanbanColumnItem, kanban_column_item, G_TYPE_OBJECT,
+                               G_IMPLEMENT_INTERFACE (G_TYPE_LIST_MODEL,
+                                                      kanban_column_item_list_model_init))
+
+static GType
+get_item_type(GListModel* model)
+{
+  return KANBAN_TYPE_CARD_ITEM;
+}
+
+static guint
+get_n_items(GListModel* model)
+{
+  return KANBAN_COLUMN_ITEM(model)->cards->len;
+}
+
+static gpointer
+get_item(GListModel* model, guint position)
+{
+  KanbanColumnItem* self = KANBAN_COLUMN_ITEM(model);
+
+  if (position >= self->cards->len)
+    return NULL;
+
+  return g_object_ref(CARD_AT(self, position));
+}
+
+static void
+kanban_column_item_list_model_init(GListModelInterface* iface)
+{
+  iface->get_item_type = get_item_type;
+  iface->get_n_items   = get_n_items;
+  iface->get_item      = get_item;
+}
+
+KanbanColumnItem*
+kanban_column_item_new(const gchar* title)
+{
+  KanbanColumnItem* column = g_object_new(KANBAN_TYPE_COLUMN_ITEM, NULL);
+
+  column->title = g_strdup(title ? title : "");
+
+  return column;
+}
+
+/* Columns read back from their shard are not written again until they change */
+KanbanColumnItem*
+kanban_column_item_new_from_record(const KanbanColumnRecord* record)
+{
+  KanbanColumnItem* column = kanban_column_item_new(record->title);
+
+  for (guint i = 0; i < record->cards->len; i++) {
+    KanbanCardItem* card = kanban_card_item_new_from_record(g_ptr_array_index(record->cards, i));
+
+    kanban_column_item_append(column, card);
+    g_object_unref(card);
+  }
+
+  if (record->shard)
+    kanban_column_item_set_shard(column, record->shard);
+  if (!record->dirty)
+    kanban_column_item_clear_dirty(column);
+
+  return column;
+}
+
+const gchar*
+kanban_column_item_get_title(KanbanColumnItem* column)
+{
+  return column->title;
+}
+
+void
+kanban_column_item_set_title(KanbanColumnItem* column, const gchar* title)
+{
+  if (g_strcmp0(column->title, title) == 0)
+    return;
+
+  g_free(column->title);
+  column->title = g_strdup(title ? title : "");
+  set_dirty(column, TRUE);
+  g_signal_emit(column, SIGNAL_TITLE_CHANGED, 0);
+}
+
+/* The file holding this column within a sharded board */
+const gchar*
+kanban_column_item_get_shard(KanbanColumnItem* column)
+{
+  return column->shard;
+}
+
+void
+kanban_column_item_set_shard(KanbanColumnItem* column, const gchar* shard)
+{
+  g_free(column->shard);
+  column->shard = g_strdup(shard);
+}
+
+/* Returns a borrowed pointer, unlike g_list_model_get_item() */
+KanbanCardItem*
+kanban_column_item_get_card(KanbanColumnItem* column, guint position)
+{
+  g_return_val_if_fail(position < column->cards->len, NULL);
+
+  return CARD_AT(column, position);
+}
+
+/* Returns a borrowed pointer to the card with id, or NULL */
+KanbanCardItem*
+kanban_column_item_lookup(KanbanColumnItem* column, guint64 id)
+{
+  CardSlot* slot = g_hash_table_lookup(column->index, &id);
+
+  return slot ? slot->card : NULL;
+}
+
+static void
+renumber(KanbanColumnItem* column)
+{
+  for (guint i = column->stale_from; i < column->cards->len; i++)
+    ((CardSlot*)g_ptr_array_index(column->cards, i))->position = i;
+
+  column->stale_from = G_MAXUINT;
+}
+
+gint
+kanban_column_item_get_position(KanbanColumnItem* column, KanbanCardItem* card)
+{
+  guint64   id   = kanban_card_item_get_id(card);
+  CardSlot* slot = g_hash_table_lookup(column->index, &id);
+
+  if (slot == NULL || slot->card != card)
+    return -1;
+
+  if (slot->position >= column->stale_from)
+    renumber(column);
+
+  return slot->position;
+}
+
+static void
+card_changed(KanbanCardItem* card, gpointer user_data)
+{
+  set_dirty(user_data, TRUE);
+  g_signal_emit(user_data, SIGNAL_CARD_CHANGED, 0, card);
+}
+
+void
+kanban_column_item_insert(KanbanColumnItem* column, guint position, KanbanCardItem* card)
+{
+  g_return_if_fail(kanban_card_item_get_column(card) == NULL);
+
+  CardSlot* slot;
+  guint64   id = kanban_card_item_get_id(card);
+
+  /* A card copied from another one, or from a hand edited file */
+  if (g_hash_table_contains(column->index, &id))
+    kanban_card_item_renew_id(card);
+
+  position = MIN(position, column->cards->len);
+
+  slot = g_new(CardSlot, 1);
+  slot->id       = kanban_card_item_get_id(card);
+  slot->position = position;
+  slot->card     = g_object_ref(card);
+
+  g_ptr_array_insert(column->cards, position, slot);
+  g_hash_table_insert(column->index, &slot->id, slot);
+  /* The cards after it moved up one, their slots still hold the
+   * positions they had, from this one on */
+  if (position + 1 < column->cards->len)
+    column->stale_from = MIN(column->stale_from, position);
+
+  kanban_card_item_set_column(card, column);
+  g_signal_connect(card, "changed", G_CALLBACK(card_changed), column);
+  set_dirty(column, TRUE);
+
+  g_list_model_items_changed(G_LIST_MODEL(column), position, 0, 1);
+  g_signal_emit(column, SIGNAL_CARD_INSERTED, 0, card, position);
+}
+
+void
+kanban_column_item_append(KanbanColumnItem* column, KanbanCardItem* card)
+{
+  kanban_column_item_insert(column, column->cards->len, card);
+}
+
+void
+kanban_column_item_remove(KanbanColumnItem* column, guint position)
+{
+  g_return_if_fail(position < column->cards->len);
+
+  CardSlot*       slot = g_ptr_array_steal_index(column->cards, position);
+  KanbanCardItem* card = slot->card;
+
+  g_hash_table_remove(column->index, &slot->id);
+  g_free(slot);
+  if (position < column->cards->len)
+    column->stale_from = MIN(column->stale_from, position);
+
+  g_signal_handlers_disconnect_by_func(card, card_changed, column);
+  kanban_card_item_set_column(card, NULL);
+  set_dirty(column, TRUE);
+
+  g_list_model_items_changed(G_LIST_MODEL(column), position, 1, 0);
+  g_signal_emit(column, SIGNAL_CARD_REMOVED, 0, position);
+  g_object_unref(card);
+}
+
+/* Tells whether the column or any of its cards changed since the last
+ * kanban_column_item_clear_dirty(), also the "dirty" property */
+gboolean
+kanban_column_item_get_dirty(KanbanColumnItem* column)
+{
+  return column->dirty;
+}
+
+void
+kanban_column_item_mark_dirty(KanbanColumnItem* column)
+{
+  set_dirty(column, TRUE);
+}
+
+void
+kanban_column_item_clear_dirty(KanbanColumnItem* column)
+{
+  set_dirty(column, FALSE);
+
+  for (guint i = 0; i < column->cards->len; i++)
+    kanban_card_item_clear_dirty(CARD_AT(column, i));
+}
+
+/* Cards carry their encoded form, release it with kanban_column_record_free() */
+KanbanColumnRecord*
+kanban_column_item_get_record(KanbanColumnItem* column)
+{
+  KanbanColumnRecord* record = kanban_column_record_new(column->title);
+
+  record->shard = g_strdup(column->shard);
+  record->dirty = kanban_column_item_get_dirty(column);
+
+  for (guint i = 0; i < column->cards->len; i++)
+    g_ptr_array_add(record->cards,
+                    kanban_card_item_get_record(CARD_AT(column, i)));
+
+  return record;
+}
+
+static void
+kanban_column_item_dispose(GObject* object)
+{
+  KanbanColumnItem* self = KANBAN_COLUMN_ITEM(object);
+
+  for (guint i = 0; i < self->cards->len; i++) {
+    KanbanCardItem* card = CARD_AT(self, i);
+
+    g_signal_handlers_disconnect_by_func(card, card_changed, self);
+    kanban_card_item_set_column(card, NULL);
+  }
+  g_hash_table_remove_all(self->index);
+  g_ptr_array_set_size(self->cards, 0);
+
+  G_OBJECT_CLASS(kanban_column_item_parent_class)->dispose(object);
+}
+
+static void
+kanban_column_item_finalize(GObject* object)
+{
+  KanbanColumnItem* self = KANBAN_COLUMN_ITEM(object);
+
+  g_free(self->title);
+  g_free(self->shard);
+  g_hash_table_unref(self->index);
+  g_ptr_array_unref(self->cards);
+
+  G_OBJECT_CLASS(kanban_column_item_parent_class)->finalize(object);
+}
+
+static void
+kanban_column_item_get_property(GObject* object, guint property_id, GValue* value,
+                                GParamSpec* pspec)
+{
+  KanbanColumnItem* self = KANBAN_COLUMN_ITEM(object);
+
+  switch (property_id) {
+    case PROP_DIRTY:
+      g_value_set_boolean(value, self->dirty);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+  }
+}
+
+static void
+kanban_column_item_class_init(KanbanColumnItemClass* klass)
+{
+  GObjectClass* object_class = G_OBJECT_CLASS(klass);
+
+  object_class->dispose      = kanban_column_item_dispose;
+  object_class->finalize     = kanban_column_item_finalize;
+  object_class->get_property = kanban_column_item_get_property;
+
+  properties[PROP_DIRTY] =
+    g_param_spec_boolean("dirty", NULL, NULL, TRUE,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_properties(object_class, N_PROPS, properties);
+
+  SIGNAL_CARD_INSERTED =
+    g_signal_new("card-inserted", G_TYPE_FROM_CLASS(klass),
+                 G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE | G_SIGNAL_NO_HOOKS,
+                 0, NULL, NULL, NULL, G_TYPE_NONE, 2, KANBAN_TYPE_CARD_ITEM, G_TYPE_UINT);
+
+  SIGNAL_CARD_REMOVED =
+    g_signal_new("card-removed", G_TYPE_FROM_CLASS(klass),
+                 G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE | G_SIGNAL_NO_HOOKS,
+                 0, NULL, NULL, NULL, G_TYPE_NONE, 1, G_TYPE_UINT);
+
+  SIGNAL_CARD_CHANGED =
+    g_signal_new("card-changed", G_TYPE_FROM_CLASS(klass),
+                 G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE | G_SIGNAL_NO_HOOKS,
+                 0, NULL, NULL, NULL, G_TYPE_NONE, 1, KANBAN_TYPE_CARD_ITEM);
+
+  SIGNAL_TITLE_CHANGED =
+    g_signal_new("title-changed", G_TYPE_FROM_CLASS(klass),
+                 G_SIGNAL_RUN_LAST | G_SIGNAL_NO_RECURSE | G_SIGNAL_NO_HOOKS,
+                 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+}
+
+static void
+kanban_column_item_init(KanbanColumnItem* self)
+{
+  self->cards = g_ptr_array_new_with_free_func((GDestroyNotify)card_slot_free);
+  self->index = g_hash_table_new(g_int64_hash, g_int64_equal);
+  self->stale_from = G_MAXUINT;
+  self->shard = kanban_board_shard_new_name();
+  self->dirty = TRUE;
+}
@@ -0,0 +1,92 @@
+/* kanban-column-item.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "kanban-card-item.h"
+
+G_BEGIN_DECLS
+
+/*
+ * A column of the board: its title, the shard it is kept in and its
+ * cards, as a GListModel of KanbanCardItem. Cards are indexed by id,
+ * finding a card or its position does not scan the column.
+ *
+ * Besides items-changed, edits are announced one by one for the journal:
+ * "card-inserted" (item, position), "card-removed" (position),
+ * "card-changed" (item) and "title-changed". The "dirty" property only
+ * changes when the column goes from saved to edited or back.
+ * */
+#define KANBAN_TYPE_COLUMN_ITEM (kanban_column_item_get_type())
+
+G_DECLARE_FINAL_TYPE (KanbanColumnItem, kanban_column_item, KANBAN, COLUMN_ITEM, GObject)
+
+KanbanColumnItem*
+kanban_column_item_new(const gchar* title);
+
+KanbanColumnItem*
+kanban_column_item_new_from_record(const KanbanColumnRecord* record);
+
+const gchar*
+kanban_column_item_get_title(KanbanColumnItem* column);
+
+void
+kanban_column_item_set_title(KanbanColumnItem* column, const gchar* title);
+
+const gchar*
+kanban_column_item_get_shard(KanbanColumnItem* column);
+
+void
+kanban_column_item_set_shard(KanbanColumnItem* column, const gchar* shard);
+
+KanbanCardItem*
+kanban_column_item_get_card(KanbanColumnItem* column, guint position);
+
+KanbanCardItem*
+kanban_column_item_lookup(KanbanColumnItem* column, guint64 id);
+
+gint
+kanban_column_item_get_position(KanbanColumnItem* column, KanbanCardItem* card);
+
+void
+kanban_column_item_insert(KanbanColumnItem* column, guint position, KanbanCardItem* card);
+
+void
+kanban_column_item_append(KanbanColumnItem* column, KanbanCardItem* card);
+
+void
+kanban_column_item_remove(KanbanColumnItem* column, guint position);
+
+gboolean
+kanban_column_item_get_dirty(KanbanColumnItem* column);
+
+void
+kanban_column_item_mark_dirty(KanbanColumnItem* column);
+
+void
+kanban_column_item_clear_dirty(KanbanColumnItem* column);
+
+KanbanColumnRecord*
+kanban_column_item_get_record(KanbanColumnItem* column);
+
+G_END_DECLS
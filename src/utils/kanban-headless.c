@@ -0,0 +1,447 @@
+/* kanban-headless.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "kanban-headless.h"
+#include "kanban-board-file.h"
+#include "kanban-journal.h"
+#include "kanban-trace.h"
+
+typedef struct
+{
+  const gchar* name;
+  guint        min_args;
+  guint        max_args;  /* 0 for any number */
+  gboolean   (*run)(gchar** args, guint n_args);
+} HeadlessCommand;
+
+static void
+collect_column(KanbanColumnRecord* column, gpointer user_data)
+{
+  KanbanBoardRecord* board = user_data;
+
+  g_ptr_array_add(board->columns, column);
+}
+
+/*
+ * Reads the board at path: a board directory, with the edits in its
+ * journal replayed, or a board file, left in the layout it is in. Either
+ * is left as it is on disk, snapshots included, for commands to be run
+ * on boards in use. replayed is set to the number of journal entries
+ * applied
+ * */
+static KanbanBoardRecord*
+load_board(const gchar* path, guint* replayed, GError** error)
+{
+  KanbanBoardRecord* board;
+
+  if (replayed)
+    *replayed = 0;
+
+  if (g_file_test(path, G_FILE_TEST_IS_DIR))
+  {
+    board = kanban_board_record_new();
+
+    if (!kanban_board_dir_read(path, TRUE, &board->journal, collect_column, board, NULL,
+                               error) ||
+        !kanban_journal_replay(path, board, replayed, error))
+      g_clear_pointer(&board, kanban_board_record_free);
+
+    return board;
+  }
+
+  board = kanban_board_record_new();
+
+  if (!kanban_board_file_read(path, NULL, collect_column, board, NULL, error))
+    g_clear_pointer(&board, kanban_board_record_free);
+
+  return board;
+}
+
+/* Cards read from snapshots only carry their encoded form. Returns how
+ * many could not be decoded, they are left with an empty description */
+static guint
+decode_cards(KanbanBoardRecord* board, const gchar* path)
+{
+  JsonParser* parser = json_parser_new();
+  guint       failed = 0;
+
+  for (guint i = 0; i < board->columns->len; i++)
+  {
+    KanbanColumnRecord* column = g_ptr_array_index(board->columns, i);
+
+    for (guint j = 0; j < column->cards->len; j++)
+    {
+      KanbanCardRecord* card  = g_ptr_array_index(column->cards, j);
+      GError*           error = NULL;
+
+      if (card->description)
+        continue;
+
+      if (!kanban_card_record_decode(card, parser, NULL, &error))
+      {
+        g_printerr("%s: card %u of column \"%s\": %s\n", path, j, column->title,
+                   error->message);
+        g_error_free(error);
+
+        card->description = kanban_unserialized_content_new();
+        failed++;
+      }
+    }
+  }
+
+  g_object_unref(parser);
+  return failed;
+}
+
+/*
+ * Writes every column of board to the board directory at dir_path, as a
+ * save from the window would: the generations of its journal so far are
+ * part of board and removed once it is written
+ * */
+static gboolean
+rewrite_dir(KanbanBoardRecord* board, const gchar* dir_path, GError** error)
+{
+  KanbanJournal* journal = kanban_journal_open(dir_path, board->journal, error);
+
+  if (journal == NULL)
+    return FALSE;
+
+  board->journal = kanban_journal_get_generation(journal) + 1;
+  gboolean success = kanban_journal_rotate(journal, error);
+  kanban_journal_close(journal);
+
+  if (!success)
+    return FALSE;
+
+  for (guint i = 0; i < board->columns->len; i++)
+  {
+    KanbanColumnRecord* column = g_ptr_array_index(board->columns, i);
+
+    if (column->shard == NULL)
+      column->shard = kanban_board_shard_new_name();
+    column->dirty = TRUE;
+  }
+
+  if (!kanban_board_dir_save(board, dir_path, error))
+    return FALSE;
+
+  kanban_journal_remove_before(dir_path, board->journal);
+  return TRUE;
+}
+
+static gboolean
+print_stats(const gchar* path)
+{
+  GError*            error    = NULL;
+  guint              replayed = 0;
+  KanbanBoardRecord* board    = load_board(path, &replayed, &error);
+
+  if (board == NULL)
+  {
+    g_printerr("%s: %s\n", path, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  guint cards = 0, tasks = 0, done = 0;
+
+  decode_cards(board, path);
+
+  for (guint i = 0; i < board->columns->len; i++)
+  {
+    KanbanColumnRecord* column = g_ptr_array_index(board->columns, i);
+
+    cards += column->cards->len;
+
+    for (guint j = 0; j < column->cards->len; j++)
+    {
+      KanbanCardRecord* card    = g_ptr_array_index(column->cards, j);
+      GArray*           anchors = card->description->anchors;
+
+      tasks += anchors->len;
+      for (guint k = 0; k < anchors->len; k++)
+        done += g_array_index(anchors, KanbanAnchor, k).done;
+    }
+  }
+
+  GString* out = g_string_new("{\"board\":");
+
+  kanban_json_append_string(out, path, -1);
+  g_string_append_printf(out, ",\"columns\":%u,\"cards\":%u,\"tasks\":%u,\"done\":%u,"
+                         "\"journaled\":%u}\n",
+                         board->columns->len, cards, tasks, done, replayed);
+  fputs(out->str, stdout);
+
+  g_string_free(out, TRUE);
+  kanban_board_record_free(board);
+
+  return TRUE;
+}
+
+static gboolean
+run_stats(gchar** args, guint n_args)
+{
+  gboolean success = TRUE;
+
+  for (guint i = 0; i < n_args; i++)
+    success &= print_stats(args[i]);
+
+  return success;
+}
+
+/* The loaders warn about what they skip, a shard or a journal entry
+ * that can't be read for instance, from any thread */
+static void
+count_warning(const gchar* log_domain, GLogLevelFlags log_level, const gchar* message,
+              gpointer user_data)
+{
+  g_atomic_int_inc((gint*)user_data);
+  g_log_default_handler(log_domain, log_level, message, NULL);
+}
+
+static gboolean
+validate_board(const gchar* path)
+{
+  GError*            error    = NULL;
+  gint               warnings = 0;
+  guint              handler  = g_log_set_handler(NULL, G_LOG_LEVEL_WARNING | G_LOG_LEVEL_CRITICAL,
+                                                  count_warning, &warnings);
+  KanbanBoardRecord* board    = load_board(path, NULL, &error);
+
+  g_log_remove_handler(NULL, handler);
+
+  if (board == NULL)
+  {
+    g_printerr("%s: %s\n", path, error->message);
+    g_error_free(error);
+    return FALSE;
+  }
+
+  guint       problems = warnings + decode_cards(board, path);
+  GHashTable* ids      = g_hash_table_new(g_int64_hash, g_int64_equal);
+
+  for (guint i = 0; i < board->columns->len; i++)
+  {
+    KanbanColumnRecord* column = g_ptr_array_index(board->columns, i);
+
+    for (guint j = 0; j < column->cards->len; j++)
+    {
+      KanbanCardRecord* card = g_ptr_array_index(column->cards, j);
+
+      if (!g_hash_table_add(ids, &card->id))
+      {
+        g_printerr("%s: card %u of column \"%s\" has the id of another card, %"
+                   G_GUINT64_FORMAT "\n", path, j, column->title, card->id);
+        problems++;
+      }
+    }
+  }
+
+  if (problems)
+    g_printerr("%s: %u problem%s\n", path, problems, problems > 1 ? "s" : "");
+  else
+    g_print("%s: ok\n", path);
+
+  g_hash_table_unref(ids);
+  kanban_board_record_free(board);
+
+  return problems == 0;
+}
+
+static gboolean
+run_validate(gchar** args, guint n_args)
+{
+  gboolean success = TRUE;
+
+  for (guint i = 0; i < n_args; i++)
+    success &= validate_board(args[i]);
+
+  return success;
+}
+
+static gboolean
+run_export(gchar** args, guint n_args)
+{
+  GError*            error   = NULL;
+  KanbanBoardRecord* board   = load_board(args[0], NULL, &error);
+  gboolean           success = board != NULL;
+
+  if (success && g_strcmp0(args[1], "-") == 0)
+  {
+    gsize  length = 0;
+    gchar* data   = kanban_board_record_to_data(board, &length);
+
+    success = fwrite(data, 1, length, stdout) == length && fflush(stdout) == 0;
+    if (!success)
+      g_set_error_literal(&error, G_IO_ERROR, G_IO_ERROR_FAILED, "Failed to write to stdout");
+
+    g_free(data);
+  }
+  else if (success)
+    success = kanban_board_file_save(board, args[1], &error);
+
+  if (!success)
+  {
+    g_printerr("%s: %s\n", args[0], error->message);
+    g_error_free(error);
+  }
+
+  g_clear_pointer(&board, kanban_board_record_free);
+  return success;
+}
+
+static gboolean
+run_import(gchar** args, guint n_args)
+{
+  GError*            error   = NULL;
+  KanbanBoardRecord* board   = load_board(args[0], NULL, &error);
+  gboolean           success = board != NULL;
+
+  /* The board in the directory is replaced, its journal along with it */
+  if (success)
+  {
+    board->journal = 0;
+    success = rewrite_dir(board, args[1], &error);
+  }
+
+  if (!success)
+  {
+    g_printerr("%s: %s\n", board ? args[1] : args[0], error->message);
+    g_error_free(error);
+  }
+
+  g_clear_pointer(&board, kanban_board_record_free);
+  return success;
+}
+
+static gboolean
+run_compact(gchar** args, guint n_args)
+{
+  GError*            error   = NULL;
+  KanbanBoardRecord* board   = load_board(args[0], NULL, &error);
+  gboolean           success = board != NULL;
+
+  if (success && g_file_test(args[0], G_FILE_TEST_IS_DIR))
+    success = rewrite_dir(board, args[0], &error);
+  else if (success)
+    success = kanban_board_file_save(board, args[0], &error);
+
+  if (!success)
+  {
+    g_printerr("%s: %s\n", args[0], error->message);
+    g_error_free(error);
+  }
+
+  g_clear_pointer(&board, kanban_board_record_free);
+  return success;
+}
+
+static const HeadlessCommand commands[] = {
+  { "stats",    1, 0, run_stats },
+  { "validate", 1, 0, run_validate },
+  { "export",   2, 2, run_export },
+  { "import",   2, 2, run_import },
+  { "compact",  1, 1, run_compact },
+};
+
+/* Whether argv asks for a headless command, before "--" if any */
+gboolean
+kanban_headless_requested(int argc, char* argv[])
+{
+  for (int i = 1; i < argc && g_strcmp0(argv[i], "--") != 0; i++)
+  {
+    if (g_strcmp0(argv[i], KANBAN_HEADLESS_OPTION) == 0)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * kanban_headless_run runs the command in argv, which holds
+ * KANBAN_HEADLESS_OPTION, and returns the exit status. GTK is never
+ * initialized.
+ * */
+int
+kanban_headless_run(int argc, char* argv[])
+{
+  gboolean     headless   = FALSE;
+  gchar*       trace_path = NULL;
+  GOptionEntry entries[] = {
+    { "headless", 0, 0, G_OPTION_ARG_NONE, &headless, "Run COMMAND without a window", NULL },
+    { "trace", 0, 0, G_OPTION_ARG_FILENAME, &trace_path,
+      "Record a trace to FILE on exit, to open in Perfetto", "FILE" },
+    { NULL }
+  };
+  GOptionContext* context = g_option_context_new("COMMAND [ARGUMENT…]");
+  GError*         error   = NULL;
+  int             status  = EXIT_FAILURE;
+
+  g_option_context_add_main_entries(context, entries, NULL);
+  g_option_context_set_summary(context,
+    "Commands:\n"
+    "  stats BOARD…        Print the size of each board, one JSON object per line\n"
+    "  validate BOARD…     Check that each board reads without problems\n"
+    "  export BOARD FILE   Write BOARD as a single board file, - for stdout\n"
+    "  import FILE DIR     Replace the board in the directory DIR with FILE\n"
+    "  compact BOARD       Fold the journal in and rewrite every column\n"
+    "\n"
+    "BOARD is a board directory or a board file.");
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    g_option_context_free(context);
+    return status;
+  }
+
+  /* Written by main() once the command is done, as for the window */
+  if (trace_path)
+    kanban_trace_start(trace_path, 0);
+  g_free(trace_path);
+
+  const HeadlessCommand* command = NULL;
+
+  for (guint i = 0; argc > 1 && i < G_N_ELEMENTS(commands); i++)
+  {
+    if (g_strcmp0(argv[1], commands[i].name) == 0)
+      command = &commands[i];
+  }
+
+  guint n_args = argc > 2 ? argc - 2 : 0;
+
+  if (command == NULL || n_args < command->min_args ||
+      (command->max_args && n_args > command->max_args))
+  {
+    gchar* help = g_option_context_get_help(context, TRUE, NULL);
+
+    g_printerr("%s", help);
+    g_free(help);
+  }
+  else if (command->run(argv + 2, n_args))
+    status = EXIT_SUCCESS;
+
+  g_option_context_free(context);
+  return status;
+}
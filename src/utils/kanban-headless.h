@@ -0,0 +1,49 @@
+/* kanban-headless.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Batch operations on boards, run without a display nor any widget:
+ *
+ * thisweekinmylife --headless stats BOARD…       One JSON object per board
+ * thisweekinmylife --headless validate BOARD…    Fails when a board has problems
+ * thisweekinmylife --headless export BOARD FILE  Writes BOARD as a board file, - for stdout
+ * thisweekinmylife --headless import FILE DIR    Replaces the board in DIR with FILE
+ * thisweekinmylife --headless compact BOARD      Folds the journal in, rewrites every column
+ *
+ * BOARD is a board directory, whose journal is replayed, or a board file
+ * of any version. Boards are only read as they are on disk, compact
+ * rewrites them in the current layout. --trace=FILE records a trace of
+ * the command, see kanban-trace.h.
+ * */
+#define KANBAN_HEADLESS_OPTION "--headless"
+
+gboolean
+kanban_headless_requested(int argc, char* argv[]);
+
+int
+kanban_headless_run(int argc, char* argv[]);
+
+G_END_DECLS
@@ -0,0 +1,552 @@
+/* kanban-journal.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "kanban-journal.h"
+#include "kanban-trace.h"
+
+struct _KanbanJournal
+{
+  gchar*         dir_path;
+  guint          generation;
+  GOutputStream* stream;
+  goffset        size;
+};
+
+static gchar*
+generation_path(const gchar* dir_path, guint generation)
+{
+  gchar* name = g_strdup_printf(KANBAN_JOURNAL_PREFIX "%u.jsonl", generation);
+  gchar* path = g_build_filename(dir_path, name, NULL);
+
+  g_free(name);
+  return path;
+}
+
+static gint
+compare_generations(gconstpointer a, gconstpointer b)
+{
+  guint x = *(const guint*)a, y = *(const guint*)b;
+  return (x > y) - (x < y);
+}
+
+/* Returns the generations found in dir_path, oldest first */
+static GArray*
+list_generations(const gchar* dir_path)
+{
+  GArray* generations = g_array_new(FALSE, FALSE, sizeof(guint));
+  GDir*   dir = g_dir_open(dir_path, 0, NULL);
+  const gchar* name;
+
+  if (dir == NULL)
+    return generations;
+
+  while ((name = g_dir_read_name(dir)) != NULL)
+  {
+    if (!g_str_has_prefix(name, KANBAN_JOURNAL_PREFIX))
+      continue;
+
+    const gchar* number = name + strlen(KANBAN_JOURNAL_PREFIX);
+    gchar*       end    = NULL;
+
+    if (!g_ascii_isdigit(*number))
+      continue;
+
+    guint64 generation = g_ascii_strtoull(number, &end, 10);
+    if (g_strcmp0(end, ".jsonl") != 0 || generation > G_MAXUINT)
+      continue;
+
+    guint value = generation;
+    g_array_append_val(generations, value);
+  }
+
+  g_dir_close(dir);
+  g_array_sort(generations, compare_generations);
+
+  return generations;
+}
+
+static gboolean
+open_generation(KanbanJournal* journal, guint generation, GError** error)
+{
+  gchar* path = generation_path(journal->dir_path, generation);
+  GFile* file = g_file_new_for_path(path);
+  GFileOutputStream* stream = g_file_append_to(file, G_FILE_CREATE_PRIVATE, NULL, error);
+
+  g_free(path);
+
+  if (stream == NULL)
+  {
+    g_object_unref(file);
+    return FALSE;
+  }
+
+  GFileInfo* info = g_file_query_info(file, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                      G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+  if (journal->stream)
+  {
+    g_output_stream_close(journal->stream, NULL, NULL);
+    g_object_unref(journal->stream);
+  }
+
+  journal->generation = generation;
+  journal->stream     = G_OUTPUT_STREAM(stream);
+  journal->size       = info ? g_file_info_get_size(info) : 0;
+
+  g_clear_object(&info);
+  g_object_unref(file);
+
+  return TRUE;
+}
+
+/*
+ * kanban_journal_open continues the newest generation in dir_path, or
+ * starts generation when it is newer, creating the directory if needed
+ *
+ * release it with kanban_journal_close() */
+KanbanJournal*
+kanban_journal_open(const gchar* dir_path, guint generation, GError** error)
+{
+  if (g_mkdir_with_parents(dir_path, 0700) != 0)
+  {
+    int saved_errno = errno;
+    g_set_error(error, G_FILE_ERROR, g_file_error_from_errno(saved_errno),
+                "Failed to create %s: %s", dir_path, g_strerror(saved_errno));
+    return NULL;
+  }
+
+  GArray* generations = list_generations(dir_path);
+  if (generations->len)
+    generation = MAX(generation, g_array_index(generations, guint, generations->len - 1));
+  g_array_unref(generations);
+
+  KanbanJournal* journal = g_new0(KanbanJournal, 1);
+  journal->dir_path = g_strdup(dir_path);
+
+  if (!open_generation(journal, MAX(generation, 1), error))
+  {
+    kanban_journal_close(journal);
+    return NULL;
+  }
+
+  return journal;
+}
+
+void
+kanban_journal_close(KanbanJournal* journal)
+{
+  if (journal == NULL)
+    return;
+
+  if (journal->stream)
+  {
+    g_output_stream_close(journal->stream, NULL, NULL);
+    g_object_unref(journal->stream);
+  }
+
+  g_free(journal->dir_path);
+  g_free(journal);
+}
+
+/* Bytes in the current generation, zero when there is nothing to compact */
+goffset
+kanban_journal_get_size(KanbanJournal* journal)
+{
+  return journal->size;
+}
+
+guint
+kanban_journal_get_generation(KanbanJournal* journal)
+{
+  return journal->generation;
+}
+
+/*
+ * Starts a new generation, the edits recorded so far are expected to
+ * be part of the next saved board
+ * */
+gboolean
+kanban_journal_rotate(KanbanJournal* journal, GError** error)
+{
+  return open_generation(journal, journal->generation + 1, error);
+}
+
+/* Removes the generations older than generation, once they are saved */
+void
+kanban_journal_remove_before(const gchar* dir_path, guint generation)
+{
+  GArray* generations = list_generations(dir_path);
+
+  for (guint i = 0; i < generations->len; i++)
+  {
+    guint current = g_array_index(generations, guint, i);
+    if (current >= generation)
+      break;
+
+    gchar* path = generation_path(dir_path, current);
+    if (g_unlink(path) != 0)
+      g_warning("Failed to remove %s: %s", path, g_strerror(errno));
+    g_free(path);
+  }
+
+  g_array_unref(generations);
+}
+
+/* Drops every edit recorded so far, they will not be replayed */
+gboolean
+kanban_journal_discard(KanbanJournal* journal, GError** error)
+{
+  if (!kanban_journal_rotate(journal, error))
+    return FALSE;
+
+  kanban_journal_remove_before(journal->dir_path, journal->generation);
+  return TRUE;
+}
+
+static GString*
+entry_new(const gchar* op)
+{
+  GString* entry = g_string_new("{\"op\":");
+
+  kanban_json_append_string(entry, op, -1);
+  return entry;
+}
+
+static void
+entry_add_card(GString* entry, GBytes* card)
+{
+  gsize size = 0;
+  const gchar* data = g_bytes_get_data(card, &size);
+
+  g_string_append(entry, ",\"card\":");
+  g_string_append_len(entry, data, size);
+}
+
+/* Entries go out in a single write so a crash leaves at most the last
+ * line torn, which replay skips */
+static gboolean
+append_entry(KanbanJournal* journal, GString* entry, GError** error)
+{
+  gsize    written = 0;
+  gboolean success;
+
+  g_string_append(entry, "}\n");
+  success = g_output_stream_write_all(journal->stream, entry->str, entry->len,
+                                      &written, NULL, error);
+  journal->size += written;
+
+  g_string_free(entry, TRUE);
+  return success;
+}
+
+gboolean
+kanban_journal_add_column(KanbanJournal* journal, const gchar* title, GError** error)
+{
+  GString* entry = entry_new("add-column");
+
+  g_string_append(entry, ",\"title\":");
+  kanban_json_append_string(entry, title, -1);
+
+  return append_entry(journal, entry, error);
+}
+
+gboolean
+kanban_journal_rename_column(KanbanJournal* journal, guint column,
+                             const gchar* title, GError** error)
+{
+  GString* entry = entry_new("rename-column");
+
+  g_string_append_printf(entry, ",\"column\":%u,\"title\":", column);
+  kanban_json_append_string(entry, title, -1);
+
+  return append_entry(journal, entry, error);
+}
+
+gboolean
+kanban_journal_remove_column(KanbanJournal* journal, guint column, GError** error)
+{
+  GString* entry = entry_new("remove-column");
+
+  g_string_append_printf(entry, ",\"column\":%u", column);
+
+  return append_entry(journal, entry, error);
+}
+
+gboolean
+kanban_journal_insert_card(KanbanJournal* journal, guint column, guint index,
+                           GBytes* card, GError** error)
+{
+  GString* entry = entry_new("insert-card");
+
+  g_string_append_printf(entry, ",\"column\":%u,\"index\":%u", column, index);
+  entry_add_card(entry, card);
+
+  return append_entry(journal, entry, error);
+}
+
+gboolean
+kanban_journal_update_card(KanbanJournal* journal, guint column, guint index,
+                           GBytes* card, GError** error)
+{
+  GString* entry = entry_new("update-card");
+
+  g_string_append_printf(entry, ",\"column\":%u,\"index\":%u", column, index);
+  entry_add_card(entry, card);
+
+  return append_entry(journal, entry, error);
+}
+
+gboolean
+kanban_journal_remove_card(KanbanJournal* journal, guint column, guint index,
+                           GError** error)
+{
+  GString* entry = entry_new("remove-card");
+
+  g_string_append_printf(entry, ",\"column\":%u,\"index\":%u", column, index);
+
+  return append_entry(journal, entry, error);
+}
+
+/* Returns -1 when the member is missing or not an integer */
+static gint64
+get_index(JsonObject* entry, const gchar* name)
+{
+  JsonNode* node = json_object_get_member(entry, name);
+
+  if (node == NULL || !JSON_NODE_HOLDS_VALUE(node) ||
+      json_node_get_value_type(node) != G_TYPE_INT64)
+    return -1;
+
+  return json_node_get_int(node);
+}
+
+static const gchar*
+get_string(JsonObject* entry, const gchar* name)
+{
+  JsonNode* node = json_object_get_member(entry, name);
+
+  if (node == NULL || !JSON_NODE_HOLDS_VALUE(node) ||
+      json_node_get_value_type(node) != G_TYPE_STRING)
+    return NULL;
+
+  return json_node_get_string(node);
+}
+
+static KanbanColumnRecord*
+get_column(KanbanBoardRecord* board, JsonObject* entry)
+{
+  gint64 column = get_index(entry, "column");
+
+  if (column < 0 || column >= board->columns->len)
+    return NULL;
+
+  return g_ptr_array_index(board->columns, column);
+}
+
+static KanbanCardRecord*
+get_card(JsonObject* entry)
+{
+  JsonNode* node = json_object_get_member(entry, "card");
+
+  if (node == NULL || !JSON_NODE_HOLDS_OBJECT(node))
+    return NULL;
+
+  return kanban_card_record_from_json(json_node_get_object(node));
+}
+
+static gboolean
+apply_entry(KanbanBoardRecord* board, JsonObject* entry)
+{
+  const gchar* op     = get_string(entry, "op");
+  const gchar* title  = get_string(entry, "title");
+  gint64       index  = get_index(entry, "index");
+  KanbanColumnRecord* column = get_column(board, entry);
+  KanbanCardRecord*   card;
+
+  if (g_strcmp0(op, "add-column") == 0)
+  {
+    g_ptr_array_add(board->columns, kanban_column_record_new(title));
+    return TRUE;
+  }
+
+  if (column == NULL)
+    return FALSE;
+
+  if (g_strcmp0(op, "rename-column") == 0)
+  {
+    if (title == NULL)
+      return FALSE;
+
+    g_free(column->title);
+    column->title = g_strdup(title);
+  }
+  else if (g_strcmp0(op, "remove-column") == 0)
+  {
+    g_ptr_array_remove(board->columns, column);
+    return TRUE;
+  }
+  else if (g_strcmp0(op, "insert-card") == 0)
+  {
+    if (index < 0 || index > column->cards->len || (card = get_card(entry)) == NULL)
+      return FALSE;
+
+    g_ptr_array_insert(column->cards, index, card);
+  }
+  else if (g_strcmp0(op, "update-card") == 0)
+  {
+    if (index < 0 || index >= column->cards->len || (card = get_card(entry)) == NULL)
+      return FALSE;
+
+    kanban_card_record_free(g_ptr_array_index(column->cards, index));
+    column->cards->pdata[index] = card;
+  }
+  else if (g_strcmp0(op, "remove-card") == 0)
+  {
+    if (index < 0 || index >= column->cards->len)
+      return FALSE;
+
+    g_ptr_array_remove_index(column->cards, index);
+  }
+  else
+  {
+    return FALSE;
+  }
+
+  column->dirty = TRUE;
+  return TRUE;
+}
+
+static guint
+replay_file(const gchar* file_path, KanbanBoardRecord* board, JsonParser* parser,
+            GError** error)
+{
+  gchar*  contents = NULL;
+  gsize   length   = 0;
+  guint   applied  = 0;
+
+  if (!g_file_get_contents(file_path, &contents, &length, error))
+    return 0;
+
+  gchar* line   = contents;
+  gchar* end    = contents + length;
+  guint  number = 0;
+
+  while (line < end)
+  {
+    gchar* newline = memchr(line, '\n', end - line);
+    gsize  size    = (newline ? newline : end) - line;
+
+    number++;
+    if (size > 0)
+    {
+      JsonNode* root = NULL;
+
+      if (json_parser_load_from_data(parser, line, size, NULL))
+        root = json_parser_get_root(parser);
+
+      if (root && JSON_NODE_HOLDS_OBJECT(root) &&
+          apply_entry(board, json_node_get_object(root)))
+        applied++;
+      else
+        g_warning("Skipping journal entry on line %u of %s", number, file_path);
+    }
+
+    line += size + 1;
+  }
+
+  g_free(contents);
+  return applied;
+}
+
+/*
+ * kanban_journal_has_entries tells whether some generation from
+ * generation on holds edits, without reading them */
+gboolean
+kanban_journal_has_entries(const gchar* dir_path, guint generation)
+{
+  GArray*  generations = list_generations(dir_path);
+  gboolean found       = FALSE;
+
+  for (guint i = 0; i < generations->len && !found; i++)
+  {
+    guint    current = g_array_index(generations, guint, i);
+    gchar*   path;
+    GStatBuf buf;
+
+    if (current < generation)
+      continue;
+
+    path  = generation_path(dir_path, current);
+    found = g_stat(path, &buf) == 0 && buf.st_size > 0;
+    g_free(path);
+  }
+
+  g_array_unref(generations);
+  return found;
+}
+
+/*
+ * kanban_journal_replay applies the generations in dir_path that are
+ * not part of board yet, in order. Entries that cannot be applied are
+ * skipped with a warning, a missing journal is not an error
+ * */
+gboolean
+kanban_journal_replay(const gchar* dir_path, KanbanBoardRecord* board,
+                      guint* n_entries, GError** error)
+{
+  GArray*     generations = list_generations(dir_path);
+  JsonParser* parser      = json_parser_new();
+  gboolean    success     = TRUE;
+  guint       applied     = 0;
+
+  KANBAN_TRACE_SCOPE("kanban_journal_replay");
+
+  for (guint i = 0; i < generations->len && success; i++)
+  {
+    guint generation = g_array_index(generations, guint, i);
+    if (generation < board->journal)
+      continue;
+
+    gchar*  path = generation_path(dir_path, generation);
+    GError* local_error = NULL;
+
+    applied += replay_file(path, board, parser, &local_error);
+    if (local_error)
+    {
+      g_propagate_error(error, local_error);
+      success = FALSE;
+    }
+
+    g_free(path);
+  }
+
+  if (n_entries)
+    *n_entries = applied;
+
+  g_object_unref(parser);
+  g_array_unref(generations);
+
+  return success;
+}
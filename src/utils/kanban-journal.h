@@ -0,0 +1,97 @@
+/* kanban-journal.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#pragma once
+
+#include "kanban-board-file.h"
+
+/*
+ * The journal records edits made since the last snapshot, one JSON
+ * object per line, columns and cards are referred to by position:
+ *
+ * { "op": "add-column", "title": "..." }
+ * { "op": "rename-column", "column": 0, "title": "..." }
+ * { "op": "remove-column", "column": 0 }
+ * { "op": "insert-card", "column": 0, "index": 0, "card": { ... } }
+ * { "op": "update-card", "column": 0, "index": 0, "card": { ... } }
+ * { "op": "remove-card", "column": 0, "index": 0 }
+ *
+ * Cards are written as in the board file. Moving a card between columns
+ * is a remove-card followed by an insert-card.
+ *
+ * The journal is split in generations, journal-<n>.jsonl in the board
+ * directory. A save starts a new generation and records it in the
+ * manifest, so the generations before it are known to be part of the
+ * board even if the save is interrupted before they are removed.
+ * */
+#define KANBAN_JOURNAL_PREFIX "journal-"
+
+typedef struct _KanbanJournal KanbanJournal;
+
+KanbanJournal*
+kanban_journal_open(const gchar* dir_path, guint generation, GError** error);
+
+void
+kanban_journal_close(KanbanJournal* journal);
+
+goffset
+kanban_journal_get_size(KanbanJournal* journal);
+
+guint
+kanban_journal_get_generation(KanbanJournal* journal);
+
+gboolean
+kanban_journal_rotate(KanbanJournal* journal, GError** error);
+
+void
+kanban_journal_remove_before(const gchar* dir_path, guint generation);
+
+gboolean
+kanban_journal_add_column(KanbanJournal* journal, const gchar* title, GError** error);
+
+gboolean
+kanban_journal_rename_column(KanbanJournal* journal, guint column,
+                             const gchar* title, GError** error);
+
+gboolean
+kanban_journal_remove_column(KanbanJournal* journal, guint column, GError** error);
+
+gboolean
+kanban_journal_insert_card(KanbanJournal* journal, guint column, guint index,
+                           GBytes* card, GError** error);
+
+gboolean
+kanban_journal_update_card(KanbanJournal* journal, guint column, guint index,
+                           GBytes* card, GError** error);
+
+gboolean
+kanban_journal_remove_card(KanbanJournal* journal, guint column, guint index,
+                           GError** error);
+
+gboolean
+kanban_journal_discard(KanbanJournal* journal, GError** error);
+
+gboolean
+kanban_journal_has_entries(const gchar* dir_path, guint generation);
+
+gboolean
+kanban_journal_replay(const gchar* dir_path, KanbanBoardRecord* board,
+                      guint* n_entries, GError** error);
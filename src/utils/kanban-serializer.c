@@ -18,6 +18,8 @@
  * SPDX-License-Identifier: GPL-3.0-or-later
  */
 
+#include <string.h>
+
 #include "kanban-serializer.h"
 
 static gchar checktemplate[] = "<task status=";
@@ -25,154 +27,226 @@ static gchar donexml[]       = "done";
 static gchar progress[]      = "progress";
 static gchar titlexml[]      = " title=\"";
 static gchar endtitle[]      = "\"/>";
-static gchar nullbyte[]      = "\0";
 
-#define lenstr(X) sizeof(X)/sizeof(X[0])-1
+#define lenstr(X) (sizeof(X)/sizeof(X[0])-1)
 
-/*
- * get_serialized_buffer returns a GByteArray with the serialized
- * content of GtkTextBuffer according to predefined template
- *
- * the user must unref the returned pointer with g_bytes_unref() */
+static const struct
+{
+  const gchar* entity;
+  gsize        len;
+  gchar        c;
+} entities[] = {
+  { "&amp;",  5, '&'  },
+  { "&quot;", 6, '"'  },
+  { "&lt;",   4, '<'  },
+  { "&gt;",   4, '>'  },
+  { "&apos;", 6, '\'' },
+};
+
+/* Task titles are escaped so that a '"/>' typed by the user can't end them */
+static void
+append_escaped(GByteArray* ret, const gchar* title)
+{
+  const gchar* run = title;
+
+  for (const gchar* p = title; *p; p++)
+  {
+    const gchar* entity;
+
+    switch (*p)
+    {
+      case '&': entity = "&amp;";  break;
+      case '"': entity = "&quot;"; break;
+      case '<': entity = "&lt;";   break;
+      case '>': entity = "&gt;";   break;
+      default:  continue;
+    }
+
+    g_byte_array_append(ret, (guint8*)run, p - run);
+    g_byte_array_append(ret, (guint8*)entity, strlen(entity));
+    run = p + 1;
+  }
+
+  g_byte_array_append(ret, (guint8*)run, strlen(run));
+}
 
-GBytes*
-get_serialized_buffer(GtkTextBuffer *buffer)
+/* Unknown entities are kept verbatim, titles saved before escaping
+ * was introduced may contain a plain '&' */
+static gchar*
+unescape_title(const gchar* title, gsize len)
 {
-  GtkTextIter start, end;
+  GString*     ret = g_string_sized_new(len);
+  const gchar* end = title + len;
+  const gchar* p   = title;
 
-  GByteArray* ret = g_byte_array_new();
-  gtk_text_buffer_get_bounds(buffer, &start, &end);
+  while (p < end)
+  {
+    const gchar* amp = memchr(p, '&', end - p);
 
-  GtkTextIter pos0,pos1;
-  GtkTextChildAnchor* anch;
+    if (amp == NULL)
+    {
+      g_string_append_len(ret, p, end - p);
+      break;
+    }
 
-  pos0 = start;
-  do {
-    pos1 = pos0;
-    gboolean not_end = TRUE;
-    while (anch = gtk_text_iter_get_child_anchor(&pos1), anch == NULL)
+    g_string_append_len(ret, p, amp - p);
+    p = amp;
+
+    gboolean found = FALSE;
+    for (guint i = 0; i < G_N_ELEMENTS(entities); i++)
     {
-      not_end = gtk_text_iter_forward_char(&pos1);
-      if (!not_end)
+      if ((gsize)(end - p) >= entities[i].len &&
+          memcmp(p, entities[i].entity, entities[i].len) == 0)
+      {
+        g_string_append_c(ret, entities[i].c);
+        p    += entities[i].len;
+        found = TRUE;
         break;
+      }
     }
 
-    gchar* text = gtk_text_iter_get_text(&pos0, &pos1);
-    ret = g_byte_array_append(ret, (guint8*)text, strlen(text));
-    g_free(text);
+    if (!found)
+    {
+      g_string_append_c(ret, '&');
+      p++;
+    }
+  }
 
-    pos0 = pos1;
+  return g_string_free(ret, FALSE);
+}
 
-    if (!not_end && !anch)
-      continue;
+/* Appends the markup of a task, as found in version 1 descriptions */
+void
+kanban_task_markup_append(GByteArray* ret, const gchar* tasklbl, gboolean isChecked)
+{
+  g_byte_array_append(ret, (guint8*)checktemplate, lenstr(checktemplate));
 
-    guint widgets_len = 0;
-    GtkWidget** widgets = gtk_text_child_anchor_get_widgets(anch, &widgets_len);
+  if (isChecked)
+    g_byte_array_append(ret, (guint8*)donexml, lenstr(donexml));
+  else
+    g_byte_array_append(ret, (guint8*)progress, lenstr(progress));
 
-    if ((!widgets_len) || (!widgets))
-      continue;
+  g_byte_array_append(ret, (guint8*)titlexml, lenstr(titlexml));
 
-    for (int i = 0; i < widgets_len; i++)
-    {
-      gboolean isChecked = false;
-      const gchar* tasklbl = NULL;
+  if (*tasklbl)
+    append_escaped(ret, tasklbl);
 
-      for (GtkWidget* child = gtk_widget_get_first_child (widgets[i]);
-                                                      child != NULL;
-                        child = gtk_widget_get_next_sibling (child))
-      {
-        if (GTK_IS_CHECK_BUTTON (child))
-          isChecked = gtk_check_button_get_active (GTK_CHECK_BUTTON (child));
-        else if (GTK_IS_EDITABLE_LABEL (child))
-          tasklbl = gtk_editable_get_text (GTK_EDITABLE(child));
-      }
+  g_byte_array_append(ret, (guint8*)endtitle, lenstr(endtitle));
+}
 
-      ret = g_byte_array_append(ret, (guint8*)checktemplate, lenstr(checktemplate));
+static void
+kanban_anchor_clear(gpointer data)
+{
+  KanbanAnchor* anchor = data;
+  g_clear_pointer(&anchor->title, g_free);
+}
 
-      if (isChecked)
-        ret = g_byte_array_append(ret, (guint8*)donexml, lenstr(donexml));
-      else
-        ret = g_byte_array_append(ret, (guint8*)progress, lenstr(progress));
+KanbanUnserializedContent*
+kanban_unserialized_content_new(void)
+{
+  KanbanUnserializedContent* content = g_new0(KanbanUnserializedContent, 1);
 
-      ret = g_byte_array_append(ret, (guint8*)titlexml, lenstr(titlexml));
+  content->text    = g_string_new(NULL);
+  content->anchors = g_array_new(FALSE, FALSE, sizeof(KanbanAnchor));
+  g_array_set_clear_func(content->anchors, kanban_anchor_clear);
 
-      int len = strlen(tasklbl);
-      if (len)
-        ret = g_byte_array_append(ret, (guint8*)(tasklbl), len);
+  return content;
+}
 
-      ret = g_byte_array_append(ret, (guint8*)endtitle, lenstr(endtitle));
-    }
+/* release it with kanban_unserialized_content_free() */
+KanbanUnserializedContent*
+kanban_unserialized_content_copy(const KanbanUnserializedContent* content)
+{
+  KanbanUnserializedContent* copy = kanban_unserialized_content_new();
 
-  } while (gtk_text_iter_forward_char(&pos0));
+  g_string_append_len(copy->text, content->text->str, content->text->len);
+  g_array_set_size(copy->anchors, content->anchors->len);
 
-  ret = g_byte_array_append (ret, (guint8*)nullbyte, 1);
+  for (guint i = 0; i < content->anchors->len; i++)
+  {
+    KanbanAnchor* anchor = &g_array_index(content->anchors, KanbanAnchor, i);
+    KanbanAnchor* target = &g_array_index(copy->anchors, KanbanAnchor, i);
 
-  return g_byte_array_free_to_bytes(ret);
+    target->offset = anchor->offset;
+    target->title  = g_strdup(anchor->title);
+    target->done   = anchor->done;
+  }
 
+  return copy;
 }
 
-KanbanUnserializedContent* get_unserialized_buffer(const gchar* description)
+void
+kanban_unserialized_content_free(KanbanUnserializedContent* content)
 {
-  int dsc_len = strlen(description);
+  if (content == NULL)
+    return;
+
+  g_string_free(content->text, TRUE);
+  g_array_unref(content->anchors);
+  g_free(content);
+}
+
+/*
+ * get_unserialized_buffer splits a serialized description into its plain
+ * text and the list of tasks found in it. Anchor offsets are character
+ * offsets into the returned text.
+ *
+ * The description is walked once; a truncated task is kept as plain text.
+ *
+ * Returns NULL for an empty description, otherwise release it with
+ * kanban_unserialized_content_free() */
+
+KanbanUnserializedContent*
+get_unserialized_buffer(const gchar* description)
+{
+  gsize dsc_len = strlen(description);
 
   if (!dsc_len)
     return NULL;
 
-  KanbanUnserializedContent* KUnContent = malloc (sizeof(KanbanUnserializedContent));
+  KanbanUnserializedContent* KUnContent = kanban_unserialized_content_new();
 
-  GByteArray* ret  = g_byte_array_new();
-  GList*      list = NULL;
+  g_string_set_size(KUnContent->text, dsc_len);
+  g_string_truncate(KUnContent->text, 0);
 
-  gchar* dataptr = (gchar*)description;
+  const gchar* dataptr = description;
+  const gchar* dataend = description + dsc_len;
+  guint offset = 0;
 
-  while (dsc_len > 0)
+  while (dataptr < dataend)
   {
-    gchar* n_dataptr = (gchar*)(g_strstr_len (dataptr, dsc_len, checktemplate));
+    const gchar* tag       = strstr(dataptr, checktemplate);
+    const gchar* chunk_end = tag ? tag : dataend;
 
-    /* In case there's no task just copy everything and returns */
-    if (n_dataptr == NULL)
-    {
-      ret = g_byte_array_append (ret, (guint8*)dataptr, dsc_len);
-      break;
-    }
-    else
-      ret = g_byte_array_append (ret, (guint8*)dataptr, n_dataptr-dataptr);
+    /* Copy the text up to the next task */
+    g_string_append_len(KUnContent->text, dataptr, chunk_end - dataptr);
+    offset += g_utf8_strlen(dataptr, chunk_end - dataptr);
 
-    // Create Anchor
-    KanbanAnchor* anchor = malloc(sizeof(KanbanAnchor));
-    anchor->offset = ret->len;
+    if (tag == NULL)
+      break;
 
-    n_dataptr   += lenstr(checktemplate);
-    gchar* title = g_strstr_len(n_dataptr, strlen(n_dataptr), titlexml);
+    const gchar* status = tag + lenstr(checktemplate);
+    const gchar* title  = strstr(status, titlexml);
+    const gchar* next   = title ? strstr(title + lenstr(titlexml), endtitle) : NULL;
 
-    if (title == NULL)
+    if (next == NULL)
     {
-      free(anchor);
-      g_print("Corrupted file :(\n");
+      g_warning("Truncated task in card description");
+      g_string_append_len(KUnContent->text, tag, dataend - tag);
       break;
     }
 
-    gchar* done     = g_strstr_len(n_dataptr, title-n_dataptr,"done");
-    anchor->active = done?true:false;
-
-    title += lenstr(titlexml);
-    gchar* next = g_strstr_len(title, strlen(title), endtitle);
+    KanbanAnchor anchor;
+    anchor.offset = offset;
+    anchor.done   = g_strstr_len(status, title - status, donexml) != NULL;
 
-    if (!next)
-    {
-      g_print("Corrupted JSON :(\n");
-      break;
-    }
+    title       += lenstr(titlexml);
+    anchor.title = unescape_title(title, next - title);
 
-    anchor->title = g_strndup (title, next-title);
-    next    += lenstr(endtitle);
-    dsc_len -= (next - dataptr);
-    dataptr  = next;
+    g_array_append_val(KUnContent->anchors, anchor);
 
-    list = g_list_append (list, anchor);
+    dataptr = next + lenstr(endtitle);
   }
-  KUnContent->text = ret;
-  KUnContent->anchors = list;
 
- return KUnContent;
+  return KUnContent;
 }
@@ -20,26 +20,42 @@
 
 #pragma once
 
-#include <gtk-4.0/gtk/gtk.h>
-
-typedef struct
-{
-  GByteArray* text;
-  GList*  anchors;
-} KanbanUnserializedContent;
+#include <glib.h>
 
 /*
- * Use g_free(KanbanAnchor->title) to release the string
+ * offset is the character offset of the task in the unserialized text,
+ * not counting the tasks before it
  * */
 typedef struct
 {
   guint offset;
   gchar* title;
-  gboolean active;
+  gboolean done;
 } KanbanAnchor;
 
-GBytes*
-get_serialized_buffer(GtkTextBuffer *buffer);
+/*
+ * A card description: its plain text and the tasks placed in it.
+ *
+ * anchors is a GArray of KanbanAnchor, the titles are released along
+ * with the array by kanban_unserialized_content_free()
+ * */
+typedef struct
+{
+  GString* text;
+  GArray*  anchors;
+} KanbanUnserializedContent;
+
+void
+kanban_task_markup_append(GByteArray* ret, const gchar* tasklbl, gboolean isChecked);
 
 KanbanUnserializedContent*
 get_unserialized_buffer(const gchar* description);
+
+KanbanUnserializedContent*
+kanban_unserialized_content_new(void);
+
+KanbanUnserializedContent*
+kanban_unserialized_content_copy(const KanbanUnserializedContent* content);
+
+void
+kanban_unserialized_content_free(KanbanUnserializedContent* content);
@@ -0,0 +1,235 @@
+/* kanban-trace.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <unistd.h>
+
+#include "kanban-trace.h"
+#include "kanban-board-file.h"
+
+typedef struct
+{
+  const gchar* name;
+  gint64       time;   /* µs since the trace started */
+  gint64       value;  /* Counter value, or id of an async span */
+  guint        thread;
+  gchar        phase;  /* As in the trace: B, E, b and e for async, C */
+} TraceEvent;
+
+/*
+ * Threads take the next slot of the ring with an atomic increment, so
+ * recording takes no lock. Counter totals are kept under a mutex, they
+ * change far less often than spans begin.
+ * */
+static struct
+{
+  TraceEvent* events;
+  guint       capacity;
+  gint        head;     /* Events recorded, wrapping around capacity */
+  gint64      start;
+  gchar*      file_path;
+
+  GMutex      mutex;
+  GHashTable* totals;   /* name → gint64* */
+  gint        threads;
+} trace;
+
+gboolean kanban_trace_enabled = FALSE;
+
+static GPrivate thread_key = G_PRIVATE_INIT(NULL);
+
+/* Threads are numbered in the order they first record, from 1 */
+static guint
+thread_id(void)
+{
+  guint id = GPOINTER_TO_UINT(g_private_get(&thread_key));
+
+  if (id == 0)
+  {
+    id = g_atomic_int_add(&trace.threads, 1) + 1;
+    g_private_set(&thread_key, GUINT_TO_POINTER(id));
+  }
+
+  return id;
+}
+
+/* Events that come in once the trace is stopped are dropped */
+static void
+record(const gchar* name, gchar phase, gint64 value)
+{
+  if (!kanban_trace_enabled || trace.events == NULL)
+    return;
+
+  guint       index = (guint)g_atomic_int_add(&trace.head, 1);
+  TraceEvent* event = &trace.events[index % trace.capacity];
+
+  event->name   = name;
+  event->time   = g_get_monotonic_time() - trace.start;
+  event->value  = value;
+  event->thread = thread_id();
+  event->phase  = phase;
+}
+
+/*
+ * kanban_trace_start records events until kanban_trace_stop() writes them
+ * to file_path. capacity is the number of events kept, 0 for
+ * KANBAN_TRACE_CAPACITY. Starting again only changes the file.
+ * */
+void
+kanban_trace_start(const gchar* file_path, guint capacity)
+{
+  g_return_if_fail(file_path != NULL);
+
+  g_free(trace.file_path);
+  trace.file_path = g_strdup(file_path);
+
+  if (kanban_trace_enabled)
+    return;
+
+  trace.capacity = capacity ? capacity : KANBAN_TRACE_CAPACITY;
+  trace.events   = g_new0(TraceEvent, trace.capacity);
+  trace.head     = 0;
+  trace.start    = g_get_monotonic_time();
+  trace.totals   = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, g_free);
+  g_mutex_init(&trace.mutex);
+
+  /* The thread starting the trace is the main one */
+  thread_id();
+
+  kanban_trace_enabled = TRUE;
+}
+
+void
+kanban_trace_begin(const gchar* name)
+{
+  record(name, 'B', 0);
+}
+
+void
+kanban_trace_end(const gchar* name)
+{
+  record(name, 'E', 0);
+}
+
+void
+kanban_trace_async_begin(const gchar* name, gint64 id)
+{
+  record(name, 'b', id);
+}
+
+void
+kanban_trace_async_end(const gchar* name, gint64 id)
+{
+  record(name, 'e', id);
+}
+
+void
+kanban_trace_counter(const gchar* name, gint64 value)
+{
+  record(name, 'C', value);
+}
+
+void
+kanban_trace_count(const gchar* name, gint64 delta)
+{
+  gint64* total;
+
+  if (!kanban_trace_enabled)
+    return;
+
+  g_mutex_lock(&trace.mutex);
+
+  total = g_hash_table_lookup(trace.totals, name);
+  if (total == NULL)
+  {
+    total = g_new0(gint64, 1);
+    g_hash_table_insert(trace.totals, (gpointer)name, total);
+  }
+
+  *total += delta;
+  record(name, 'C', *total);
+
+  g_mutex_unlock(&trace.mutex);
+}
+
+static void
+append_event(GString* out, const TraceEvent* event, gint pid)
+{
+  g_string_append(out, "{\"name\":");
+  kanban_json_append_string(out, event->name, -1);
+  g_string_append_printf(out, ",\"cat\":\"thisweekinmylife\",\"ph\":\"%c\","
+                         "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%u",
+                         event->phase, event->time, pid, event->thread);
+
+  if (event->phase == 'C')
+    g_string_append_printf(out, ",\"args\":{\"value\":%" G_GINT64_FORMAT "}", event->value);
+  else if (event->phase == 'b' || event->phase == 'e')
+    g_string_append_printf(out, ",\"id\":%" G_GINT64_FORMAT, event->value);
+
+  g_string_append_c(out, '}');
+}
+
+/*
+ * kanban_trace_stop writes the events kept, oldest first, and stops
+ * recording. Other threads must be done tracing by then, see
+ * kanban_board_io_join(). Does nothing when no trace was started.
+ * */
+gboolean
+kanban_trace_stop(GError** error)
+{
+  if (!kanban_trace_enabled)
+    return TRUE;
+
+  kanban_trace_enabled = FALSE;
+
+  guint    recorded = (guint)g_atomic_int_get(&trace.head);
+  guint    count    = MIN(recorded, trace.capacity);
+  guint    first    = recorded > trace.capacity ? recorded % trace.capacity : 0;
+  gint     pid      = getpid();
+  GString* out      = g_string_new("{\"traceEvents\":[\n");
+
+  g_string_append_printf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                         "\"args\":{\"name\":\"thisweekinmylife\"}},\n"
+                         "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":1,"
+                         "\"args\":{\"name\":\"main\"}}", pid, pid);
+
+  for (guint i = 0; i < count; i++)
+  {
+    const TraceEvent* event = &trace.events[(first + i) % trace.capacity];
+
+    /* Slots taken but not filled in yet, by a thread still recording */
+    if (event->name == NULL)
+      continue;
+
+    g_string_append(out, ",\n");
+    append_event(out, event, pid);
+  }
+
+  g_string_append(out, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  gboolean success = g_file_set_contents(trace.file_path, out->str, out->len, error);
+
+  g_string_free(out, TRUE);
+  g_clear_pointer(&trace.events, g_free);
+  g_clear_pointer(&trace.totals, g_hash_table_unref);
+  g_clear_pointer(&trace.file_path, g_free);
+  g_mutex_clear(&trace.mutex);
+
+  return success;
+}
@@ -0,0 +1,123 @@
+/* kanban-trace.h
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include "config.h"
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Spans and counters recorded into a ring buffer and written as a Chrome
+ * trace, which Perfetto and chrome://tracing open.
+ *
+ * Recording starts with --trace=FILE or with THISWEEKINMYLIFE_TRACE=FILE
+ * in the environment, and the trace is written to FILE on exit. Once the
+ * ring is full the oldest events make way for new ones.
+ *
+ * The macros are all there is to call from the code traced, they cost a
+ * test while not recording, and nothing when built with -Dtracing=false.
+ * Names must be string literals, only their address is kept.
+ * */
+#define KANBAN_TRACE_ENV "THISWEEKINMYLIFE_TRACE"
+
+/* Events kept by default, about 8 MB */
+#define KANBAN_TRACE_CAPACITY (1 << 18)
+
+extern gboolean kanban_trace_enabled;
+
+void
+kanban_trace_start(const gchar* file_path, guint capacity);
+
+gboolean
+kanban_trace_stop(GError** error);
+
+void
+kanban_trace_begin(const gchar* name);
+
+void
+kanban_trace_end(const gchar* name);
+
+void
+kanban_trace_async_begin(const gchar* name, gint64 id);
+
+void
+kanban_trace_async_end(const gchar* name, gint64 id);
+
+void
+kanban_trace_counter(const gchar* name, gint64 value);
+
+void
+kanban_trace_count(const gchar* name, gint64 delta);
+
+/* Ends the span a KANBAN_TRACE_SCOPE() began, see below, unless the
+ * trace was stopped meanwhile */
+static inline void
+kanban_trace_scope_end(const gchar** name)
+{
+  if (*name && kanban_trace_enabled)
+    kanban_trace_end(*name);
+}
+
+#if KANBAN_ENABLE_TRACING
+
+#define KANBAN_TRACE_BEGIN(name) \
+  G_STMT_START { if (G_UNLIKELY(kanban_trace_enabled)) kanban_trace_begin(name); } G_STMT_END
+
+#define KANBAN_TRACE_END(name) \
+  G_STMT_START { if (G_UNLIKELY(kanban_trace_enabled)) kanban_trace_end(name); } G_STMT_END
+
+/* A span from here to the end of the enclosing block, whichever way it ends */
+#define KANBAN_TRACE_SCOPE(name) \
+  __attribute__((cleanup(kanban_trace_scope_end), unused)) \
+  const gchar* G_PASTE(kanban_trace_scope_, __LINE__) = \
+    G_UNLIKELY(kanban_trace_enabled) ? (kanban_trace_begin(name), (name)) : NULL
+
+/* Spans that end in another callback or thread than they began, told
+ * apart by id when several run at once */
+#define KANBAN_TRACE_ASYNC_BEGIN(name, id) \
+  G_STMT_START { if (G_UNLIKELY(kanban_trace_enabled)) kanban_trace_async_begin(name, id); } G_STMT_END
+
+#define KANBAN_TRACE_ASYNC_END(name, id) \
+  G_STMT_START { if (G_UNLIKELY(kanban_trace_enabled)) kanban_trace_async_end(name, id); } G_STMT_END
+
+/* Sets counter name to value */
+#define KANBAN_TRACE_COUNTER(name, value) \
+  G_STMT_START { if (G_UNLIKELY(kanban_trace_enabled)) kanban_trace_counter(name, value); } G_STMT_END
+
+/* Adds delta to counter name */
+#define KANBAN_TRACE_COUNT(name, delta) \
+  G_STMT_START { if (G_UNLIKELY(kanban_trace_enabled)) kanban_trace_count(name, delta); } G_STMT_END
+
+#else
+
+#define KANBAN_TRACE_BEGIN(name)           G_STMT_START { } G_STMT_END
+#define KANBAN_TRACE_END(name)             G_STMT_START { } G_STMT_END
+#define KANBAN_TRACE_SCOPE(name)           G_STMT_START { } G_STMT_END
+#define KANBAN_TRACE_ASYNC_BEGIN(name, id) G_STMT_START { } G_STMT_END
+#define KANBAN_TRACE_ASYNC_END(name, id)   G_STMT_START { } G_STMT_END
+#define KANBAN_TRACE_COUNTER(name, value)  G_STMT_START { } G_STMT_END
+#define KANBAN_TRACE_COUNT(name, delta)    G_STMT_START { } G_STMT_END
+
+#endif
+
+G_END_DECLS
@@ -0,0 +1,578 @@
+/* bench-board.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+/*
+ * Measures the save and load paths on a synthetic board and prints one
+ * JSON object per benchmark on stdout.
+ *
+ * The benchmarks that need widgets fail without a display, meson runs
+ * them under xvfb-run when there is none.
+ */
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include "kanban-application.h"
+#include "kanban-card.h"
+#include "kanban-column.h"
+#include "kanban-text-buffer.h"
+#include "kanban-window.h"
+#include "utils/kanban-board-file.h"
+#include "utils/kanban-board-model.h"
+#include "utils/kanban-board-snapshot.h"
+
+static gint n_columns    = 5;
+static gint n_cards      = 2000;
+static gint n_tasks      = 50;
+static gint n_iterations = 3;
+
+static GOptionEntry entries[] = {
+  { "columns", 0, 0, G_OPTION_ARG_INT, &n_columns, "Number of columns", "N" },
+  { "cards", 0, 0, G_OPTION_ARG_INT, &n_cards, "Cards per column", "N" },
+  { "tasks", 0, 0, G_OPTION_ARG_INT, &n_tasks, "Tasks per card", "N" },
+  { "iterations", 0, 0, G_OPTION_ARG_INT, &n_iterations, "Board loads to time", "N" },
+  { NULL }
+};
+
+typedef struct
+{
+  const gchar* name;
+  const gchar* unit;
+  GArray*      samples;  /* gdouble, seconds per unit */
+  guint64      bytes;
+  gdouble      seconds;
+} BenchResult;
+
+static gdouble
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+bench_result_init(BenchResult* result, const gchar* name, const gchar* unit)
+{
+  result->name    = name;
+  result->unit    = unit;
+  result->samples = g_array_new(FALSE, FALSE, sizeof(gdouble));
+  result->bytes   = 0;
+  result->seconds = 0;
+}
+
+static void
+bench_result_add(BenchResult* result, gdouble seconds, gsize bytes)
+{
+  g_array_append_val(result->samples, seconds);
+  result->seconds += seconds;
+  result->bytes   += bytes;
+}
+
+static gint
+compare_doubles(gconstpointer a, gconstpointer b)
+{
+  gdouble x = *(const gdouble*)a, y = *(const gdouble*)b;
+  return (x > y) - (x < y);
+}
+
+static gdouble
+percentile(GArray* sorted, gdouble p)
+{
+  if (sorted->len == 0)
+    return 0;
+
+  return g_array_index(sorted, gdouble, (guint)((sorted->len - 1) * p));
+}
+
+static JsonBuilder*
+report_begin(const gchar* name)
+{
+  JsonBuilder* builder = json_builder_new();
+
+  json_builder_begin_object(builder);
+  json_builder_set_member_name(builder, "benchmark");
+  json_builder_add_string_value(builder, name);
+  json_builder_set_member_name(builder, "columns");
+  json_builder_add_int_value(builder, n_columns);
+  json_builder_set_member_name(builder, "cards");
+  json_builder_add_int_value(builder, n_cards);
+  json_builder_set_member_name(builder, "tasks");
+  json_builder_add_int_value(builder, n_tasks);
+
+  return builder;
+}
+
+static void
+report_end(JsonBuilder* builder)
+{
+  json_builder_end_object(builder);
+
+  JsonNode* root = json_builder_get_root(builder);
+  gchar* line    = json_to_string(root, FALSE);
+  g_print("%s\n", line);
+
+  g_free(line);
+  json_node_unref(root);
+  g_object_unref(builder);
+}
+
+static void
+report(BenchResult* result)
+{
+  JsonBuilder* builder = report_begin(result->name);
+
+  g_array_sort(result->samples, compare_doubles);
+
+  json_builder_set_member_name(builder, "bytes");
+  json_builder_add_int_value(builder, result->bytes);
+  json_builder_set_member_name(builder, "seconds");
+  json_builder_add_double_value(builder, result->seconds);
+  json_builder_set_member_name(builder, "mb_per_s");
+  json_builder_add_double_value(builder, result->bytes / (1024.0 * 1024.0) /
+                                         MAX(result->seconds, 1e-9));
+  json_builder_set_member_name(builder, "unit");
+  json_builder_add_string_value(builder, result->unit);
+  json_builder_set_member_name(builder, "samples");
+  json_builder_add_int_value(builder, result->samples->len);
+  json_builder_set_member_name(builder, "p50_us");
+  json_builder_add_double_value(builder, percentile(result->samples, 0.50) * 1e6);
+  json_builder_set_member_name(builder, "p90_us");
+  json_builder_add_double_value(builder, percentile(result->samples, 0.90) * 1e6);
+  json_builder_set_member_name(builder, "p99_us");
+  json_builder_add_double_value(builder, percentile(result->samples, 0.99) * 1e6);
+  json_builder_set_member_name(builder, "max_us");
+  json_builder_add_double_value(builder, percentile(result->samples, 1.0) * 1e6);
+
+  report_end(builder);
+  g_array_unref(result->samples);
+}
+
+static void
+report_skipped(const gchar* name, const gchar* reason)
+{
+  JsonBuilder* builder = report_begin(name);
+
+  json_builder_set_member_name(builder, "skipped");
+  json_builder_add_string_value(builder, reason);
+
+  report_end(builder);
+}
+
+static gchar*
+make_description(guint card)
+{
+  GString* description = g_string_new(NULL);
+
+  for (gint i = 0; i < n_tasks; i++)
+  {
+    g_string_append_printf(description,
+                           "Notes for step %d of card %u, with ümlauts and ☕\n", i, card);
+    g_string_append_printf(description,
+                           "<task status=%s title=\"Step %d\"/>\n",
+                           i % 3 ? "progress" : "done", i);
+  }
+
+  return g_string_free(description, FALSE);
+}
+
+static void
+bench_unserialize(GPtrArray* descriptions)
+{
+  BenchResult result;
+  bench_result_init(&result, "get_unserialized_buffer", "card");
+
+  for (guint i = 0; i < descriptions->len; i++)
+  {
+    const gchar* description = g_ptr_array_index(descriptions, i);
+
+    gdouble start = now();
+    KanbanUnserializedContent* content = get_unserialized_buffer(description);
+    bench_result_add(&result, now() - start, strlen(description));
+
+    kanban_unserialized_content_free(content);
+  }
+
+  report(&result);
+}
+
+static GPtrArray*
+build_columns(GPtrArray* descriptions)
+{
+  GPtrArray* columns = g_ptr_array_new_with_free_func(g_object_unref);
+
+  for (gint c = 0; c < n_columns; c++)
+  {
+    gchar* title = g_strdup_printf("Column %d", c);
+    KanbanColumnItem* column = kanban_column_item_new(title);
+
+    for (gint i = 0; i < n_cards; i++)
+    {
+      gchar* card_title = g_strdup_printf("Card %d", i);
+      const gchar* description = g_ptr_array_index(descriptions, c * n_cards + i);
+      KanbanCardItem* card = kanban_card_item_new(card_title, FALSE,
+                                                  get_unserialized_buffer(description));
+
+      kanban_column_item_append(column, card);
+
+      g_object_unref(card);
+      g_free(card_title);
+    }
+
+    g_ptr_array_add(columns, column);
+    g_free(title);
+  }
+
+  return columns;
+}
+
+/* Each description is put in a card, then read back from its buffer */
+static void
+bench_serialize(GPtrArray* columns)
+{
+  BenchResult result;
+  KanbanCard* card = g_object_ref_sink(kanban_card_new());
+
+  bench_result_init(&result, "get_buffer_content", "card");
+
+  for (guint c = 0; c < columns->len; c++)
+  {
+    KanbanColumnItem* column = g_ptr_array_index(columns, c);
+
+    for (guint i = 0; i < g_list_model_get_n_items(G_LIST_MODEL(column)); i++)
+    {
+      kanban_card_bind(card, kanban_column_item_get_card(column, i));
+      kanban_card_set_reveal(card, TRUE);
+
+      gdouble start = now();
+      KanbanUnserializedContent* content = kanban_card_get_description(card);
+      bench_result_add(&result, now() - start, content->text->len);
+
+      kanban_unserialized_content_free(content);
+      kanban_card_set_reveal(card, FALSE);
+      kanban_card_unbind(card);
+    }
+  }
+
+  g_object_unref(card);
+  report(&result);
+}
+
+/*
+ * Each column is timed on its own, the encoding of the board they make
+ * up is reported apart. Returns the encoded board, which is also what
+ * loadjson() reads back
+ * */
+static gchar*
+bench_column_record(GPtrArray* columns, gsize* len)
+{
+  BenchResult result, encode;
+  gchar* data = NULL;
+
+  bench_result_init(&result, "kanban_column_item_get_record", "column");
+  bench_result_init(&encode, "kanban_board_record_to_data", "board");
+
+  for (gint i = 0; i < n_iterations; i++)
+  {
+    KanbanBoardRecord* board = kanban_board_record_new();
+
+    for (guint c = 0; c < columns->len; c++)
+    {
+      KanbanColumnItem* column = g_ptr_array_index(columns, c);
+
+      gdouble start = now();
+      g_ptr_array_add(board->columns, kanban_column_item_get_record(column));
+      bench_result_add(&result, now() - start, 0);
+    }
+
+    g_free(data);
+
+    gdouble start = now();
+    data = kanban_board_record_to_data(board, len);
+    bench_result_add(&encode, now() - start, *len);
+
+    kanban_board_record_free(board);
+  }
+
+  report(&result);
+  report(&encode);
+  return data;
+}
+
+static void
+bench_loadjson(const gchar* data, gsize len)
+{
+  GError* error = NULL;
+  gchar*  path  = NULL;
+  gint    fd    = g_file_open_tmp("thisweekinmylife-bench-XXXXXX.json", &path, &error);
+
+  if (fd >= 0)
+    close(fd);
+
+  if (fd < 0 || !g_file_set_contents(path, data, len, &error))
+  {
+    report_skipped("loadjson", error->message);
+    g_error_free(error);
+    g_free(path);
+    return;
+  }
+
+  BenchResult result;
+  /* The board loads as a whole, one sample per load */
+  bench_result_init(&result, "loadjson", "board");
+
+  for (gint i = 0; i < n_iterations; i++)
+  {
+    KanbanWindow* window = g_object_new(KANBAN_TYPE_WINDOW, NULL);
+
+    gdouble start = now();
+    loadjson(window, path);
+    bench_result_add(&result, now() - start, len);
+
+    gtk_window_destroy(GTK_WINDOW(window));
+  }
+
+  report(&result);
+
+  g_unlink(path);
+  g_free(path);
+}
+
+/*
+ * Drops the files of the board from the page cache, for the next read to
+ * come from the disk as on the first start after a boot. Files are only
+ * dropped once written back, hence the sync.
+ * */
+static void
+evict_dir(const gchar* dir_path)
+{
+  GDir* dir = g_dir_open(dir_path, 0, NULL);
+  const gchar* name;
+
+  while (dir && (name = g_dir_read_name(dir)) != NULL)
+  {
+    gchar* path = g_build_filename(dir_path, name, NULL);
+    gint   fd   = g_open(path, O_RDONLY, 0);
+
+    if (fd >= 0)
+    {
+      fdatasync(fd);
+#ifdef POSIX_FADV_DONTNEED
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+      close(fd);
+    }
+
+    g_free(path);
+  }
+
+  g_clear_pointer(&dir, g_dir_close);
+}
+
+static void
+remove_snapshots(const gchar* dir_path, GPtrArray* shards)
+{
+  for (guint i = 0; i < shards->len; i++)
+  {
+    gchar* path     = g_build_filename(dir_path, g_ptr_array_index(shards, i), NULL);
+    gchar* snapshot = kanban_board_snapshot_path(path);
+
+    g_unlink(snapshot);
+    g_free(snapshot);
+    g_free(path);
+  }
+}
+
+static void
+drop_column(KanbanColumnRecord* column, gpointer user_data)
+{
+  guint* n_read = user_data;
+
+  *n_read += column->cards->len;
+  kanban_column_record_free(column);
+}
+
+/*
+ * Times a sharded board start, until every column and card title is in:
+ * without snapshots, as on the first start, when the shards are parsed
+ * and the snapshots written, then from the snapshots. Either runs with
+ * the files in the page cache and out of it.
+ * */
+static void
+bench_startup(GPtrArray* columns)
+{
+  GError* error = NULL;
+  gchar*  dir   = g_dir_make_tmp("thisweekinmylife-bench-XXXXXX", &error);
+
+  if (dir == NULL)
+  {
+    report_skipped("kanban_board_dir_read", error->message);
+    g_error_free(error);
+    return;
+  }
+
+  KanbanBoardRecord* board  = kanban_board_record_new();
+  GPtrArray*         shards = g_ptr_array_new_with_free_func(g_free);
+  guint64            bytes  = 0;
+
+  for (guint c = 0; c < columns->len; c++)
+  {
+    KanbanColumnRecord* record = kanban_column_item_get_record(g_ptr_array_index(columns, c));
+
+    g_free(record->shard);
+    record->shard = kanban_board_shard_new_name();
+    record->dirty = TRUE;
+    g_ptr_array_add(shards, g_strdup(record->shard));
+    g_ptr_array_add(board->columns, record);
+  }
+
+  if (!kanban_board_dir_save(board, dir, &error))
+  {
+    report_skipped("kanban_board_dir_read", error->message);
+    g_error_free(error);
+    kanban_board_record_free(board);
+    g_ptr_array_unref(shards);
+    g_free(dir);
+    return;
+  }
+
+  kanban_board_record_free(board);
+
+  for (guint i = 0; i < shards->len; i++)
+  {
+    gchar*  path = g_build_filename(dir, g_ptr_array_index(shards, i), NULL);
+    GStatBuf st;
+
+    if (g_stat(path, &st) == 0)
+      bytes += st.st_size;
+    g_free(path);
+  }
+
+  static const struct
+  {
+    const gchar* name;
+    gboolean     snapshot;
+    gboolean     cold;
+  } runs[] = {
+    { "kanban_board_dir_read json cold", FALSE, TRUE },
+    { "kanban_board_dir_read json warm", FALSE, FALSE },
+    { "kanban_board_dir_read snapshot cold", TRUE, TRUE },
+    { "kanban_board_dir_read snapshot warm", TRUE, FALSE },
+  };
+
+  for (guint r = 0; r < G_N_ELEMENTS(runs); r++)
+  {
+    BenchResult result;
+    bench_result_init(&result, runs[r].name, "board");
+
+    for (gint i = 0; i < n_iterations; i++)
+    {
+      guint n_read = 0;
+
+      if (!runs[r].snapshot)
+        remove_snapshots(dir, shards);
+      if (runs[r].cold)
+        evict_dir(dir);
+
+      /* The snapshots are written again by the read without them */
+      gdouble start = now();
+      kanban_board_dir_read(dir, FALSE, NULL, drop_column, &n_read, NULL, NULL);
+      bench_result_add(&result, now() - start, bytes);
+
+      g_assert_cmpuint(n_read, ==, n_columns * n_cards);
+    }
+
+    report(&result);
+  }
+
+  gchar* manifest = g_build_filename(dir, KANBAN_BOARD_MANIFEST, NULL);
+  remove_snapshots(dir, shards);
+  for (guint i = 0; i < shards->len; i++)
+  {
+    gchar* path = g_build_filename(dir, g_ptr_array_index(shards, i), NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+  g_unlink(manifest);
+  g_rmdir(dir);
+
+  g_free(manifest);
+  g_ptr_array_unref(shards);
+  g_free(dir);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_autoptr(GOptionContext) context = g_option_context_new("- benchmark board save and load");
+  GError* error = NULL;
+
+  g_option_context_add_main_entries(context, entries, NULL);
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+
+  if (n_columns < 1 || n_cards < 1 || n_tasks < 0 || n_iterations < 1)
+  {
+    g_printerr("Board size and iterations must be positive\n");
+    return 1;
+  }
+
+  GPtrArray* descriptions = g_ptr_array_new_with_free_func(g_free);
+  for (gint i = 0; i < n_columns * n_cards; i++)
+    g_ptr_array_add(descriptions, make_description(i));
+
+  bench_unserialize(descriptions);
+
+  GPtrArray* columns = build_columns(descriptions);
+  gsize len = 0;
+  gchar* data = bench_column_record(columns, &len);
+
+  bench_startup(columns);
+
+  /* The save and load paths through the widgets are what this guards,
+   * they must not go unmeasured */
+  gboolean has_display = gtk_init_check();
+
+  if (!has_display)
+  {
+    g_printerr("No display available, run the benchmark under xvfb-run\n");
+  }
+  else
+  {
+    adw_init();
+
+    bench_serialize(columns);
+    bench_loadjson(data, len);
+  }
+
+  g_free(data);
+  g_ptr_array_unref(columns);
+  g_ptr_array_unref(descriptions);
+
+  return has_display ? 0 : 1;
+}
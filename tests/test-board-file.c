@@ -0,0 +1,548 @@
+/* test-board-file.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "utils/kanban-board-file.h"
+#include "utils/kanban-board-snapshot.h"
+#include "utils/kanban-card-item.h"
+
+static const gchar legacy_board[] =
+  "{\"Monday\":{\"Card A\":{\"description\":\"Übung <task status=done title=\\\"First\\\"/>"
+  "rest<task status=progress title=\\\"Second\\\"/>\",\"revealed\":1}},"
+  "\"Tuesday\":{}}";
+
+static KanbanCardRecord*
+get_card(KanbanBoardRecord* board, guint column, guint card)
+{
+  KanbanColumnRecord* record = g_ptr_array_index(board->columns, column);
+  return g_ptr_array_index(record->cards, card);
+}
+
+static void
+assert_migrated_board(KanbanBoardRecord* board)
+{
+  g_assert_cmpuint(board->columns->len, ==, 2);
+  g_assert_cmpstr(((KanbanColumnRecord*)g_ptr_array_index(board->columns, 0))->title, ==, "Monday");
+  g_assert_cmpstr(((KanbanColumnRecord*)g_ptr_array_index(board->columns, 1))->title, ==, "Tuesday");
+
+  KanbanCardRecord* card = get_card(board, 0, 0);
+  g_assert_cmpstr(card->title, ==, "Card A");
+  g_assert_true(card->revealed);
+  g_assert_cmpstr(card->description->text->str, ==, "Übung rest");
+  g_assert_cmpuint(card->description->anchors->len, ==, 2);
+
+  KanbanAnchor* first  = &g_array_index(card->description->anchors, KanbanAnchor, 0);
+  KanbanAnchor* second = &g_array_index(card->description->anchors, KanbanAnchor, 1);
+  g_assert_cmpuint(first->offset, ==, 6);
+  g_assert_cmpstr(first->title, ==, "First");
+  g_assert_true(first->done);
+  g_assert_cmpuint(second->offset, ==, 10);
+  g_assert_cmpstr(second->title, ==, "Second");
+  g_assert_false(second->done);
+}
+
+static void
+test_migrate_legacy(void)
+{
+  GError* error = NULL;
+  gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  g_assert_no_error(error);
+
+  gchar* path   = g_build_filename(dir, "board", NULL);
+  gchar* backup = g_strconcat(path, ".v1", NULL);
+  g_file_set_contents(path, legacy_board, -1, &error);
+  g_assert_no_error(error);
+
+  KanbanBoardRecord* board = kanban_board_file_load(path, &error);
+  g_assert_no_error(error);
+  assert_migrated_board(board);
+  kanban_board_record_free(board);
+
+  /* The old file is kept and the new one is in the current layout */
+  gchar* contents = NULL;
+  g_file_get_contents(backup, &contents, NULL, &error);
+  g_assert_no_error(error);
+  g_assert_cmpstr(contents, ==, legacy_board);
+  g_free(contents);
+
+  g_file_get_contents(path, &contents, NULL, &error);
+  g_assert_no_error(error);
+  g_assert_nonnull(strstr(contents, "\"version\":2"));
+  g_free(contents);
+
+  /* Loading again reads the new layout directly */
+  g_unlink(backup);
+  board = kanban_board_file_load(path, &error);
+  g_assert_no_error(error);
+  assert_migrated_board(board);
+  g_assert_false(g_file_test(backup, G_FILE_TEST_EXISTS));
+  kanban_board_record_free(board);
+
+  /* A first column named like a member of the current layout */
+  g_file_set_contents(path, "{\"title\":{\"Card\":{\"description\":\"x\"}},\"Tuesday\":{}}",
+                      -1, &error);
+  g_assert_no_error(error);
+
+  board = kanban_board_file_load(path, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(board->columns->len, ==, 2);
+  g_assert_cmpstr(((KanbanColumnRecord*)g_ptr_array_index(board->columns, 0))->title, ==,
+                  "title");
+  g_assert_cmpstr(get_card(board, 0, 0)->title, ==, "Card");
+  g_assert_true(g_file_test(backup, G_FILE_TEST_EXISTS));
+  kanban_board_record_free(board);
+
+  g_unlink(backup);
+  g_unlink(path);
+  g_rmdir(dir);
+  g_free(backup);
+  g_free(path);
+  g_free(dir);
+}
+
+static void
+test_round_trip(void)
+{
+  KanbanBoardRecord* board = kanban_board_record_new();
+  KanbanColumnRecord* column = kanban_column_record_new("Column");
+  KanbanUnserializedContent* description = kanban_unserialized_content_new();
+  KanbanAnchor anchor = { 3, g_strdup("He said \"hi\"/>"), TRUE };
+
+  g_string_assign(description->text, "abc\ndef");
+  g_array_append_val(description->anchors, anchor);
+
+  /* Two cards with the same title no longer overwrite each other */
+  g_ptr_array_add(column->cards, kanban_card_record_new("Same", FALSE, description));
+  g_ptr_array_add(column->cards, kanban_card_record_new("Same", TRUE, NULL));
+  g_ptr_array_add(board->columns, column);
+
+  gsize  length = 0;
+  gchar* data   = kanban_board_record_to_data(board, &length);
+  kanban_board_record_free(board);
+
+  GError*     error  = NULL;
+  JsonParser* parser = json_parser_new();
+  gboolean    migrated;
+
+  json_parser_load_from_data(parser, data, length, &error);
+  g_assert_no_error(error);
+
+  board = kanban_board_record_from_json(json_parser_get_root(parser), &migrated, &error);
+  g_assert_no_error(error);
+  g_assert_false(migrated);
+
+  g_assert_cmpuint(board->columns->len, ==, 1);
+  column = g_ptr_array_index(board->columns, 0);
+  g_assert_cmpuint(column->cards->len, ==, 2);
+
+  KanbanCardRecord* card = get_card(board, 0, 0);
+  g_assert_cmpstr(card->title, ==, "Same");
+  g_assert_false(card->revealed);
+  g_assert_cmpstr(card->description->text->str, ==, "abc\ndef");
+  g_assert_cmpuint(card->description->anchors->len, ==, 1);
+  g_assert_cmpuint(g_array_index(card->description->anchors, KanbanAnchor, 0).offset, ==, 3);
+  g_assert_cmpstr(g_array_index(card->description->anchors, KanbanAnchor, 0).title, ==, "He said \"hi\"/>");
+
+  card = get_card(board, 0, 1);
+  g_assert_true(card->revealed);
+  g_assert_cmpuint(card->description->text->len, ==, 0);
+  g_assert_cmpuint(card->id, !=, get_card(board, 0, 0)->id);
+
+  kanban_board_record_free(board);
+  g_object_unref(parser);
+  g_free(data);
+}
+
+static void
+test_encoded_card(void)
+{
+  KanbanUnserializedContent* description = kanban_unserialized_content_new();
+  g_string_assign(description->text, "tab\there \"quoted\" back\\slash \x01");
+
+  KanbanCardRecord* card    = kanban_card_record_new("Cached", TRUE, description);
+  GBytes*           encoded = kanban_card_record_encode(card);
+
+  /* A cached card is written verbatim */
+  KanbanBoardRecord*  board  = kanban_board_record_new();
+  KanbanColumnRecord* column = kanban_column_record_new("Column");
+  g_ptr_array_add(column->cards, kanban_card_record_new_encoded("Cached", TRUE, encoded));
+  g_ptr_array_add(board->columns, column);
+
+  gsize  size   = 0;
+  gchar* needle = g_strndup(g_bytes_get_data(encoded, &size), size);
+  gsize  length = 0;
+  gchar* data   = kanban_board_record_to_data(board, &length);
+  g_assert_nonnull(g_strstr_len(data, length, needle));
+  kanban_board_record_free(board);
+  g_free(needle);
+
+  GError*     error  = NULL;
+  JsonParser* parser = json_parser_new();
+  json_parser_load_from_data(parser, data, length, &error);
+  g_assert_no_error(error);
+
+  board = kanban_board_record_from_json(json_parser_get_root(parser), NULL, &error);
+  g_assert_no_error(error);
+  g_assert_cmpstr(get_card(board, 0, 0)->description->text->str, ==,
+                  card->description->text->str);
+
+  kanban_board_record_free(board);
+  g_object_unref(parser);
+  g_free(data);
+  g_bytes_unref(encoded);
+  kanban_card_record_free(card);
+}
+
+static void
+test_stream_write(void)
+{
+  KanbanBoardRecord* board = kanban_board_record_new();
+
+  for (guint i = 0; i < 3; i++)
+  {
+    gchar* title = g_strdup_printf("Column %u", i);
+    KanbanColumnRecord* column = kanban_column_record_new(title);
+
+    for (guint j = 0; j < 500; j++)
+    {
+      KanbanUnserializedContent* description = kanban_unserialized_content_new();
+
+      /* One card bigger than the stream buffer on its own */
+      if (i == 1 && j == 250)
+        for (guint k = 0; k < 10000; k++)
+          g_string_append(description->text, "line \"ten\"\n");
+      else
+        g_string_printf(description->text, "Card %u of %s", j, title);
+
+      g_ptr_array_add(column->cards, kanban_card_record_new("Card", j % 2, description));
+    }
+
+    g_ptr_array_add(board->columns, column);
+    g_free(title);
+  }
+
+  GError*        error  = NULL;
+  GOutputStream* stream = g_memory_output_stream_new_resizable();
+
+  g_assert_true(kanban_board_record_write(board, stream, NULL, &error));
+  g_assert_no_error(error);
+  g_output_stream_close(stream, NULL, NULL);
+
+  /* Same bytes as the in-memory encoder */
+  GMemoryOutputStream* memory = G_MEMORY_OUTPUT_STREAM(stream);
+  gsize  length = 0;
+  gchar* data   = kanban_board_record_to_data(board, &length);
+
+  g_assert_cmpuint(g_memory_output_stream_get_data_size(memory), ==, length);
+  g_assert_cmpmem(g_memory_output_stream_get_data(memory), length, data, length);
+
+  JsonParser* parser = json_parser_new();
+  json_parser_load_from_data(parser, data, length, &error);
+  g_assert_no_error(error);
+
+  KanbanBoardRecord* again = kanban_board_record_from_json(json_parser_get_root(parser),
+                                                           NULL, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(again->columns->len, ==, 3);
+  g_assert_cmpuint(((KanbanColumnRecord*)g_ptr_array_index(again->columns, 2))->cards->len,
+                   ==, 500);
+  g_assert_cmpuint(get_card(again, 1, 250)->description->text->len, ==,
+                   get_card(board, 1, 250)->description->text->len);
+  g_assert_cmpuint(get_card(again, 1, 250)->id, ==, get_card(board, 1, 250)->id);
+
+  kanban_board_record_free(again);
+  g_object_unref(parser);
+  g_free(data);
+  g_object_unref(stream);
+
+  /* A stream that fills up reports it */
+  stream = g_memory_output_stream_new(g_malloc(1024), 1024, NULL, g_free);
+  g_assert_false(kanban_board_record_write(board, stream, NULL, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NO_SPACE);
+  g_clear_error(&error);
+  g_object_unref(stream);
+
+  kanban_board_record_free(board);
+}
+
+/* Removes a sharded board with whatever it holds */
+static void
+remove_dir(const gchar* dir_path)
+{
+  GDir* dir = g_dir_open(dir_path, 0, NULL);
+  const gchar* name;
+
+  while (dir && (name = g_dir_read_name(dir)) != NULL)
+  {
+    gchar* path = g_build_filename(dir_path, name, NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+
+  g_clear_pointer(&dir, g_dir_close);
+  g_rmdir(dir_path);
+}
+
+static KanbanColumnRecord*
+make_column(const gchar* title, const gchar* card_title)
+{
+  KanbanColumnRecord* column = kanban_column_record_new(title);
+
+  column->shard = kanban_board_shard_new_name();
+  g_ptr_array_add(column->cards, kanban_card_record_new(card_title, FALSE, NULL));
+
+  return column;
+}
+
+static void
+test_dir_round_trip(void)
+{
+  GError* error = NULL;
+  gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  g_assert_no_error(error);
+
+  KanbanBoardRecord* board = kanban_board_record_new();
+  g_ptr_array_add(board->columns, make_column("Monday", "A"));
+  g_ptr_array_add(board->columns, make_column("Tuesday", "B"));
+  g_ptr_array_add(board->columns, make_column("Wednesday", "C"));
+
+  g_assert_true(kanban_board_dir_save(board, dir, &error));
+  g_assert_no_error(error);
+
+  /* Only dirty columns are written, the others keep their shard */
+  KanbanColumnRecord* monday  = g_ptr_array_index(board->columns, 0);
+  KanbanColumnRecord* tuesday = g_ptr_array_index(board->columns, 1);
+  gchar* monday_path  = g_build_filename(dir, monday->shard, NULL);
+  gchar* tuesday_path = g_build_filename(dir, tuesday->shard, NULL);
+
+  monday->dirty = FALSE;
+  g_ptr_array_set_size(monday->cards, 0);
+  g_free(tuesday->title);
+  tuesday->title = g_strdup("Thursday");
+
+  /* Removed columns lose their shard */
+  KanbanColumnRecord* wednesday = g_ptr_array_index(board->columns, 2);
+  gchar* wednesday_path = g_build_filename(dir, wednesday->shard, NULL);
+  g_ptr_array_remove_index(board->columns, 2);
+
+  g_assert_true(kanban_board_dir_save(board, dir, &error));
+  g_assert_no_error(error);
+  g_assert_true(g_file_test(monday_path, G_FILE_TEST_EXISTS));
+  g_assert_false(g_file_test(wednesday_path, G_FILE_TEST_EXISTS));
+
+  /* Written columns get a new shard, the former one goes with the save */
+  g_assert_false(g_file_test(tuesday_path, G_FILE_TEST_EXISTS));
+  g_free(tuesday_path);
+  tuesday_path = g_build_filename(dir, tuesday->shard, NULL);
+  g_assert_true(g_file_test(tuesday_path, G_FILE_TEST_EXISTS));
+
+  gchar* wednesday_snapshot = kanban_board_snapshot_path(wednesday_path);
+  g_assert_false(g_file_test(wednesday_snapshot, G_FILE_TEST_EXISTS));
+  g_free(wednesday_snapshot);
+  kanban_board_record_free(board);
+
+  board = kanban_board_dir_load(dir, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(board->columns->len, ==, 2);
+
+  monday  = g_ptr_array_index(board->columns, 0);
+  tuesday = g_ptr_array_index(board->columns, 1);
+  g_assert_cmpstr(monday->title, ==, "Monday");
+  g_assert_cmpuint(monday->cards->len, ==, 1);
+  g_assert_cmpstr(get_card(board, 0, 0)->title, ==, "A");
+  g_assert_false(monday->dirty);
+  g_assert_cmpstr(tuesday->title, ==, "Thursday");
+  g_assert_cmpstr(get_card(board, 1, 0)->title, ==, "B");
+
+  kanban_board_record_free(board);
+  remove_dir(dir);
+
+  g_free(wednesday_path);
+  g_free(tuesday_path);
+  g_free(monday_path);
+  g_free(dir);
+}
+
+static void
+save_done(GObject* source, GAsyncResult* result, gpointer user_data)
+{
+  GError* error = NULL;
+
+  g_assert_true(kanban_board_dir_save_finish(result, &error));
+  g_assert_no_error(error);
+  *(gboolean*)user_data = TRUE;
+}
+
+static void
+test_dir_save_async(void)
+{
+  GError* error = NULL;
+  gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  g_assert_no_error(error);
+
+  KanbanBoardRecord*  board  = kanban_board_record_new();
+  KanbanColumnRecord* column = make_column("Monday", "A");
+  gboolean done = FALSE;
+  guint64 id = ((KanbanCardRecord*)g_ptr_array_index(column->cards, 0))->id;
+
+  board->journal = 4;
+  g_ptr_array_add(board->columns, column);
+
+  /* The worker owns the board from here on */
+  kanban_board_dir_save_async(board, dir, NULL, save_done, &done);
+  while (!done)
+    g_main_context_iteration(NULL, TRUE);
+
+  board = kanban_board_dir_load(dir, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(board->journal, ==, 4);
+  g_assert_cmpuint(board->columns->len, ==, 1);
+  g_assert_cmpstr(get_card(board, 0, 0)->title, ==, "A");
+  g_assert_cmpuint(get_card(board, 0, 0)->id, ==, id);
+  kanban_board_record_free(board);
+  remove_dir(dir);
+
+  g_free(dir);
+}
+
+/* Shards are read back from their snapshot, unless it is out of date */
+static void
+test_dir_snapshot(void)
+{
+  GError* error = NULL;
+  gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  g_assert_no_error(error);
+
+  KanbanBoardRecord*  board      = kanban_board_record_new();
+  KanbanColumnRecord* column     = make_column("Monday", "A");
+  KanbanCardRecord*   card       = g_ptr_array_index(column->cards, 0);
+  KanbanAnchor        anchor     = { 2, g_strdup("Task"), TRUE };
+  guint64             id         = card->id;
+  gchar*              shard_path = g_build_filename(dir, column->shard, NULL);
+  gchar*              snapshot   = kanban_board_snapshot_path(shard_path);
+
+  g_string_assign(card->description->text, "Übung");
+  g_array_append_val(card->description->anchors, anchor);
+  card->revealed = TRUE;
+  g_ptr_array_add(board->columns, column);
+
+  g_assert_true(kanban_board_dir_save(board, dir, &error));
+  g_assert_no_error(error);
+  g_assert_true(g_file_test(snapshot, G_FILE_TEST_EXISTS));
+  kanban_board_record_free(board);
+
+  /* Titles come without decoding, the rest when the card is used */
+  board = kanban_board_dir_load(dir, &error);
+  g_assert_no_error(error);
+  column = g_ptr_array_index(board->columns, 0);
+  card   = get_card(board, 0, 0);
+  g_assert_cmpstr(column->title, ==, "Monday");
+  g_assert_false(column->dirty);
+  g_assert_cmpstr(card->title, ==, "A");
+  g_assert_cmpuint(card->id, ==, id);
+  g_assert_true(card->revealed);
+  g_assert_null(card->description);
+  g_assert_nonnull(card->encoded);
+
+  KanbanCardItem* item = kanban_card_item_new_from_record(card);
+  const KanbanUnserializedContent* description = kanban_card_item_get_description(item);
+  g_assert_cmpstr(description->text->str, ==, "Übung");
+  g_assert_cmpuint(description->anchors->len, ==, 1);
+  g_assert_cmpstr(g_array_index(description->anchors, KanbanAnchor, 0).title, ==, "Task");
+  g_object_unref(item);
+  kanban_board_record_free(board);
+
+  /* A shard changed behind the board's back outdates its snapshot */
+  g_assert_true(g_file_set_contents(shard_path,
+                                    "{\"version\":2,\"title\":\"Changed\",\"cards\":"
+                                    "[{\"id\":7,\"title\":\"B\",\"text\":\"x\"}]}",
+                                    -1, &error));
+  g_assert_no_error(error);
+
+  board = kanban_board_dir_load(dir, &error);
+  g_assert_no_error(error);
+  card = get_card(board, 0, 0);
+  g_assert_cmpstr(((KanbanColumnRecord*)g_ptr_array_index(board->columns, 0))->title, ==,
+                  "Changed");
+  g_assert_cmpuint(card->id, ==, 7);
+  g_assert_nonnull(card->description);
+  kanban_board_record_free(board);
+
+  /* Reading the shard wrote the snapshot again */
+  board = kanban_board_dir_load(dir, &error);
+  g_assert_no_error(error);
+  card = get_card(board, 0, 0);
+  g_assert_cmpstr(card->title, ==, "B");
+  g_assert_null(card->description);
+  kanban_board_record_free(board);
+
+  /* Damaged snapshots are ignored */
+  g_assert_true(g_file_set_contents(snapshot, "garbage", -1, &error));
+  g_assert_no_error(error);
+  board = kanban_board_dir_load(dir, &error);
+  g_assert_no_error(error);
+  g_assert_cmpstr(get_card(board, 0, 0)->title, ==, "B");
+  g_assert_nonnull(get_card(board, 0, 0)->description);
+  kanban_board_record_free(board);
+
+  remove_dir(dir);
+
+  g_free(snapshot);
+  g_free(shard_path);
+  g_free(dir);
+}
+
+static void
+test_newer_version(void)
+{
+  GError*     error  = NULL;
+  JsonParser* parser = json_parser_new();
+
+  json_parser_load_from_data(parser, "{\"version\":99,\"columns\":[]}", -1, &error);
+  g_assert_no_error(error);
+
+  KanbanBoardRecord* board = kanban_board_record_from_json(json_parser_get_root(parser),
+                                                           NULL, &error);
+  g_assert_null(board);
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+
+  g_error_free(error);
+  g_object_unref(parser);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/board-file/migrate-legacy", test_migrate_legacy);
+  g_test_add_func("/board-file/round-trip", test_round_trip);
+  g_test_add_func("/board-file/encoded-card", test_encoded_card);
+  g_test_add_func("/board-file/stream-write", test_stream_write);
+  g_test_add_func("/board-file/dir-round-trip", test_dir_round_trip);
+  g_test_add_func("/board-file/dir-save-async", test_dir_save_async);
+  g_test_add_func("/board-file/dir-snapshot", test_dir_snapshot);
+  g_test_add_func("/board-file/newer-version", test_newer_version);
+
+  return g_test_run();
+}
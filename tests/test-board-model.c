@@ -0,0 +1,410 @@
+/* test-board-model.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include "utils/kanban-board-model.h"
+
+typedef struct
+{
+  guint position;
+  guint removed;
+  guint added;
+  guint changes;
+} ItemsChanged;
+
+static void
+items_changed(GListModel* model, guint position, guint removed, guint added,
+              gpointer user_data)
+{
+  ItemsChanged* changed = user_data;
+
+  changed->position = position;
+  changed->removed  = removed;
+  changed->added    = added;
+  changed->changes++;
+}
+
+static KanbanCardItem*
+make_card(const gchar* title)
+{
+  KanbanUnserializedContent* description = kanban_unserialized_content_new();
+
+  g_string_assign(description->text, "Some notes");
+  return kanban_card_item_new(title, FALSE, description);
+}
+
+static void
+test_column_model(void)
+{
+  KanbanColumnItem* column = kanban_column_item_new("Monday");
+  ItemsChanged changed = { 0 };
+  const gchar* titles[] = { "First", "Second", "Third" };
+
+  g_signal_connect(column, "items-changed", G_CALLBACK(items_changed), &changed);
+
+  for (guint i = 0; i < G_N_ELEMENTS(titles); i++)
+  {
+    KanbanCardItem* card = make_card(titles[i]);
+    kanban_column_item_append(column, card);
+    g_object_unref(card);
+  }
+
+  g_assert_cmpuint(g_list_model_get_item_type(G_LIST_MODEL(column)), ==, KANBAN_TYPE_CARD_ITEM);
+  g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(column)), ==, 3);
+  g_assert_cmpuint(changed.changes, ==, 3);
+  g_assert_cmpuint(changed.position, ==, 2);
+  g_assert_cmpuint(changed.added, ==, 1);
+
+  KanbanCardItem* second = g_list_model_get_item(G_LIST_MODEL(column), 1);
+  g_assert_cmpstr(kanban_card_item_get_title(second), ==, "Second");
+  g_assert_true(kanban_card_item_get_column(second) == column);
+  g_assert_cmpint(kanban_column_item_get_position(column, second), ==, 1);
+
+  kanban_column_item_remove(column, 1);
+  g_assert_cmpuint(changed.position, ==, 1);
+  g_assert_cmpuint(changed.removed, ==, 1);
+  g_assert_null(kanban_card_item_get_column(second));
+  g_assert_cmpint(kanban_column_item_get_position(column, second), ==, -1);
+
+  /* A card can move to another column once removed */
+  kanban_column_item_insert(column, 0, second);
+  g_assert_cmpstr(kanban_card_item_get_title(kanban_column_item_get_card(column, 0)),
+                  ==, "Second");
+  g_assert_null(g_list_model_get_item(G_LIST_MODEL(column), 3));
+
+  g_object_unref(second);
+  g_object_unref(column);
+}
+
+static void
+count_card_changes(KanbanColumnItem* column, KanbanCardItem* card, gpointer user_data)
+{
+  (*(guint*)user_data)++;
+}
+
+static void
+test_dirty(void)
+{
+  KanbanColumnItem* column = kanban_column_item_new("Monday");
+  KanbanCardItem* card = make_card("Card");
+  guint card_changes = 0;
+
+  g_signal_connect(column, "card-changed", G_CALLBACK(count_card_changes), &card_changes);
+
+  kanban_column_item_append(column, card);
+  g_assert_true(kanban_column_item_get_dirty(column));
+
+  kanban_column_item_clear_dirty(column);
+  g_assert_false(kanban_column_item_get_dirty(column));
+
+  /* Setting the same title is not an edit */
+  kanban_card_item_set_title(card, "Card");
+  g_assert_false(kanban_column_item_get_dirty(column));
+  g_assert_cmpuint(card_changes, ==, 0);
+
+  /* Neither is expanding it */
+  kanban_card_item_set_revealed(card, TRUE);
+  g_assert_false(kanban_column_item_get_dirty(column));
+  g_assert_cmpuint(card_changes, ==, 0);
+
+  kanban_card_item_set_title(card, "Edited");
+  g_assert_true(kanban_column_item_get_dirty(column));
+  g_assert_cmpuint(card_changes, ==, 1);
+
+  kanban_column_item_clear_dirty(column);
+  kanban_column_item_set_title(column, "Tuesday");
+  g_assert_true(kanban_column_item_get_dirty(column));
+
+  g_object_unref(card);
+  g_object_unref(column);
+}
+
+static void
+count_notifies(GObject* object, GParamSpec* pspec, gpointer user_data)
+{
+  (*(guint*)user_data)++;
+}
+
+static void
+test_dirty_tracker(void)
+{
+  KanbanBoardModel* model = kanban_board_model_new();
+  KanbanColumnItem* monday = kanban_column_item_new("Monday");
+  KanbanColumnItem* tuesday = kanban_column_item_new("Tuesday");
+  KanbanCardItem* card = make_card("Card");
+  guint notifies = 0;
+
+  g_signal_connect(model, "notify::dirty", G_CALLBACK(count_notifies), &notifies);
+  g_assert_false(kanban_board_model_get_dirty(model));
+
+  /* New columns have yet to be saved */
+  kanban_board_model_append(model, monday);
+  kanban_board_model_append(model, tuesday);
+  kanban_column_item_append(monday, card);
+  g_assert_true(kanban_board_model_get_dirty(model));
+  g_assert_cmpuint(notifies, ==, 1);
+
+  kanban_board_model_clear_dirty(model);
+  g_assert_false(kanban_board_model_get_dirty(model));
+  g_assert_false(kanban_column_item_get_dirty(monday));
+  g_assert_false(kanban_column_item_get_dirty(tuesday));
+  g_assert_cmpuint(notifies, ==, 2);
+
+  /* However many edits, the board is told once */
+  for (guint i = 0; i < 1000; i++)
+    kanban_card_item_description_changed(card);
+  kanban_column_item_set_title(tuesday, "Wednesday");
+  g_assert_true(kanban_board_model_get_dirty(model));
+  g_assert_cmpuint(notifies, ==, 3);
+
+  /* A column saved on its own leaves the board dirty until the last */
+  kanban_column_item_clear_dirty(monday);
+  g_assert_true(kanban_board_model_get_dirty(model));
+  kanban_column_item_clear_dirty(tuesday);
+  g_assert_false(kanban_board_model_get_dirty(model));
+  g_assert_cmpuint(notifies, ==, 4);
+
+  /* Removing a clean column still changes the board file */
+  kanban_board_model_remove(model, 1);
+  g_assert_true(kanban_board_model_get_dirty(model));
+  kanban_board_model_clear_dirty(model);
+
+  kanban_board_model_mark_dirty(model);
+  g_assert_true(kanban_board_model_get_dirty(model));
+  g_assert_cmpuint(notifies, ==, 7);
+
+  g_object_unref(card);
+  g_object_unref(tuesday);
+  g_object_unref(monday);
+  g_object_unref(model);
+}
+
+static KanbanUnserializedContent*
+edited_description(gpointer user_data)
+{
+  KanbanUnserializedContent* description = kanban_unserialized_content_new();
+
+  (*(guint*)user_data)++;
+  g_string_assign(description->text, "Edited");
+  return description;
+}
+
+static void
+test_source(void)
+{
+  KanbanCardItem* card = make_card("Card");
+  guint pulls = 0;
+
+  GBytes* before = kanban_card_item_get_encoded(card);
+  GBytes* cached = kanban_card_item_get_encoded(card);
+  g_assert_true(before == cached);
+
+  /* Edits only mark the item, the description is pulled when needed */
+  kanban_card_item_set_source(card, edited_description, &pulls);
+  kanban_card_item_description_changed(card);
+  kanban_card_item_description_changed(card);
+  g_assert_cmpuint(pulls, ==, 0);
+
+  GBytes* after = kanban_card_item_get_encoded(card);
+  g_assert_cmpuint(pulls, ==, 1);
+  g_assert_false(g_bytes_equal(before, after));
+  g_assert_cmpstr(kanban_card_item_get_description(card)->text->str, ==, "Edited");
+
+  /* Unregistering pulls the last edits */
+  kanban_card_item_description_changed(card);
+  kanban_card_item_set_source(card, NULL, NULL);
+  g_assert_cmpuint(pulls, ==, 2);
+  kanban_card_item_description_changed(card);
+  g_assert_cmpuint(pulls, ==, 2);
+
+  g_bytes_unref(before);
+  g_bytes_unref(cached);
+  g_bytes_unref(after);
+  g_object_unref(card);
+}
+
+static void
+test_record_round_trip(void)
+{
+  KanbanBoardRecord* board = kanban_board_record_new();
+  KanbanColumnRecord* record = kanban_column_record_new("Monday");
+  KanbanCardItem* card = make_card("Encoded");
+
+  /* Cards that only carry their encoded form are decoded */
+  g_ptr_array_add(record->cards, kanban_card_item_get_record(card));
+  g_ptr_array_add(record->cards, kanban_card_record_new("Plain", TRUE, NULL));
+  record->shard = g_strdup("column-kept.json");
+  record->dirty = FALSE;
+  g_ptr_array_add(board->columns, record);
+
+  KanbanBoardModel* model = kanban_board_model_new_from_record(board);
+  g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(model)), ==, 1);
+
+  KanbanColumnItem* column = kanban_board_model_get_column(model, 0);
+  g_assert_cmpint(kanban_board_model_get_position(model, column), ==, 0);
+  g_assert_cmpstr(kanban_column_item_get_shard(column), ==, "column-kept.json");
+  g_assert_false(kanban_column_item_get_dirty(column));
+
+  KanbanCardItem* decoded = kanban_column_item_get_card(column, 0);
+  g_assert_cmpstr(kanban_card_item_get_title(decoded), ==, "Encoded");
+  g_assert_cmpstr(kanban_card_item_get_description(decoded)->text->str, ==, "Some notes");
+  g_assert_true(kanban_card_item_get_revealed(kanban_column_item_get_card(column, 1)));
+
+  KanbanBoardRecord* again = kanban_board_model_get_record(model);
+  gsize len = 0, again_len = 0;
+  gchar* data = kanban_board_record_to_data(board, &len);
+  gchar* again_data = kanban_board_record_to_data(again, &again_len);
+  g_assert_cmpmem(data, len, again_data, again_len);
+
+  kanban_board_model_remove(model, 0);
+  g_assert_cmpuint(g_list_model_get_n_items(G_LIST_MODEL(model)), ==, 0);
+
+  g_free(data);
+  g_free(again_data);
+  kanban_board_record_free(again);
+  kanban_board_record_free(board);
+  g_object_unref(model);
+  g_object_unref(card);
+}
+
+/* Expanding a card keeps its encoded form, only the flag in it changes */
+static void
+test_revealed(void)
+{
+  KanbanCardItem*   card   = make_card("revealed");
+  KanbanCardRecord* record = kanban_card_item_get_record(card);
+  KanbanCardItem*   loaded = kanban_card_item_new_from_record(record);
+
+  kanban_card_item_clear_dirty(loaded);
+  kanban_card_item_set_revealed(loaded, TRUE);
+  g_assert_false(kanban_card_item_get_dirty(loaded));
+
+  KanbanCardRecord expected = {
+    .id          = kanban_card_item_get_id(card),
+    .title       = "revealed",
+    .revealed    = TRUE,
+    .description = (KanbanUnserializedContent*)kanban_card_item_get_description(card),
+  };
+  GBytes* encoded = kanban_card_record_encode(&expected);
+  GBytes* patched = kanban_card_item_get_encoded(loaded);
+
+  g_assert_true(g_bytes_equal(patched, encoded));
+
+  /* Without the flag, the card is encoded again */
+  GBytes* plain = g_bytes_new_static("{\"title\":\"revealed\"}", 20);
+  g_assert_null(kanban_card_encoded_set_revealed(plain, TRUE));
+
+  g_bytes_unref(plain);
+  g_bytes_unref(patched);
+  g_bytes_unref(encoded);
+  g_object_unref(loaded);
+  kanban_card_record_free(record);
+  g_object_unref(card);
+}
+
+static void
+test_card_ids(void)
+{
+  KanbanBoardModel* model = kanban_board_model_new();
+  KanbanColumnItem* monday = kanban_column_item_new("Monday");
+  KanbanColumnItem* tuesday = kanban_column_item_new("Tuesday");
+  KanbanCardItem* cards[100];
+
+  kanban_board_model_append(model, monday);
+  kanban_board_model_append(model, tuesday);
+
+  for (guint i = 0; i < G_N_ELEMENTS(cards); i++) {
+    /* Titles need not be unique */
+    cards[i] = make_card("Same");
+    kanban_column_item_append(monday, cards[i]);
+    g_assert_cmpuint(kanban_card_item_get_id(cards[i]), !=, 0);
+  }
+
+  g_assert_true(kanban_column_item_lookup(monday, kanban_card_item_get_id(cards[42])) == cards[42]);
+  g_assert_null(kanban_column_item_lookup(tuesday, kanban_card_item_get_id(cards[42])));
+
+  /* Positions follow inserts and removes in the middle */
+  kanban_column_item_remove(monday, 10);
+  g_assert_cmpint(kanban_column_item_get_position(monday, cards[99]), ==, 98);
+  g_assert_cmpint(kanban_column_item_get_position(monday, cards[11]), ==, 10);
+  g_assert_cmpint(kanban_column_item_get_position(monday, cards[10]), ==, -1);
+  g_assert_null(kanban_column_item_lookup(monday, kanban_card_item_get_id(cards[10])));
+
+  kanban_column_item_insert(monday, 0, cards[10]);
+  g_assert_cmpint(kanban_column_item_get_position(monday, cards[10]), ==, 0);
+  g_assert_cmpint(kanban_column_item_get_position(monday, cards[0]), ==, 1);
+  g_assert_cmpint(kanban_column_item_get_position(monday, cards[99]), ==, 99);
+
+  /* A card keeps its id as it moves */
+  guint64 id = kanban_card_item_get_id(cards[50]);
+  kanban_column_item_remove(monday, kanban_column_item_get_position(monday, cards[50]));
+  kanban_column_item_append(tuesday, cards[50]);
+  g_assert_cmpuint(kanban_card_item_get_id(cards[50]), ==, id);
+  g_assert_true(kanban_board_model_lookup_card(model, id) == cards[50]);
+  g_assert_cmpint(kanban_column_item_get_position(tuesday, cards[50]), ==, 0);
+
+  /* A second card with the same id gets another one */
+  KanbanCardRecord* record = kanban_card_item_get_record(cards[0]);
+  KanbanCardItem* copy = kanban_card_item_new_from_record(record);
+  g_assert_cmpuint(kanban_card_item_get_id(copy), ==, kanban_card_item_get_id(cards[0]));
+  kanban_column_item_append(monday, copy);
+  g_assert_cmpuint(kanban_card_item_get_id(copy), !=, kanban_card_item_get_id(cards[0]));
+  g_assert_true(kanban_column_item_lookup(monday, kanban_card_item_get_id(cards[0])) == cards[0]);
+  g_assert_true(kanban_column_item_lookup(monday, kanban_card_item_get_id(copy)) == copy);
+
+  /* Ids last through the board file */
+  GBytes* encoded = kanban_card_item_get_encoded(cards[0]);
+  JsonParser* parser = json_parser_new();
+  gsize size = 0;
+  const gchar* data = g_bytes_get_data(encoded, &size);
+
+  g_assert_true(json_parser_load_from_data(parser, data, size, NULL));
+  KanbanCardRecord* decoded =
+    kanban_card_record_from_json(json_node_get_object(json_parser_get_root(parser)));
+  g_assert_cmpuint(decoded->id, ==, kanban_card_item_get_id(cards[0]));
+
+  kanban_card_record_free(decoded);
+  g_object_unref(parser);
+  g_bytes_unref(encoded);
+  kanban_card_record_free(record);
+  g_object_unref(copy);
+  for (guint i = 0; i < G_N_ELEMENTS(cards); i++)
+    g_object_unref(cards[i]);
+  g_object_unref(tuesday);
+  g_object_unref(monday);
+  g_object_unref(model);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/board-model/column", test_column_model);
+  g_test_add_func("/board-model/dirty", test_dirty);
+  g_test_add_func("/board-model/dirty-tracker", test_dirty_tracker);
+  g_test_add_func("/board-model/source", test_source);
+  g_test_add_func("/board-model/record-round-trip", test_record_round_trip);
+  g_test_add_func("/board-model/revealed", test_revealed);
+  g_test_add_func("/board-model/card-ids", test_card_ids);
+
+  return g_test_run();
+}
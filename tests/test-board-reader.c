@@ -0,0 +1,355 @@
+/* test-board-reader.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+#include "utils/kanban-board-reader.h"
+#include "utils/kanban-card-decoder.h"
+
+static KanbanBoardReader*
+reader_for(const gchar* data)
+{
+  GInputStream* stream = g_memory_input_stream_new_from_data(data, -1, NULL);
+  KanbanBoardReader* reader = kanban_board_reader_new(stream);
+
+  g_object_unref(stream);
+  return reader;
+}
+
+static KanbanCardRecord*
+get_card(KanbanColumnRecord* column, guint card)
+{
+  return g_ptr_array_index(column->cards, card);
+}
+
+static void
+test_board(void)
+{
+  static const gchar data[] =
+    "{ \"version\": 2, \"extra\": {\"a\": [1, \"]}\"]},\n"
+    "  \"columns\": [\n"
+    "    { \"title\": \"Mon\\u00e9 \\ud83d\\ude00 \\\"day\\\"\",\n"
+    "      \"cards\": [ { \"id\": 7, \"title\": \"A\", \"revealed\": true, \"text\": \"x\\ny\",\n"
+    "                     \"tasks\": [ { \"offset\": 1, \"title\": \"t\", \"done\": true } ] },\n"
+    "                   \"not a card\",\n"
+    "                   { \"id\": 8, \"title\": \"B\" } ] },\n"
+    "    [ \"not a column\" ],\n"
+    "    { \"cards\": [], \"title\": \"Tue\" }\n"
+    "  ],\n"
+    "  \"trailing\": null }";
+
+  KanbanBoardReader*  reader  = reader_for(data);
+  GError*             error   = NULL;
+  gboolean            new_ids = TRUE;
+  KanbanColumnRecord* column  = kanban_board_reader_next_column(reader, &new_ids, NULL, &error);
+
+  g_assert_no_error(error);
+  g_assert_nonnull(column);
+  g_assert_false(new_ids);
+  g_assert_cmpstr(column->title, ==, "Moné 😀 \"day\"");
+  g_assert_cmpuint(column->cards->len, ==, 2);
+
+  KanbanCardRecord* card = get_card(column, 0);
+  g_assert_cmpuint(card->id, ==, 7);
+  g_assert_cmpstr(card->title, ==, "A");
+  g_assert_true(card->revealed);
+  g_assert_cmpstr(card->description->text->str, ==, "x\ny");
+  g_assert_cmpuint(card->description->anchors->len, ==, 1);
+  g_assert_cmpuint(get_card(column, 1)->id, ==, 8);
+  kanban_column_record_free(column);
+
+  column = kanban_board_reader_next_column(reader, NULL, NULL, &error);
+  g_assert_no_error(error);
+  g_assert_cmpstr(column->title, ==, "Tue");
+  g_assert_cmpuint(column->cards->len, ==, 0);
+  kanban_column_record_free(column);
+
+  g_assert_null(kanban_board_reader_next_column(reader, NULL, NULL, &error));
+  g_assert_no_error(error);
+  g_assert_false(kanban_board_reader_is_legacy(reader));
+
+  kanban_board_reader_free(reader);
+}
+
+static void
+test_shard(void)
+{
+  KanbanBoardReader*  reader  = reader_for("{\"version\":2,\"cards\":[{\"title\":\"No id\"}],"
+                                           "\"title\":\"Late title\"}");
+  GError*             error   = NULL;
+  gboolean            new_ids = FALSE;
+  KanbanColumnRecord* column  = kanban_board_reader_next_column(reader, &new_ids, NULL, &error);
+
+  g_assert_no_error(error);
+  g_assert_cmpstr(column->title, ==, "Late title");
+  g_assert_cmpuint(column->cards->len, ==, 1);
+  g_assert_cmpuint(get_card(column, 0)->id, !=, 0);
+  g_assert_true(new_ids);
+  kanban_column_record_free(column);
+
+  g_assert_null(kanban_board_reader_next_column(reader, NULL, NULL, &error));
+  g_assert_no_error(error);
+  kanban_board_reader_free(reader);
+}
+
+static void
+test_errors(void)
+{
+  GError* error = NULL;
+
+  /* Legacy boards are left to the JSON tree reader */
+  KanbanBoardReader* reader = reader_for("{\"Monday\":{\"Card\":{\"description\":\"\"}}}");
+  g_assert_null(kanban_board_reader_next_column(reader, NULL, NULL, &error));
+  g_assert_no_error(error);
+  g_assert_true(kanban_board_reader_is_legacy(reader));
+  kanban_board_reader_free(reader);
+
+  /* Whatever the title of their first column */
+  static const gchar* titles[] = { "title", "cards", "columns", "version", NULL };
+
+  for (const gchar** title = titles; *title != NULL; title++)
+  {
+    gchar* data = g_strdup_printf("{\"%s\":{\"Card\":{\"description\":\"\"}},"
+                                  "\"Tuesday\":{}}", *title);
+
+    reader = reader_for(data);
+    g_assert_null(kanban_board_reader_next_column(reader, NULL, NULL, &error));
+    g_assert_no_error(error);
+    g_assert_true(kanban_board_reader_is_legacy(reader));
+    kanban_board_reader_free(reader);
+    g_free(data);
+  }
+
+  /* And so is a board with neither a version nor columns */
+  reader = reader_for("{}");
+  g_assert_null(kanban_board_reader_next_column(reader, NULL, NULL, &error));
+  g_assert_no_error(error);
+  g_assert_true(kanban_board_reader_is_legacy(reader));
+  kanban_board_reader_free(reader);
+
+  reader = reader_for("{\"version\":99,\"columns\":[{\"title\":\"Mon\"}]}");
+  g_assert_null(kanban_board_reader_next_column(reader, NULL, NULL, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED);
+  g_clear_error(&error);
+  kanban_board_reader_free(reader);
+
+  /* Columns read before the file breaks off are kept */
+  reader = reader_for("{\"version\":2,\"columns\":[{\"title\":\"Mon\",\"cards\":[]},"
+                      "{\"title\":\"Tue\",\"cards\":[{\"title\":\"cut");
+  KanbanColumnRecord* column = kanban_board_reader_next_column(reader, NULL, NULL, &error);
+  g_assert_no_error(error);
+  g_assert_cmpstr(column->title, ==, "Mon");
+  kanban_column_record_free(column);
+
+  g_assert_null(kanban_board_reader_next_column(reader, NULL, NULL, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_clear_error(&error);
+  g_assert_null(kanban_board_reader_next_column(reader, NULL, NULL, &error));
+  g_assert_no_error(error);
+  kanban_board_reader_free(reader);
+}
+
+static void
+count_column(KanbanColumnRecord* column, gpointer user_data)
+{
+  GPtrArray* columns = user_data;
+
+  g_ptr_array_add(columns, column);
+}
+
+/* A written board reads back the same, a column at a time */
+static void
+test_file_round_trip(void)
+{
+  guint n_cards = g_test_perf() ? 20000 : 2000;
+  KanbanBoardRecord* board = kanban_board_record_new();
+
+  for (guint i = 0; i < 4; i++)
+  {
+    gchar* title = g_strdup_printf("Column %u", i);
+    KanbanColumnRecord* column = kanban_column_record_new(title);
+
+    for (guint j = 0; j < n_cards / 4; j++)
+    {
+      KanbanUnserializedContent* description = kanban_unserialized_content_new();
+      KanbanAnchor anchor = { 4, g_strdup("Task \"x\" \\ y"), j % 2 };
+
+      g_string_printf(description->text, "Text\t%u\n☕ with \\ and \"quotes\"", j);
+      g_array_append_val(description->anchors, anchor);
+      g_ptr_array_add(column->cards, kanban_card_record_new("Card", FALSE, description));
+    }
+
+    g_ptr_array_add(board->columns, column);
+    g_free(title);
+  }
+
+  GError* error = NULL;
+  gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  gchar*  path  = g_build_filename(dir, "board", NULL);
+
+  g_assert_no_error(error);
+  kanban_board_file_save(board, path, &error);
+  g_assert_no_error(error);
+
+  GPtrArray* columns  = g_ptr_array_new_with_free_func((GDestroyNotify)kanban_column_record_free);
+  gboolean   migrated = TRUE;
+
+  g_test_timer_start();
+  g_assert_true(kanban_board_file_read(path, &migrated, count_column, columns, NULL, &error));
+  gdouble elapsed = g_test_timer_elapsed();
+
+  g_assert_no_error(error);
+  g_assert_false(migrated);
+  g_assert_cmpuint(columns->len, ==, 4);
+
+  for (guint i = 0; i < columns->len; i++)
+  {
+    KanbanColumnRecord* read     = g_ptr_array_index(columns, i);
+    KanbanColumnRecord* original = g_ptr_array_index(board->columns, i);
+
+    g_assert_cmpstr(read->title, ==, original->title);
+    g_assert_cmpuint(read->cards->len, ==, original->cards->len);
+
+    for (guint j = 0; j < read->cards->len; j++)
+    {
+      KanbanCardRecord* a = get_card(read, j);
+      KanbanCardRecord* b = get_card(original, j);
+
+      g_assert_cmpuint(a->id, ==, b->id);
+      g_assert_cmpstr(a->description->text->str, ==, b->description->text->str);
+      g_assert_cmpstr(g_array_index(a->description->anchors, KanbanAnchor, 0).title, ==,
+                      g_array_index(b->description->anchors, KanbanAnchor, 0).title);
+    }
+  }
+
+  g_test_minimized_result(elapsed, "Read %u cards in %.3f s", n_cards, elapsed);
+
+  g_ptr_array_unref(columns);
+  kanban_board_record_free(board);
+  g_unlink(path);
+  g_rmdir(dir);
+  g_free(path);
+  g_free(dir);
+}
+
+static KanbanColumnRecord*
+encoded_column(guint index, guint n_cards)
+{
+  gchar* title = g_strdup_printf("Column %u", index);
+  KanbanColumnRecord* column = kanban_column_record_new(title);
+
+  column->dirty = FALSE;
+
+  for (guint j = 0; j < n_cards; j++)
+  {
+    /* The second column has a card without id, the third a broken one */
+    gchar* data = index == 1 && j == 5 ? g_strdup("{\"title\":\"No id\",\"text\":\"n\"}")
+                : index == 2 && j == 0 ? g_strdup("{\"title\":")
+                : g_strdup_printf("{\"id\":%u,\"title\":\"Card %u\",\"revealed\":true,"
+                                  "\"text\":\"Text %u\",\"tasks\":[{\"offset\":0,"
+                                  "\"title\":\"t\",\"done\":false}]}",
+                                  index * 1000 + j + 1, j, j);
+    GBytes* encoded = g_bytes_new_take(data, strlen(data));
+
+    g_ptr_array_add(column->cards, kanban_card_record_new_encoded(NULL, FALSE, encoded));
+    g_bytes_unref(encoded);
+  }
+
+  g_free(title);
+  return column;
+}
+
+/* Columns come out of the decoder in order, their cards decoded */
+static void
+test_decoder(void)
+{
+  guint n_columns = g_test_perf() ? 64 : 16;
+  guint n_cards   = g_test_perf() ? 2000 : 150;
+  GPtrArray* columns = g_ptr_array_new_with_free_func((GDestroyNotify)kanban_column_record_free);
+  KanbanCardDecoder* decoder = kanban_card_decoder_new(count_column, columns);
+
+  g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "Failed to decode a card*");
+  g_test_timer_start();
+
+  for (guint i = 0; i < n_columns; i++)
+    kanban_card_decoder_push(encoded_column(i, n_cards), decoder);
+
+  kanban_card_decoder_finish(decoder);
+  g_test_assert_expected_messages();
+
+  gdouble elapsed = g_test_timer_elapsed();
+
+  g_assert_cmpuint(columns->len, ==, n_columns);
+
+  for (guint i = 0; i < n_columns; i++)
+  {
+    KanbanColumnRecord* column = g_ptr_array_index(columns, i);
+    gchar*              title  = g_strdup_printf("Column %u", i);
+
+    g_assert_cmpstr(column->title, ==, title);
+    g_assert_cmpuint(column->cards->len, ==, n_cards);
+    g_assert_true(column->dirty == (i == 1));
+    g_free(title);
+
+    for (guint j = 0; j < n_cards; j++)
+    {
+      KanbanCardRecord* card = get_card(column, j);
+
+      g_assert_nonnull(card->description);
+
+      if ((i == 1 && j == 5) || (i == 2 && j == 0))
+      {
+        g_assert_null(card->encoded);
+        continue;
+      }
+
+      g_assert_nonnull(card->encoded);
+      g_assert_cmpuint(card->id, ==, i * 1000 + j + 1);
+      g_assert_true(card->revealed);
+      g_assert_cmpuint(card->description->anchors->len, ==, 1);
+    }
+  }
+
+  /* Nothing of a broken card is lost */
+  g_assert_cmpstr(get_card(g_ptr_array_index(columns, 2), 0)->description->text->str, ==,
+                  "{\"title\":");
+  g_assert_cmpstr(get_card(g_ptr_array_index(columns, 1), 5)->title, ==, "No id");
+  g_assert_cmpuint(get_card(g_ptr_array_index(columns, 1), 5)->id, !=, 0);
+
+  g_test_minimized_result(elapsed, "Decoded %u cards in %.3f s", n_columns * n_cards, elapsed);
+
+  g_ptr_array_unref(columns);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/board-reader/board", test_board);
+  g_test_add_func("/board-reader/shard", test_shard);
+  g_test_add_func("/board-reader/errors", test_errors);
+  g_test_add_func("/board-reader/file-round-trip", test_file_round_trip);
+  g_test_add_func("/board-reader/decoder", test_decoder);
+
+  return g_test_run();
+}
@@ -0,0 +1,364 @@
+/* test-headless.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "utils/kanban-board-file.h"
+#include "utils/kanban-board-snapshot.h"
+#include "utils/kanban-headless.h"
+#include "utils/kanban-journal.h"
+#include "utils/kanban-trace.h"
+
+static void
+remove_dir(const gchar* dir_path)
+{
+  GDir* dir = g_dir_open(dir_path, 0, NULL);
+  const gchar* name;
+
+  while (dir && (name = g_dir_read_name(dir)) != NULL)
+  {
+    gchar* path = g_build_filename(dir_path, name, NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+
+  g_clear_pointer(&dir, g_dir_close);
+  g_rmdir(dir_path);
+}
+
+/* Removes the snapshots of the board in dir_path, returns how many there were */
+static guint
+remove_snapshots(const gchar* dir_path)
+{
+  GDir*        dir     = g_dir_open(dir_path, 0, NULL);
+  const gchar* name;
+  guint        removed = 0;
+
+  while (dir && (name = g_dir_read_name(dir)) != NULL)
+  {
+    if (!g_str_has_suffix(name, KANBAN_BOARD_SNAPSHOT_SUFFIX))
+      continue;
+
+    gchar* path = g_build_filename(dir_path, name, NULL);
+    g_unlink(path);
+    g_free(path);
+    removed++;
+  }
+
+  g_clear_pointer(&dir, g_dir_close);
+  return removed;
+}
+
+/* Runs thisweekinmylife --headless with the arguments given, up to NULL */
+static int
+run(const gchar* first, ...)
+{
+  GPtrArray* args = g_ptr_array_new_with_free_func(g_free);
+  va_list    ap;
+
+  g_ptr_array_add(args, g_strdup("thisweekinmylife"));
+  g_ptr_array_add(args, g_strdup(KANBAN_HEADLESS_OPTION));
+
+  va_start(ap, first);
+  for (const gchar* arg = first; arg != NULL; arg = va_arg(ap, const gchar*))
+    g_ptr_array_add(args, g_strdup(arg));
+  va_end(ap);
+
+  /* Option parsing moves the arguments around */
+  char** argv   = g_new0(char*, args->len + 1);
+  int    status;
+
+  memcpy(argv, args->pdata, args->len * sizeof(char*));
+  g_assert_true(kanban_headless_requested(args->len, argv));
+  status = kanban_headless_run(args->len, argv);
+
+  g_free(argv);
+  g_ptr_array_unref(args);
+
+  return status;
+}
+
+static KanbanCardRecord*
+make_card(const gchar* title, const gchar* task, gboolean done)
+{
+  KanbanUnserializedContent* description = kanban_unserialized_content_new();
+
+  g_string_assign(description->text, "Some text");
+
+  if (task)
+  {
+    KanbanAnchor anchor = { 4, g_strdup(task), done };
+    g_array_append_val(description->anchors, anchor);
+  }
+
+  return kanban_card_record_new(title, FALSE, description);
+}
+
+/* Two columns, three cards and two tasks, one of them done */
+static gchar*
+make_board_file(const gchar* dir, const gchar* name)
+{
+  KanbanBoardRecord*  board  = kanban_board_record_new();
+  KanbanColumnRecord* monday = kanban_column_record_new("Monday");
+  KanbanColumnRecord* friday = kanban_column_record_new("Friday");
+  gchar*              path   = g_build_filename(dir, name, NULL);
+  GError*             error  = NULL;
+
+  g_ptr_array_add(monday->cards, make_card("First", "Done", TRUE));
+  g_ptr_array_add(monday->cards, make_card("Second", "Not done", FALSE));
+  g_ptr_array_add(friday->cards, make_card("Third", NULL, FALSE));
+  g_ptr_array_add(board->columns, monday);
+  g_ptr_array_add(board->columns, friday);
+
+  kanban_board_file_save(board, path, &error);
+  g_assert_no_error(error);
+  kanban_board_record_free(board);
+
+  return path;
+}
+
+static void
+assert_columns(KanbanBoardRecord* board, const gchar* const* titles)
+{
+  g_assert_cmpuint(board->columns->len, ==, g_strv_length((gchar**)titles));
+
+  for (guint i = 0; i < board->columns->len; i++)
+  {
+    KanbanColumnRecord* column = g_ptr_array_index(board->columns, i);
+    g_assert_cmpstr(column->title, ==, titles[i]);
+  }
+}
+
+static void
+test_round_trip(void)
+{
+  GError* error = NULL;
+  gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  g_assert_no_error(error);
+
+  gchar* file_path = make_board_file(dir, "board.json");
+  gchar* board_dir = g_build_filename(dir, "board.d", NULL);
+  gchar* out_path  = g_build_filename(dir, "out.json", NULL);
+
+  g_assert_cmpint(run("import", file_path, board_dir, NULL), ==, EXIT_SUCCESS);
+
+  KanbanBoardRecord* board = kanban_board_dir_load(board_dir, &error);
+  g_assert_no_error(error);
+  assert_columns(board, (const gchar*[]) { "Monday", "Friday", NULL });
+
+  /* An edit left in the journal, as after a crash */
+  KanbanJournal* journal = kanban_journal_open(board_dir, board->journal, &error);
+  g_assert_no_error(error);
+  kanban_journal_add_column(journal, "Added", &error);
+  g_assert_no_error(error);
+  kanban_journal_close(journal);
+  kanban_board_record_free(board);
+
+  g_assert_cmpint(run("compact", board_dir, NULL), ==, EXIT_SUCCESS);
+  g_assert_false(kanban_journal_has_entries(board_dir, 0));
+
+  board = kanban_board_dir_load(board_dir, &error);
+  g_assert_no_error(error);
+  assert_columns(board, (const gchar*[]) { "Monday", "Friday", "Added", NULL });
+  kanban_board_record_free(board);
+
+  g_assert_cmpint(run("export", board_dir, out_path, NULL), ==, EXIT_SUCCESS);
+
+  board = kanban_board_file_load(out_path, &error);
+  g_assert_no_error(error);
+  assert_columns(board, (const gchar*[]) { "Monday", "Friday", "Added", NULL });
+
+  KanbanColumnRecord* monday = g_ptr_array_index(board->columns, 0);
+  KanbanCardRecord*   second = g_ptr_array_index(monday->cards, 1);
+  g_assert_cmpstr(second->title, ==, "Second");
+  g_assert_cmpuint(second->description->anchors->len, ==, 1);
+  g_assert_cmpstr(g_array_index(second->description->anchors, KanbanAnchor, 0).title, ==,
+                  "Not done");
+  kanban_board_record_free(board);
+
+  /* A board that can't be read is not written out */
+  gchar* missing = g_build_filename(dir, "missing.json", NULL);
+
+  g_unlink(out_path);
+  g_assert_cmpint(run("export", missing, out_path, NULL), ==, EXIT_FAILURE);
+  g_assert_false(g_file_test(out_path, G_FILE_TEST_EXISTS));
+  g_free(missing);
+
+  remove_dir(board_dir);
+  remove_dir(dir);
+
+  g_free(out_path);
+  g_free(board_dir);
+  g_free(file_path);
+  g_free(dir);
+}
+
+static void
+test_stats(void)
+{
+  if (g_test_subprocess())
+  {
+    GError* error = NULL;
+    gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+    g_assert_no_error(error);
+
+    gchar* file_path = make_board_file(dir, "board.json");
+    gchar* board_dir = g_build_filename(dir, "board.d", NULL);
+
+    /* The board directory is read from its snapshots */
+    g_assert_cmpint(run("import", file_path, board_dir, NULL), ==, EXIT_SUCCESS);
+    g_assert_cmpint(run("stats", file_path, board_dir, NULL), ==, EXIT_SUCCESS);
+
+    /* Or from its shards, which leaves it as it was */
+    g_assert_cmpuint(remove_snapshots(board_dir), >, 0);
+    g_assert_cmpint(run("validate", board_dir, NULL), ==, EXIT_SUCCESS);
+    g_assert_cmpuint(remove_snapshots(board_dir), ==, 0);
+
+    remove_dir(board_dir);
+    remove_dir(dir);
+    g_free(board_dir);
+    g_free(file_path);
+    g_free(dir);
+    return;
+  }
+
+  g_test_trap_subprocess(NULL, 0, 0);
+  g_test_trap_assert_passed();
+  g_test_trap_assert_stdout("{\"board\":\"*board.json\",\"columns\":2,\"cards\":3,"
+                            "\"tasks\":2,\"done\":1,\"journaled\":0}\n"
+                            "{\"board\":\"*board.d\",\"columns\":2,\"cards\":3,"
+                            "\"tasks\":2,\"done\":1,\"journaled\":0}\n"
+                            "*board.d: ok\n");
+}
+
+static void
+test_validate(void)
+{
+  if (g_test_subprocess())
+  {
+    GError* error = NULL;
+    gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+    g_assert_no_error(error);
+
+    /* Problems are reported, not fatal */
+    g_log_set_always_fatal(G_LOG_FATAL_MASK);
+
+    gchar* good_path = make_board_file(dir, "good.json");
+    gchar* bad_dir   = g_build_filename(dir, "bad.d", NULL);
+    gchar* manifest  = g_build_filename(bad_dir, KANBAN_BOARD_MANIFEST, NULL);
+
+    /* A shard gone missing, and a card sharing its id with another */
+    g_mkdir(bad_dir, 0700);
+    g_file_set_contents(manifest,
+                        "{\"version\":2,\"journal\":1,\"shards\":[\"column-gone.json\"]}",
+                        -1, &error);
+    g_assert_no_error(error);
+
+    KanbanBoardRecord* board = kanban_board_file_load(good_path, &error);
+    g_assert_no_error(error);
+
+    gchar* dup_path = g_build_filename(dir, "duplicate.json", NULL);
+    KanbanColumnRecord* monday = g_ptr_array_index(board->columns, 0);
+    ((KanbanCardRecord*)g_ptr_array_index(monday->cards, 1))->id =
+      ((KanbanCardRecord*)g_ptr_array_index(monday->cards, 0))->id;
+    g_clear_pointer(&((KanbanCardRecord*)g_ptr_array_index(monday->cards, 1))->encoded,
+                    g_bytes_unref);
+    kanban_board_file_save(board, dup_path, &error);
+    g_assert_no_error(error);
+    kanban_board_record_free(board);
+
+    g_assert_cmpint(run("validate", good_path, NULL), ==, EXIT_SUCCESS);
+    g_assert_cmpint(run("validate", good_path, bad_dir, dup_path, NULL), ==, EXIT_FAILURE);
+
+    remove_dir(bad_dir);
+    remove_dir(dir);
+    g_free(dup_path);
+    g_free(manifest);
+    g_free(bad_dir);
+    g_free(good_path);
+    g_free(dir);
+    return;
+  }
+
+  g_test_trap_subprocess(NULL, 0, 0);
+  g_test_trap_assert_passed();
+  g_test_trap_assert_stdout("*good.json: ok\n*good.json: ok\n");
+  g_test_trap_assert_stderr("*Failed to load column*bad.d: 1 problem\n"
+                            "*duplicate.json: card 1 of column \"Monday\" has the id of another card*"
+                            "duplicate.json: 1 problem\n");
+}
+
+/* --trace is taken along with the command, as without --headless */
+static void
+test_trace(void)
+{
+  GError* error = NULL;
+  gchar*  dir   = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  g_assert_no_error(error);
+
+  gchar* file_path  = make_board_file(dir, "board.json");
+  gchar* trace_path = g_build_filename(dir, "trace.json", NULL);
+  gchar* option     = g_strconcat("--trace=", trace_path, NULL);
+
+  g_assert_cmpint(run(option, "validate", file_path, NULL), ==, EXIT_SUCCESS);
+  g_assert_true(kanban_trace_enabled);
+  g_assert_true(kanban_trace_stop(&error));
+  g_assert_no_error(error);
+  g_assert_true(g_file_test(trace_path, G_FILE_TEST_EXISTS));
+
+  remove_dir(dir);
+  g_free(option);
+  g_free(trace_path);
+  g_free(file_path);
+  g_free(dir);
+}
+
+static void
+test_usage(void)
+{
+  if (g_test_subprocess())
+  {
+    g_assert_cmpint(run(NULL), ==, EXIT_FAILURE);
+    g_assert_cmpint(run("compact", NULL), ==, EXIT_FAILURE);
+    g_assert_cmpint(run("frobnicate", "board", NULL), ==, EXIT_FAILURE);
+    return;
+  }
+
+  g_test_trap_subprocess(NULL, 0, 0);
+  g_test_trap_assert_passed();
+  g_test_trap_assert_stderr("*COMMAND*validate BOARD*");
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/headless/round-trip", test_round_trip);
+  g_test_add_func("/headless/stats", test_stats);
+  g_test_add_func("/headless/validate", test_validate);
+  g_test_add_func("/headless/trace", test_trace);
+  g_test_add_func("/headless/usage", test_usage);
+
+  return g_test_run();
+}
@@ -0,0 +1,330 @@
+/* test-journal.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+
+#include <glib/gstdio.h>
+
+#include "utils/kanban-journal.h"
+
+typedef struct
+{
+  gchar* dir;
+} Fixture;
+
+static void
+fixture_set_up(Fixture* fixture, gconstpointer data)
+{
+  GError* error = NULL;
+
+  fixture->dir = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  g_assert_no_error(error);
+}
+
+static void
+fixture_tear_down(Fixture* fixture, gconstpointer data)
+{
+  GDir* dir = g_dir_open(fixture->dir, 0, NULL);
+  const gchar* name;
+
+  while (dir && (name = g_dir_read_name(dir)) != NULL)
+  {
+    gchar* path = g_build_filename(fixture->dir, name, NULL);
+    g_unlink(path);
+    g_free(path);
+  }
+
+  g_clear_pointer(&dir, g_dir_close);
+  g_rmdir(fixture->dir);
+  g_free(fixture->dir);
+}
+
+static gboolean
+generation_exists(Fixture* fixture, guint generation)
+{
+  gchar* name = g_strdup_printf(KANBAN_JOURNAL_PREFIX "%u.jsonl", generation);
+  gchar* path = g_build_filename(fixture->dir, name, NULL);
+  gboolean exists = g_file_test(path, G_FILE_TEST_EXISTS);
+
+  g_free(path);
+  g_free(name);
+  return exists;
+}
+
+static GBytes*
+encode_card(const gchar* title, const gchar* text)
+{
+  KanbanUnserializedContent* description = kanban_unserialized_content_new();
+  g_string_assign(description->text, text);
+
+  KanbanCardRecord* card  = kanban_card_record_new(title, FALSE, description);
+  GBytes*           bytes = kanban_card_record_encode(card);
+
+  kanban_card_record_free(card);
+  return bytes;
+}
+
+static KanbanBoardRecord*
+make_board(void)
+{
+  KanbanBoardRecord* board = kanban_board_record_new();
+  KanbanColumnRecord* column = kanban_column_record_new("Monday");
+
+  column->dirty = FALSE;
+  g_ptr_array_add(column->cards, kanban_card_record_new("Kept", FALSE, NULL));
+  g_ptr_array_add(board->columns, column);
+
+  return board;
+}
+
+static const gchar*
+card_title(KanbanBoardRecord* board, guint column, guint card)
+{
+  KanbanColumnRecord* record = g_ptr_array_index(board->columns, column);
+  return ((KanbanCardRecord*)g_ptr_array_index(record->cards, card))->title;
+}
+
+static void
+test_replay(Fixture* fixture, gconstpointer data)
+{
+  GError* error = NULL;
+  KanbanJournal* journal = kanban_journal_open(fixture->dir, 0, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(kanban_journal_get_generation(journal), ==, 1);
+  g_assert_cmpint(kanban_journal_get_size(journal), ==, 0);
+
+  GBytes* first  = encode_card("First", "one");
+  GBytes* edited = encode_card("First", "one, edited");
+  GBytes* second = encode_card("Second", "two");
+
+  /* A new column, a card moved into it and an edit after the move */
+  g_assert_true(kanban_journal_add_column(journal, "Tuesday", &error));
+  g_assert_true(kanban_journal_rename_column(journal, 1, "Wednesday", &error));
+  g_assert_true(kanban_journal_insert_card(journal, 0, 0, first, &error));
+  g_assert_true(kanban_journal_insert_card(journal, 0, 2, second, &error));
+  g_assert_true(kanban_journal_remove_card(journal, 0, 0, &error));
+  g_assert_true(kanban_journal_insert_card(journal, 1, 0, first, &error));
+  g_assert_true(kanban_journal_update_card(journal, 1, 0, edited, &error));
+  g_assert_no_error(error);
+  g_assert_cmpint(kanban_journal_get_size(journal), >, 0);
+  kanban_journal_close(journal);
+
+  KanbanBoardRecord* board = make_board();
+  guint replayed = 0;
+
+  g_assert_true(kanban_journal_replay(fixture->dir, board, &replayed, &error));
+  g_assert_no_error(error);
+  g_assert_cmpuint(replayed, ==, 7);
+
+  g_assert_cmpuint(board->columns->len, ==, 2);
+  KanbanColumnRecord* monday    = g_ptr_array_index(board->columns, 0);
+  KanbanColumnRecord* wednesday = g_ptr_array_index(board->columns, 1);
+
+  g_assert_true(monday->dirty);
+  g_assert_cmpuint(monday->cards->len, ==, 2);
+  g_assert_cmpstr(card_title(board, 0, 0), ==, "Kept");
+  g_assert_cmpstr(card_title(board, 0, 1), ==, "Second");
+
+  g_assert_cmpstr(wednesday->title, ==, "Wednesday");
+  g_assert_cmpuint(wednesday->cards->len, ==, 1);
+  KanbanCardRecord* card = g_ptr_array_index(wednesday->cards, 0);
+  g_assert_cmpstr(card->description->text->str, ==, "one, edited");
+
+  kanban_board_record_free(board);
+  g_bytes_unref(second);
+  g_bytes_unref(edited);
+  g_bytes_unref(first);
+}
+
+static void
+test_generations(Fixture* fixture, gconstpointer data)
+{
+  GError* error = NULL;
+  KanbanJournal* journal = kanban_journal_open(fixture->dir, 0, &error);
+  g_assert_no_error(error);
+
+  g_assert_true(kanban_journal_rename_column(journal, 0, "Saved", &error));
+  g_assert_true(kanban_journal_rotate(journal, &error));
+  g_assert_cmpuint(kanban_journal_get_generation(journal), ==, 2);
+  g_assert_cmpint(kanban_journal_get_size(journal), ==, 0);
+  g_assert_true(kanban_journal_rename_column(journal, 0, "Pending", &error));
+  g_assert_no_error(error);
+  kanban_journal_close(journal);
+
+  /* A board saved with generation 2 only replays what came after it,
+   * even when the older generation is still around */
+  KanbanBoardRecord* board = make_board();
+  guint replayed = 0;
+
+  board->journal = 2;
+  g_assert_true(generation_exists(fixture, 1));
+  g_assert_true(kanban_journal_replay(fixture->dir, board, &replayed, &error));
+  g_assert_no_error(error);
+  g_assert_cmpuint(replayed, ==, 1);
+  g_assert_cmpstr(((KanbanColumnRecord*)g_ptr_array_index(board->columns, 0))->title,
+                  ==, "Pending");
+  kanban_board_record_free(board);
+
+  kanban_journal_remove_before(fixture->dir, 2);
+  g_assert_false(generation_exists(fixture, 1));
+  g_assert_true(generation_exists(fixture, 2));
+
+  /* Reopening continues the newest generation */
+  journal = kanban_journal_open(fixture->dir, 0, &error);
+  g_assert_no_error(error);
+  g_assert_cmpuint(kanban_journal_get_generation(journal), ==, 2);
+  g_assert_cmpint(kanban_journal_get_size(journal), >, 0);
+
+  /* Discarded edits are not replayed */
+  g_assert_true(kanban_journal_discard(journal, &error));
+  g_assert_no_error(error);
+  g_assert_false(generation_exists(fixture, 2));
+  kanban_journal_close(journal);
+
+  board = make_board();
+  g_assert_true(kanban_journal_replay(fixture->dir, board, &replayed, &error));
+  g_assert_cmpuint(replayed, ==, 0);
+  kanban_board_record_free(board);
+}
+
+static void
+test_torn_entry(Fixture* fixture, gconstpointer data)
+{
+  static const gchar contents[] =
+    "{\"op\":\"rename-column\",\"column\":0,\"title\":\"Renamed\"}\n"
+    "{\"op\":\"remove-card\",\"column\":5,\"index\":0}\n"
+    "{\"op\":\"remove-card\",\"column\":0,\"ind";
+
+  GError* error = NULL;
+  gchar*  path  = g_build_filename(fixture->dir, KANBAN_JOURNAL_PREFIX "1.jsonl", NULL);
+  g_file_set_contents(path, contents, -1, &error);
+  g_assert_no_error(error);
+  g_free(path);
+
+  KanbanBoardRecord* board = make_board();
+  guint replayed = 0;
+
+  /* Entries that do not apply are skipped, the rest is kept */
+  g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "Skipping journal entry*");
+  g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "Skipping journal entry*");
+  g_assert_true(kanban_journal_replay(fixture->dir, board, &replayed, &error));
+  g_test_assert_expected_messages();
+  g_assert_no_error(error);
+
+  g_assert_cmpuint(replayed, ==, 1);
+  g_assert_cmpstr(((KanbanColumnRecord*)g_ptr_array_index(board->columns, 0))->title,
+                  ==, "Renamed");
+  g_assert_cmpstr(card_title(board, 0, 0), ==, "Kept");
+
+  kanban_board_record_free(board);
+}
+
+static KanbanBoardRecord*
+load_board(Fixture* fixture)
+{
+  GError*            error = NULL;
+  KanbanBoardRecord* board = kanban_board_dir_load(fixture->dir, &error);
+
+  g_assert_no_error(error);
+  g_assert_true(kanban_journal_replay(fixture->dir, board, NULL, &error));
+  g_assert_no_error(error);
+
+  return board;
+}
+
+/*
+ * A save cut short after writing a column leaves the board on disk as it
+ * was, the edits of its journal generation are replayed onto it once
+ * */
+static void
+test_interrupted_save(Fixture* fixture, gconstpointer data)
+{
+  GError*             error  = NULL;
+  KanbanBoardRecord*  board  = make_board();
+  KanbanColumnRecord* monday = g_ptr_array_index(board->columns, 0);
+
+  monday->shard = kanban_board_shard_new_name();
+  monday->dirty = TRUE;
+  board->journal = 1;
+  g_assert_true(kanban_board_dir_save(board, fixture->dir, &error));
+  g_assert_no_error(error);
+  kanban_board_record_free(board);
+
+  /* A card added once the board was saved */
+  KanbanJournal* journal = kanban_journal_open(fixture->dir, 1, &error);
+  GBytes*        added   = encode_card("Added", "new");
+
+  g_assert_true(kanban_journal_insert_card(journal, 0, 0, added, &error));
+  g_assert_no_error(error);
+  kanban_journal_close(journal);
+  g_bytes_unref(added);
+
+  /* The next save writes Monday, then fails on a column without a shard
+   * before the manifest is written */
+  board = load_board(fixture);
+  board->journal = 2;
+  g_ptr_array_add(board->columns, kanban_column_record_new("Tuesday"));
+
+  g_assert_false(kanban_board_dir_save(board, fixture->dir, &error));
+  g_assert_error(error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_clear_error(&error);
+  kanban_board_record_free(board);
+
+  board = load_board(fixture);
+  g_assert_cmpuint(board->journal, ==, 1);
+  g_assert_cmpuint(board->columns->len, ==, 1);
+  monday = g_ptr_array_index(board->columns, 0);
+  g_assert_cmpuint(monday->cards->len, ==, 2);
+  g_assert_cmpstr(card_title(board, 0, 0), ==, "Added");
+  g_assert_cmpstr(card_title(board, 0, 1), ==, "Kept");
+  kanban_board_record_free(board);
+}
+
+static void
+test_missing(void)
+{
+  KanbanBoardRecord* board = make_board();
+  GError* error = NULL;
+  guint replayed = 1;
+
+  g_assert_true(kanban_journal_replay("/nonexistent", board, &replayed, &error));
+  g_assert_no_error(error);
+  g_assert_cmpuint(replayed, ==, 0);
+
+  kanban_board_record_free(board);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add("/journal/replay", Fixture, NULL,
+             fixture_set_up, test_replay, fixture_tear_down);
+  g_test_add("/journal/generations", Fixture, NULL,
+             fixture_set_up, test_generations, fixture_tear_down);
+  g_test_add("/journal/torn-entry", Fixture, NULL,
+             fixture_set_up, test_torn_entry, fixture_tear_down);
+  g_test_add("/journal/interrupted-save", Fixture, NULL,
+             fixture_set_up, test_interrupted_save, fixture_tear_down);
+  g_test_add_func("/journal/missing", test_missing);
+
+  return g_test_run();
+}
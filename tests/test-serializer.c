@@ -0,0 +1,542 @@
+/* test-serializer.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <string.h>
+
+#include "kanban-text-buffer.h"
+
+static gboolean has_display = FALSE;
+
+/* Widgets need a display, meson runs the tests under xvfb-run when there
+ * is one to be had. Fails the test without one */
+static gboolean
+require_display(void)
+{
+  if (!has_display)
+    g_test_fail_printf("No display available, run the test under xvfb-run");
+
+  return has_display;
+}
+
+/*
+ * Character-by-character serializer the anchor-jumping one replaced,
+ * kept here as the reference for the wire format.
+ */
+static GBytes*
+legacy_serialized_buffer(GtkTextBuffer *buffer)
+{
+  GtkTextIter start, end;
+
+  GByteArray* ret = g_byte_array_new();
+  gtk_text_buffer_get_bounds(buffer, &start, &end);
+
+  GtkTextIter pos0,pos1;
+  GtkTextChildAnchor* anch;
+
+  pos0 = start;
+  do {
+    pos1 = pos0;
+    gboolean not_end = TRUE;
+    while (anch = gtk_text_iter_get_child_anchor(&pos1), anch == NULL)
+    {
+      not_end = gtk_text_iter_forward_char(&pos1);
+      if (!not_end)
+        break;
+    }
+
+    gchar* text = gtk_text_iter_get_text(&pos0, &pos1);
+    ret = g_byte_array_append(ret, (guint8*)text, strlen(text));
+    g_free(text);
+
+    pos0 = pos1;
+
+    if (!not_end && !anch)
+      continue;
+
+    guint widgets_len = 0;
+    GtkWidget** widgets = gtk_text_child_anchor_get_widgets(anch, &widgets_len);
+
+    for (guint i = 0; i < widgets_len; i++)
+    {
+      gboolean isChecked = false;
+      const gchar* tasklbl = NULL;
+
+      for (GtkWidget* child = gtk_widget_get_first_child (widgets[i]);
+                                                      child != NULL;
+                        child = gtk_widget_get_next_sibling (child))
+      {
+        if (GTK_IS_CHECK_BUTTON (child))
+          isChecked = gtk_check_button_get_active (GTK_CHECK_BUTTON (child));
+        else if (GTK_IS_EDITABLE_LABEL (child))
+          tasklbl = gtk_editable_get_text (GTK_EDITABLE(child));
+      }
+
+      g_byte_array_append(ret, (guint8*)"<task status=", 13);
+      if (isChecked)
+        g_byte_array_append(ret, (guint8*)"done", 4);
+      else
+        g_byte_array_append(ret, (guint8*)"progress", 8);
+      g_byte_array_append(ret, (guint8*)" title=\"", 8);
+      g_byte_array_append(ret, (guint8*)tasklbl, strlen(tasklbl));
+      g_byte_array_append(ret, (guint8*)"\"/>", 3);
+    }
+    g_free(widgets);
+
+  } while (gtk_text_iter_forward_char(&pos0));
+
+  ret = g_byte_array_append (ret, (guint8*)"\0", 1);
+
+  return g_byte_array_free_to_bytes(ret);
+}
+
+static void
+insert_task(GtkTextView* view, GtkTextIter* iter, const gchar* title, gboolean done)
+{
+  GtkTextBuffer* buffer = gtk_text_view_get_buffer(view);
+  GtkTextChildAnchor* anchor = gtk_text_buffer_create_child_anchor(buffer, iter);
+  GtkWidget* box   = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+  GtkWidget* check = gtk_check_button_new();
+
+  gtk_check_button_set_active(GTK_CHECK_BUTTON(check), done);
+  gtk_box_append(GTK_BOX(box), check);
+  gtk_box_append(GTK_BOX(box), gtk_editable_label_new(title));
+  gtk_text_view_add_child_at_anchor(view, box, anchor);
+}
+
+/*
+ * Builds a text view from a pattern where every '@' becomes a task,
+ * alternating between done and in progress.
+ */
+static GtkTextView*
+build_view(const gchar* pattern)
+{
+  GtkTextView* view = GTK_TEXT_VIEW(g_object_ref_sink(gtk_text_view_new()));
+  GtkTextBuffer* buffer = gtk_text_view_get_buffer(view);
+  GtkTextIter iter;
+  gchar** parts = g_strsplit(pattern, "@", -1);
+
+  gtk_text_buffer_get_end_iter(buffer, &iter);
+  for (guint i = 0; parts[i] != NULL; i++)
+  {
+    if (i > 0)
+    {
+      gchar* title = g_strdup_printf("Task #%u", i);
+      insert_task(view, &iter, title, i % 2);
+      g_free(title);
+    }
+    gtk_text_buffer_insert(buffer, &iter, parts[i], -1);
+  }
+
+  g_strfreev(parts);
+  return view;
+}
+
+static void
+test_round_trip(void)
+{
+  static const gchar* patterns[] = {
+    "",
+    "plain text without tasks",
+    "@",
+    "@@@",
+    "@leading task",
+    "trailing task@",
+    "line one\n@\nline two\n@\n@\nline three",
+    "Übung für Donnerstag @ café ☕ @ 日本語のテキスト",
+    NULL
+  };
+
+  if (!require_display())
+    return;
+
+  for (const gchar** pattern = patterns; *pattern != NULL; pattern++)
+  {
+    GtkTextView* view = build_view(*pattern);
+    GtkTextBuffer* buffer = gtk_text_view_get_buffer(view);
+
+    GBytes* expected = legacy_serialized_buffer(buffer);
+    GBytes* actual   = get_serialized_buffer(buffer);
+
+    g_assert_cmpstr(g_bytes_get_data(actual, NULL), ==,
+                    g_bytes_get_data(expected, NULL));
+    g_assert_true(g_bytes_equal(actual, expected));
+
+    g_bytes_unref(expected);
+    g_bytes_unref(actual);
+    g_object_unref(view);
+  }
+}
+
+static void
+test_buffer_content(void)
+{
+  if (!require_display())
+    return;
+
+  GtkTextView* view = build_view("ab@cd ☕@");
+  KanbanUnserializedContent* content = get_buffer_content(gtk_text_view_get_buffer(view));
+
+  g_assert_cmpstr(content->text->str, ==, "abcd ☕");
+  g_assert_cmpuint(content->anchors->len, ==, 2);
+
+  KanbanAnchor* first  = &g_array_index(content->anchors, KanbanAnchor, 0);
+  KanbanAnchor* second = &g_array_index(content->anchors, KanbanAnchor, 1);
+
+  g_assert_cmpuint(first->offset, ==, 2);
+  g_assert_cmpstr(first->title, ==, "Task #1");
+  g_assert_true(first->done);
+  g_assert_cmpuint(second->offset, ==, 6);
+  g_assert_cmpstr(second->title, ==, "Task #2");
+  g_assert_false(second->done);
+
+  kanban_unserialized_content_free(content);
+  g_object_unref(view);
+}
+
+static void
+test_escaped_round_trip(void)
+{
+  static const gchar* titles[] = {
+    "He said \"hi\"/>",
+    "<task status=done title=\"nested\"/>",
+    "fish & chips &amp; more",
+    NULL
+  };
+
+  if (!require_display())
+    return;
+
+  GtkTextView* view = GTK_TEXT_VIEW(g_object_ref_sink(gtk_text_view_new()));
+  GtkTextBuffer* buffer = gtk_text_view_get_buffer(view);
+  GtkTextIter iter;
+
+  gtk_text_buffer_get_end_iter(buffer, &iter);
+  for (guint i = 0; titles[i] != NULL; i++)
+  {
+    gtk_text_buffer_insert(buffer, &iter, "text ", -1);
+    insert_task(view, &iter, titles[i], TRUE);
+  }
+
+  GBytes* bytes = get_serialized_buffer(buffer);
+  KanbanUnserializedContent* content = get_unserialized_buffer(g_bytes_get_data(bytes, NULL));
+
+  g_assert_nonnull(content);
+  g_assert_cmpuint(content->anchors->len, ==, g_strv_length((gchar**)titles));
+  for (guint i = 0; titles[i] != NULL; i++)
+  {
+    KanbanAnchor* anchor = &g_array_index(content->anchors, KanbanAnchor, i);
+    g_assert_cmpstr(anchor->title, ==, titles[i]);
+    g_assert_true(anchor->done);
+    g_assert_cmpuint(anchor->offset, ==, (i + 1) * 5);
+  }
+
+  kanban_unserialized_content_free(content);
+  g_bytes_unref(bytes);
+  g_object_unref(view);
+}
+
+static void
+test_parse_offsets(void)
+{
+  const gchar* description = "Übung ☕<task status=done title=\"A\"/>"
+                             "日本語<task status=progress title=\"B\"/>";
+
+  KanbanUnserializedContent* content = get_unserialized_buffer(description);
+
+  g_assert_nonnull(content);
+  g_assert_cmpmem(content->text->str, content->text->len,
+                  "Übung ☕日本語", strlen("Übung ☕日本語"));
+  g_assert_cmpuint(content->anchors->len, ==, 2);
+
+  KanbanAnchor* first  = &g_array_index(content->anchors, KanbanAnchor, 0);
+  KanbanAnchor* second = &g_array_index(content->anchors, KanbanAnchor, 1);
+
+  g_assert_cmpuint(first->offset, ==, 7);
+  g_assert_cmpstr(first->title, ==, "A");
+  g_assert_true(first->done);
+  g_assert_cmpuint(second->offset, ==, 10);
+  g_assert_cmpstr(second->title, ==, "B");
+  g_assert_false(second->done);
+
+  kanban_unserialized_content_free(content);
+}
+
+static void
+test_content_copy(void)
+{
+  KanbanUnserializedContent* content =
+    get_unserialized_buffer("Übung ☕<task status=done title=\"A\"/>rest");
+  KanbanUnserializedContent* copy = kanban_unserialized_content_copy(content);
+
+  /* The copy owns its titles */
+  kanban_unserialized_content_free(content);
+
+  g_assert_cmpmem(copy->text->str, copy->text->len,
+                  "Übung ☕rest", strlen("Übung ☕rest"));
+  g_assert_cmpuint(copy->anchors->len, ==, 1);
+  g_assert_cmpuint(g_array_index(copy->anchors, KanbanAnchor, 0).offset, ==, 7);
+  g_assert_cmpstr(g_array_index(copy->anchors, KanbanAnchor, 0).title, ==, "A");
+  g_assert_true(g_array_index(copy->anchors, KanbanAnchor, 0).done);
+
+  kanban_unserialized_content_free(copy);
+}
+
+static void
+test_parse_escaped(void)
+{
+  KanbanUnserializedContent* content =
+    get_unserialized_buffer("<task status=done title=\"&quot;/&gt; &amp;amp; &lt;b&gt; & co\"/>");
+
+  g_assert_nonnull(content);
+  g_assert_cmpuint(content->text->len, ==, 0);
+  g_assert_cmpuint(content->anchors->len, ==, 1);
+  g_assert_cmpstr(g_array_index(content->anchors, KanbanAnchor, 0).title,
+                  ==, "\"/> &amp; <b> & co");
+
+  kanban_unserialized_content_free(content);
+}
+
+static void
+test_parse_truncated(void)
+{
+  static const gchar* truncated[] = {
+    "text<task status=",
+    "text<task status=done",
+    "text<task status=done title=\"never closed",
+    NULL
+  };
+
+  g_assert_null(get_unserialized_buffer(""));
+
+  for (const gchar** description = truncated; *description != NULL; description++)
+  {
+    KanbanUnserializedContent* content;
+
+    g_test_expect_message(G_LOG_DOMAIN, G_LOG_LEVEL_WARNING, "*Truncated*");
+    content = get_unserialized_buffer(*description);
+    g_test_assert_expected_messages();
+
+    g_assert_nonnull(content);
+    g_assert_cmpuint(content->anchors->len, ==, 0);
+    g_assert_cmpmem(content->text->str, content->text->len,
+                    *description, strlen(*description));
+
+    kanban_unserialized_content_free(content);
+  }
+}
+
+static void
+test_parse_throughput(void)
+{
+  static const gchar line[]  = "Zeile mit Umlauten äöü und ☕\n";
+  static const gchar task[]  = "<task status=done title=\"Aufgabe &quot;x&quot;\"/>";
+  guint  n_tasks = g_test_perf() ? 400000 : 60000;
+  GString* description = g_string_new(NULL);
+
+  for (guint i = 0; i < n_tasks; i++)
+  {
+    g_string_append(description, line);
+    g_string_append(description, task);
+  }
+
+  g_test_timer_start();
+  KanbanUnserializedContent* content = get_unserialized_buffer(description->str);
+  gdouble elapsed = g_test_timer_elapsed();
+
+  g_assert_nonnull(content);
+  g_assert_cmpuint(content->anchors->len, ==, n_tasks);
+
+  glong line_chars = g_utf8_strlen(line, -1);
+  KanbanAnchor* last = &g_array_index(content->anchors, KanbanAnchor, n_tasks - 1);
+  g_assert_cmpuint(last->offset, ==, n_tasks * line_chars);
+  g_assert_cmpstr(last->title, ==, "Aufgabe \"x\"");
+
+  g_test_maximized_result(description->len / MAX(elapsed, 1e-9) / (1024 * 1024),
+                          "Parsed %.1f MB in %.3f s",
+                          description->len / (1024.0 * 1024.0), elapsed);
+
+  kanban_unserialized_content_free(content);
+  g_string_free(description, TRUE);
+}
+
+static void
+assert_same_content(const KanbanUnserializedContent* actual,
+                    const KanbanUnserializedContent* expected)
+{
+  g_assert_cmpstr(actual->text->str, ==, expected->text->str);
+  g_assert_cmpuint(actual->anchors->len, ==, expected->anchors->len);
+
+  for (guint i = 0; i < expected->anchors->len; i++)
+  {
+    KanbanAnchor* a = &g_array_index(actual->anchors, KanbanAnchor, i);
+    KanbanAnchor* e = &g_array_index(expected->anchors, KanbanAnchor, i);
+
+    g_assert_cmpuint(a->offset, ==, e->offset);
+    g_assert_cmpstr(a->title, ==, e->title);
+    g_assert_cmpint(a->done, ==, e->done);
+  }
+}
+
+static void
+test_set_buffer_content(void)
+{
+  static const gchar* descriptions[] = {
+    "<task status=done title=\"first\"/>",
+    "plain text without tasks",
+    "ab<task status=done title=\"x\"/>cd ☕<task status=progress title=\"\"/>",
+    "Übung<task status=progress title=\"&quot;a&quot; &amp; b\"/><task status=done title=\"c\"/>日本語\n",
+    NULL
+  };
+
+  if (!require_display())
+    return;
+
+  for (const gchar** description = descriptions; *description != NULL; description++)
+  {
+    GtkTextView* view = GTK_TEXT_VIEW(g_object_ref_sink(gtk_text_view_new()));
+    GtkTextBuffer* buffer = gtk_text_view_get_buffer(view);
+    KanbanUnserializedContent* content = get_unserialized_buffer(*description);
+
+    gtk_text_buffer_set_text(buffer, "replaced", -1);
+    GPtrArray* anchors = set_buffer_content(buffer, content);
+    g_assert_cmpuint(anchors->len, ==, content->anchors->len);
+
+    /* Tasks without a widget are read from their anchor */
+    KanbanUnserializedContent* pending = get_buffer_content(buffer);
+    GBytes* serialized = get_serialized_buffer(buffer);
+
+    assert_same_content(pending, content);
+    g_assert_cmpstr(g_bytes_get_data(serialized, NULL), ==, *description);
+
+    /* And from their widget once it is made */
+    for (guint i = 0; i < anchors->len; i++)
+    {
+      GtkTextChildAnchor* anchor = g_ptr_array_index(anchors, i);
+      GtkWidget* box   = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+      GtkWidget* check = gtk_check_button_new();
+      gboolean done    = FALSE;
+      gchar* title     = take_pending_task(anchor, &done);
+
+      g_assert_nonnull(title);
+      g_assert_null(take_pending_task(anchor, &done));
+
+      gtk_check_button_set_active(GTK_CHECK_BUTTON(check), done);
+      gtk_box_append(GTK_BOX(box), check);
+      gtk_box_append(GTK_BOX(box), gtk_editable_label_new(title));
+      gtk_text_view_add_child_at_anchor(view, box, anchor);
+      g_free(title);
+    }
+
+    KanbanUnserializedContent* built = get_buffer_content(buffer);
+    assert_same_content(built, content);
+
+    kanban_unserialized_content_free(built);
+    g_bytes_unref(serialized);
+    kanban_unserialized_content_free(pending);
+    g_ptr_array_unref(anchors);
+    kanban_unserialized_content_free(content);
+    g_object_unref(view);
+  }
+}
+
+/*
+ * Loads a card with thousands of tasks the way the card does, against
+ * the offset lookup per task it used before
+ */
+static void
+test_set_buffer_content_many_tasks(void)
+{
+  guint n_tasks = g_test_perf() ? 20000 : 1500;
+
+  if (!require_display())
+    return;
+
+  KanbanUnserializedContent* content = kanban_unserialized_content_new();
+
+  for (guint i = 0; i < n_tasks; i++)
+  {
+    KanbanAnchor anchor;
+
+    g_string_append(content->text, "Schritt ☕\n");
+    anchor.offset = g_utf8_strlen(content->text->str, content->text->len);
+    anchor.title  = g_strdup_printf("Task #%u", i);
+    anchor.done   = i % 3 == 0;
+    g_array_append_val(content->anchors, anchor);
+  }
+
+  GtkTextView* view = GTK_TEXT_VIEW(g_object_ref_sink(gtk_text_view_new()));
+  GtkTextBuffer* buffer = gtk_text_view_get_buffer(view);
+
+  g_test_timer_start();
+  GPtrArray* anchors = set_buffer_content(buffer, content);
+  gdouble one_pass = g_test_timer_elapsed();
+
+  g_assert_cmpuint(anchors->len, ==, n_tasks);
+  g_assert_cmpint(gtk_text_buffer_get_char_count(buffer), ==,
+                  g_utf8_strlen(content->text->str, -1) + n_tasks);
+
+  KanbanUnserializedContent* loaded = get_buffer_content(buffer);
+  assert_same_content(loaded, content);
+  kanban_unserialized_content_free(loaded);
+
+  /* The way anchors were inserted before */
+  GtkTextIter iter;
+
+  g_test_timer_start();
+  gtk_text_buffer_set_text(buffer, content->text->str, content->text->len);
+  gtk_text_buffer_get_end_iter(buffer, &iter);
+  for (guint i = 0; i < content->anchors->len; i++)
+  {
+    KanbanAnchor* anchor = &g_array_index(content->anchors, KanbanAnchor, i);
+    gtk_text_iter_set_offset(&iter, anchor->offset + i);
+    gtk_text_buffer_create_child_anchor(buffer, &iter);
+  }
+  gdouble by_offset = g_test_timer_elapsed();
+
+  g_test_minimized_result(one_pass, "Loaded %u tasks in %.4f s, %.4f s by offset",
+                          n_tasks, one_pass, by_offset);
+
+  g_ptr_array_unref(anchors);
+  g_object_unref(view);
+  kanban_unserialized_content_free(content);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  has_display = gtk_init_check();
+
+  g_test_add_func("/serializer/round-trip", test_round_trip);
+  g_test_add_func("/serializer/buffer-content", test_buffer_content);
+  g_test_add_func("/serializer/escaped-round-trip", test_escaped_round_trip);
+  g_test_add_func("/serializer/parse/offsets", test_parse_offsets);
+  g_test_add_func("/serializer/parse/escaped", test_parse_escaped);
+  g_test_add_func("/serializer/content-copy", test_content_copy);
+  g_test_add_func("/serializer/parse/truncated", test_parse_truncated);
+  g_test_add_func("/serializer/parse/throughput", test_parse_throughput);
+  g_test_add_func("/serializer/set-buffer-content", test_set_buffer_content);
+  g_test_add_func("/serializer/set-buffer-content/many-tasks",
+                  test_set_buffer_content_many_tasks);
+
+  return g_test_run();
+}
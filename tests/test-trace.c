@@ -0,0 +1,250 @@
+/* test-trace.c
+ *
+ * Copyright 2023 zhrexl
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include <glib/gstdio.h>
+#include <json-glib/json-glib.h>
+
+#include "utils/kanban-trace.h"
+
+typedef struct
+{
+  gchar* dir;
+  gchar* path;
+} Fixture;
+
+static void
+fixture_set_up(Fixture* fixture, gconstpointer data)
+{
+  GError* error = NULL;
+
+  fixture->dir  = g_dir_make_tmp("thisweekinmylife-XXXXXX", &error);
+  fixture->path = g_build_filename(fixture->dir, "trace.json", NULL);
+  g_assert_no_error(error);
+}
+
+static void
+fixture_tear_down(Fixture* fixture, gconstpointer data)
+{
+  g_unlink(fixture->path);
+  g_rmdir(fixture->dir);
+  g_free(fixture->path);
+  g_free(fixture->dir);
+}
+
+/* Stops the trace and returns its events, without the metadata ones */
+static GPtrArray*
+stop_and_load(Fixture* fixture, JsonParser* parser)
+{
+  GError* error = NULL;
+
+  g_assert_true(kanban_trace_stop(&error));
+  g_assert_no_error(error);
+  g_assert_false(kanban_trace_enabled);
+
+  json_parser_load_from_file(parser, fixture->path, &error);
+  g_assert_no_error(error);
+
+  JsonObject* root   = json_node_get_object(json_parser_get_root(parser));
+  JsonArray*  array  = json_object_get_array_member(root, "traceEvents");
+  GPtrArray*  events = g_ptr_array_new();
+
+  for (guint i = 0; i < json_array_get_length(array); i++)
+  {
+    JsonObject* event = json_array_get_object_element(array, i);
+
+    if (g_strcmp0(json_object_get_string_member(event, "ph"), "M") != 0)
+      g_ptr_array_add(events, event);
+  }
+
+  return events;
+}
+
+static const gchar*
+event_phase(GPtrArray* events, guint i)
+{
+  return json_object_get_string_member(g_ptr_array_index(events, i), "ph");
+}
+
+static const gchar*
+event_name(GPtrArray* events, guint i)
+{
+  return json_object_get_string_member(g_ptr_array_index(events, i), "name");
+}
+
+static void
+trace_in_thread(gpointer data, gpointer user_data)
+{
+  kanban_trace_begin("worker");
+  kanban_trace_count("items", 5);
+  kanban_trace_end("worker");
+}
+
+static void
+test_spans(Fixture* fixture, gconstpointer data)
+{
+  kanban_trace_start(fixture->path, 0);
+  g_assert_true(kanban_trace_enabled);
+
+  kanban_trace_begin("outer");
+  kanban_trace_async_begin("async", 42);
+  kanban_trace_count("items", 2);
+  kanban_trace_counter("level", 7);
+  kanban_trace_end("outer");
+
+  GThreadPool* pool = g_thread_pool_new(trace_in_thread, NULL, 1, FALSE, NULL);
+  g_thread_pool_push(pool, GUINT_TO_POINTER(1), NULL);
+  g_thread_pool_free(pool, FALSE, TRUE);
+
+  kanban_trace_async_end("async", 42);
+
+  JsonParser* parser = json_parser_new();
+  GPtrArray*  events = stop_and_load(fixture, parser);
+
+  g_assert_cmpuint(events->len, ==, 9);
+
+  g_assert_cmpstr(event_name(events, 0), ==, "outer");
+  g_assert_cmpstr(event_phase(events, 0), ==, "B");
+  g_assert_cmpstr(event_phase(events, 1), ==, "b");
+  g_assert_cmpint(json_object_get_int_member(g_ptr_array_index(events, 1), "id"), ==, 42);
+  g_assert_cmpstr(event_phase(events, 4), ==, "E");
+
+  /* Counted totals go on across threads */
+  JsonObject* count = g_ptr_array_index(events, 2);
+  g_assert_cmpstr(event_phase(events, 2), ==, "C");
+  g_assert_cmpint(json_object_get_int_member(json_object_get_object_member(count, "args"),
+                                             "value"), ==, 2);
+
+  JsonObject* worker = g_ptr_array_index(events, 5);
+  JsonObject* total  = g_ptr_array_index(events, 6);
+  g_assert_cmpstr(event_name(events, 5), ==, "worker");
+  g_assert_cmpint(json_object_get_int_member(worker, "tid"), !=, 1);
+  g_assert_cmpint(json_object_get_int_member(json_object_get_object_member(total, "args"),
+                                             "value"), ==, 7);
+
+  /* The thread starting the trace is the main one */
+  g_assert_cmpint(json_object_get_int_member(g_ptr_array_index(events, 0), "tid"), ==, 1);
+  g_assert_cmpstr(event_phase(events, 8), ==, "e");
+
+  g_ptr_array_unref(events);
+  g_object_unref(parser);
+}
+
+/* A full ring keeps the latest events, in order */
+static void
+test_ring(Fixture* fixture, gconstpointer data)
+{
+  kanban_trace_start(fixture->path, 8);
+
+  for (gint i = 0; i < 20; i++)
+    kanban_trace_counter("value", i);
+
+  JsonParser* parser = json_parser_new();
+  GPtrArray*  events = stop_and_load(fixture, parser);
+
+  g_assert_cmpuint(events->len, ==, 8);
+
+  for (guint i = 0; i < events->len; i++)
+  {
+    JsonObject* args = json_object_get_object_member(g_ptr_array_index(events, i), "args");
+    g_assert_cmpint(json_object_get_int_member(args, "value"), ==, 12 + i);
+  }
+
+  g_ptr_array_unref(events);
+  g_object_unref(parser);
+
+  /* Nothing is written without a trace */
+  g_assert_true(kanban_trace_stop(NULL));
+}
+
+static void
+scoped(void)
+{
+  KANBAN_TRACE_SCOPE("scoped");
+  KANBAN_TRACE_COUNT("calls", 1);
+}
+
+/* The macros record while tracing, and cost nothing otherwise */
+static void
+test_macros(Fixture* fixture, gconstpointer data)
+{
+  scoped();
+
+  kanban_trace_start(fixture->path, 0);
+  scoped();
+
+  JsonParser* parser = json_parser_new();
+  GPtrArray*  events = stop_and_load(fixture, parser);
+
+#if KANBAN_ENABLE_TRACING
+  g_assert_cmpuint(events->len, ==, 3);
+  g_assert_cmpstr(event_phase(events, 0), ==, "B");
+  g_assert_cmpstr(event_phase(events, 1), ==, "C");
+  g_assert_cmpstr(event_phase(events, 2), ==, "E");
+  g_assert_cmpstr(event_name(events, 2), ==, "scoped");
+#else
+  g_assert_cmpuint(events->len, ==, 0);
+#endif
+
+  g_ptr_array_unref(events);
+  g_object_unref(parser);
+}
+
+/* A span still open when the trace stops is left out of it */
+static void
+test_stopped_scope(Fixture* fixture, gconstpointer data)
+{
+  JsonParser* parser = json_parser_new();
+  GPtrArray*  events;
+
+  kanban_trace_start(fixture->path, 0);
+
+  {
+    KANBAN_TRACE_SCOPE("open");
+    events = stop_and_load(fixture, parser);
+  }
+
+  kanban_trace_end("late");
+  kanban_trace_count("late", 1);
+
+#if KANBAN_ENABLE_TRACING
+  g_assert_cmpuint(events->len, ==, 1);
+  g_assert_cmpstr(event_phase(events, 0), ==, "B");
+#else
+  g_assert_cmpuint(events->len, ==, 0);
+#endif
+
+  g_ptr_array_unref(events);
+  g_object_unref(parser);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add("/trace/spans", Fixture, NULL, fixture_set_up, test_spans, fixture_tear_down);
+  g_test_add("/trace/ring", Fixture, NULL, fixture_set_up, test_ring, fixture_tear_down);
+  g_test_add("/trace/macros", Fixture, NULL, fixture_set_up, test_macros, fixture_tear_down);
+  g_test_add("/trace/stopped-scope", Fixture, NULL, fixture_set_up, test_stopped_scope,
+             fixture_tear_down);
+
+  return g_test_run();
+}